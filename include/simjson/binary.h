@@ -0,0 +1,175 @@
+﻿/*
+ * (c) Проект "SimJson", Александр Орефков orefkov@gmail.com
+ * ver. 1.0
+ * Двоичный снимок json для чтения без разбора
+ * (c) Project "SimJson", Aleksandr Orefkov orefkov@gmail.com
+ * ver. 1.0
+ * Binary json snapshot for reading without parsing
+ */
+
+#pragma once
+#include <simjson/json.h>
+#include <cstring>
+
+namespace simjson {
+
+template<typename K>
+class JsonBinary;
+
+/*!
+ * @ru @brief Значение внутри двоичного снимка JsonBinary, только для чтения, без копирования данных.
+ * @details Лёгкий объект - указатель на данные и смещение, живёт, пока открыт снимок. Обращение к отсутствующему
+ *  ключу или индексу, как и к повреждённым данным, даёт значение с типом Undefined. Ключи объекта идут в порядке их хэшей.
+ * @tparam K - тип символов.
+ * @en @brief A value inside a JsonBinary binary snapshot, read-only, without copying data.
+ * @details A lightweight object - a pointer to the data and an offset, lives while the snapshot is open. Accessing a missing
+ *  key or index, as well as damaged data, gives a value of type Undefined. Object keys go in the order of their hashes.
+ * @tparam K - character type.
+ */
+template<typename K>
+class JsonBinaryValue {
+public:
+    using ssType = simple_str<K>;
+    using json_value = JsonValueTempl<K>;
+
+    JsonBinaryValue() = default;
+
+    Json::Type type() const {
+        return offset_ ? Json::Type(read<uint32_t>(offset_)) : Json::Undefined;
+    }
+    bool is_undefined() const {
+        return type() == Json::Undefined;
+    }
+    bool is_null() const {
+        return type() == Json::Null;
+    }
+    bool is_boolean() const {
+        return type() == Json::Boolean;
+    }
+    bool is_integer() const {
+        return type() == Json::Integer;
+    }
+    bool is_real() const {
+        return type() == Json::Real;
+    }
+    bool is_text() const {
+        return type() == Json::Text;
+    }
+    bool is_object() const {
+        return type() == Json::Object;
+    }
+    bool is_array() const {
+        return type() == Json::Array;
+    }
+
+    bool as_boolean() const {
+        return is_boolean() && count();
+    }
+    int64_t as_integer() const {
+        return is_integer() ? read<int64_t>(offset_ + 8) : 0;
+    }
+    double as_real() const {
+        return is_real() ? read<double>(offset_ + 8) : 0.0;
+    }
+    /// @ru Текст прямо в данных снимка. @en The text right in the snapshot data.
+    ssType as_text() const {
+        return is_text() ? ssType{reinterpret_cast<const K*>(base_ + offset_ + 8), count()} : ssType{};
+    }
+    /// @ru Количество элементов массива или ключей объекта. @en Number of array elements or object keys.
+    size_t size() const {
+        return is_array() || is_object() ? count() : 0;
+    }
+    /// @ru Значение по ключу, двоичный поиск по хэшу. @en Value by key, binary search by hash.
+    SIMJSON_API JsonBinaryValue at(ssType key) const;
+    /// @ru Элемент массива или значение ключа объекта по позиции. @en Array element or object key value by position.
+    SIMJSON_API JsonBinaryValue at(size_t idx) const;
+    /// @ru Ключ объекта по позиции. @en Object key by position.
+    SIMJSON_API ssType key(size_t idx) const;
+    JsonBinaryValue operator[](ssType key) const {
+        return at(key);
+    }
+    JsonBinaryValue operator[](size_t idx) const {
+        return at(idx);
+    }
+    /// @ru Построить обычное изменяемое json-значение. @en Build a usual mutable json value.
+    SIMJSON_API json_value to_json() const;
+
+protected:
+    friend class JsonBinary<K>;
+    // Проверяет, что узел целиком лежит в данных, иначе - Undefined
+    // Checks that the node lies entirely in the data, otherwise - Undefined
+    SIMJSON_API static JsonBinaryValue make(const char* base, size_t size, uint64_t offset);
+
+    template<typename T>
+    T read(uint64_t pos) const {
+        T value;
+        std::memcpy(&value, base_ + pos, sizeof(T));
+        return value;
+    }
+    uint32_t count() const {
+        return read<uint32_t>(offset_ + 4);
+    }
+
+    const char* base_{};
+    size_t size_{};
+    // 0 - Undefined, там лежит заголовок
+    // 0 - Undefined, the header lies there
+    uint64_t offset_{};
+};
+
+/*!
+ * @ru @brief Двоичный снимок json: пишется один раз, потом отображается в память и читается без разбора.
+ * @details Все узлы выровнены на 8 байт и ссылаются друг на друга смещениями, поэтому файл можно отобразить в память
+ *  как есть, и несколько процессов делят одни страницы кэша. Ключи объектов хранятся один раз и лежат в таблице,
+ *  упорядоченной по заранее посчитанному хэшу FNV-1a. Порядок байтов и размер символа - как у записавшей платформы,
+ *  снимок с другими не открывается.
+ * @tparam K - тип символов.
+ * @en @brief A binary json snapshot: written once, then mapped into memory and read without parsing.
+ * @details All nodes are aligned to 8 bytes and refer to each other by offsets, so the file can be mapped into memory
+ *  as is, and several processes share the same cache pages. Object keys are stored once and lie in a table ordered
+ *  by a precomputed FNV-1a hash. The byte order and symbol size are those of the writing platform,
+ *  a snapshot with different ones is not opened.
+ * @tparam K - character type.
+ * @~ `JsonBinary<u8s>::save(json, "ref.sjb"); JsonBinary<u8s> ref; ref.open("ref.sjb"); ref.root()["items"][0]["id"].as_integer();`
+ */
+template<typename K>
+class JsonBinary {
+public:
+    using json_value = JsonValueTempl<K>;
+
+    JsonBinary() = default;
+    SIMJSON_API ~JsonBinary();
+    JsonBinary(const JsonBinary&) = delete;
+    JsonBinary& operator=(const JsonBinary&) = delete;
+
+    /// @ru Отобразить файл снимка в память. @en Map a snapshot file into memory.
+    SIMJSON_API bool open(stra path);
+    /*!
+     * @ru @brief Читать снимок из готового буфера, он должен жить, пока открыт снимок.
+     * @en @brief Read a snapshot from a ready buffer, it must live while the snapshot is open.
+     */
+    SIMJSON_API bool attach(const void* data, size_t size);
+    /// @ru Закрыть снимок. @en Close the snapshot.
+    SIMJSON_API void close();
+    bool is_open() const {
+        return data_ != nullptr;
+    }
+    /// @ru Корневое значение. @en The root value.
+    JsonBinaryValue<K> root() const {
+        return data_ ? JsonBinaryValue<K>::make(data_, size_, root_) : JsonBinaryValue<K>{};
+    }
+
+    /// @ru Записать снимок json в буфер, прежнее содержимое заменяется. @en Write a json snapshot into the buffer, the previous contents are replaced.
+    SIMJSON_API static void store(const json_value& json, lstring<u8s, 0, true>& out);
+    /// @ru Записать снимок json в файл через временный файл и переименование, уже открытые снимки не меняются.
+    /// @en Write a json snapshot to a file via a temporary file and a rename, already opened snapshots do not change.
+    SIMJSON_API static bool save(const json_value& json, stra path);
+
+protected:
+    const char* data_{};
+    size_t size_{};
+    uint64_t root_{};
+    bool mapped_{};
+};
+
+} // namespace simjson
@@ -0,0 +1,73 @@
+﻿/*
+ * (c) Проект "SimJson", Александр Орефков orefkov@gmail.com
+ * ver. 1.0
+ * Кодирование json в CBOR (RFC 8949) и обратно
+ * (c) Project "SimJson", Aleksandr Orefkov orefkov@gmail.com
+ * ver. 1.0
+ * Encoding json into CBOR (RFC 8949) and back
+ */
+
+#pragma once
+#include <simjson/decoder.h>
+
+namespace simjson {
+
+/*!
+ * @ru @brief Записать json в CBOR в конец буфера.
+ * @details Целые пишутся целыми, вещественные - всегда float64, поэтому после from_cbor тип числа тот же.
+ *  Строки пишутся в UTF-8, Undefined в объектах пропускается, в массивах пишется как undefined.
+ * @en @brief Write json into CBOR at the end of the buffer.
+ * @details Integers are written as integers, reals - always as float64, so after from_cbor the number type is the same.
+ *  Strings are written in UTF-8, Undefined in objects is skipped, in arrays it is written as undefined.
+ */
+template<typename K>
+SIMJSON_API void to_cbor(const JsonValueTempl<K>& json, lstring<u8s, 0, true>& out);
+
+/*!
+ * @ru @brief Потоковый разбор CBOR в JsonValue, данные можно подавать порциями любого размера.
+ * @details Порции и построение дерева - как в StreamedBinaryParser, ограничения limits_ и память resource_ работают
+ *  так же, как в StreamedJsonParser. Преобразование в json - по RFC 8949, раздел 6.1: строки байтов становятся текстом
+ *  base64url без выравнивания, undefined и прочие простые значения - null, теги пропускаются, целые ключи словарей -
+ *  их десятичным текстом. Целые вне int64_t становятся вещественными.
+ * @tparam K - тип символов результата.
+ * @en @brief Streaming parsing of CBOR into JsonValue, data can be fed in chunks of any size.
+ * @details Chunks and tree building are as in StreamedBinaryParser, the limits_ and the resource_ memory work
+ *  the same as in StreamedJsonParser. Conversion to json follows RFC 8949, section 6.1: byte strings become base64url
+ *  text without padding, undefined and other simple values - null, tags are skipped, integer map keys - their decimal
+ *  text. Integers outside int64_t become real.
+ * @tparam K - character type of the result.
+ */
+template<typename K>
+struct StreamedCborParser : StreamedBinaryParser<K, StreamedCborParser<K>> {
+protected:
+    using base = StreamedBinaryParser<K, StreamedCborParser<K>>;
+    friend base;
+    using base::error_;
+    using base::stack_;
+    using base::addValue;
+    using base::addString;
+    using base::overString;
+    using base::openContainer;
+    using base::closeContainer;
+
+    size_t decodeItem(const uint8_t* ptr, size_t size);
+    void resetItem() {
+        stringMajor_ = -1;
+        stringParts_.clear();
+    }
+
+    // Строка неопределённой длины собирается по частям
+    // A string of indefinite length is collected in parts
+    int stringMajor_{-1};
+    std::string stringParts_;
+};
+
+/*!
+ * @ru @brief Разобрать CBOR в json.
+ * @en @brief Parse CBOR into json.
+ * @~ `auto [json, err, line, col] = from_cbor<u8s>(data);`
+ */
+template<typename K>
+SIMJSON_API typename JsonValueTempl<K>::parse_result from_cbor(ssa data, const ParseLimits& limits = {}, std::pmr::memory_resource* resource = nullptr);
+
+} // namespace simjson
@@ -0,0 +1,95 @@
+﻿/*
+ * (c) Проект "SimJson", Александр Орефков orefkov@gmail.com
+ * ver. 1.0
+ * Общая часть потоковых парсеров двоичных форматов
+ * (c) Project "SimJson", Aleksandr Orefkov orefkov@gmail.com
+ * ver. 1.0
+ * Common part of streaming parsers of binary formats
+ */
+
+#pragma once
+#include <simjson/json.h>
+
+namespace simjson {
+
+/*!
+ * @ru @brief Общая часть потоковых парсеров двоичных форматов (CBOR, MessagePack).
+ * @details Собирает порции данных, хранит незаконченный элемент до следующей порции и строит дерево JsonValue
+ *  с проверкой ограничений limits_. Формат разбирает только отдельные элементы в Decoder::decodeItem.
+ *  В line_ всегда 0, в col_ - сколько байтов разобрано.
+ * @tparam K - тип символов результата.
+ * @tparam Decoder - парсер формата, наследник этого класса.
+ * @en @brief Common part of streaming parsers of binary formats (CBOR, MessagePack).
+ * @details Collects chunks of data, keeps an unfinished item until the next chunk and builds the JsonValue tree,
+ *  checking the limits_. The format only decodes single items in Decoder::decodeItem.
+ *  line_ is always 0, col_ is how many bytes were parsed.
+ * @tparam K - character type of the result.
+ * @tparam Decoder - the format parser, a descendant of this class.
+ */
+template<typename K, typename Decoder>
+struct StreamedBinaryParser : StreamedJsonParserBase {
+    JsonValueTempl<K> result_;
+
+    using strType = typename JsonValueTempl<K>::strType;
+
+    /// @ru Подготовить парсер к новым данным, настройки сохраняются. @en Prepare the parser for new data, the settings are kept.
+    SIMJSON_API void reset();
+    /*!
+     * @ru @brief Разобрать порцию данных.
+     * @param last - это последняя порция.
+     * @return Success или NoNeedMore (если после значения есть ещё данные), Pending - значение ещё не закончено.
+     * @en @brief Parse a chunk of data.
+     * @param last - this is the last chunk.
+     * @return Success or NoNeedMore (if there is more data after the value), Pending - the value is not finished yet.
+     */
+    SIMJSON_API JsonParseResult processChunk(ssa chunk, bool last);
+    /// @ru Разобрать все данные за один раз. @en Parse all the data in one go.
+    JsonParseResult parseAll(ssa data) {
+        return processChunk(data, true);
+    }
+
+protected:
+    struct Frame {
+        JsonValueTempl<K>* container;
+        uint64_t remaining;
+        bool map;
+        bool indefinite;
+        bool needKey;
+        strType key;
+    };
+
+    // Добавить готовое значение в текущий контейнер, в словаре сначала идёт ключ
+    // Add a ready value to the current container, in a map the key comes first
+    bool addValue(JsonValueTempl<K>&& value);
+    // Строка UTF-8 или байты, байты становятся текстом base64url без выравнивания
+    // A UTF-8 string or bytes, bytes become base64url text without padding
+    bool addString(const uint8_t* ptr, size_t size, bool text);
+    // Строка из стольких байтов заведомо не пройдёт ограничения: даже в UTF-8 на символ не больше 4 байтов.
+    // Проверяется до того, как байты строки копятся в буфере
+    // A string of that many bytes surely fails the limits: even in UTF-8 a symbol takes at most 4 bytes.
+    // Checked before the string bytes are accumulated in a buffer
+    bool overString(uint64_t bytes) {
+        if (bytes / 4 > limits_.max_string_length || bytes > limits_.max_bytes) {
+            error_ = JsonParseResult::LimitExceeded;
+            return true;
+        }
+        return false;
+    }
+    bool openContainer(bool map, uint64_t count, bool indefinite = false);
+    // Закрыть контейнер неопределённой длины
+    // Close a container of indefinite length
+    bool closeContainer();
+    void complete();
+    // Данные формата, которые надо очистить в reset
+    // Format data to be cleared in reset
+    void resetItem() {}
+
+    std::vector<Frame> stack_;
+    // Незаконченный элемент с конца прошлой порции
+    // An unfinished item from the end of the previous chunk
+    std::vector<uint8_t> pending_;
+    bool done_{};
+    JsonParseResult error_{JsonParseResult::Pending};
+};
+
+} // namespace simjson
@@ -8,12 +8,19 @@
  */
 
 #pragma once
+#include <array>
+#include <functional>
 #include <memory>
+#include <memory_resource>
+#include <mutex>
 #include <optional>
+#include <span>
 #include <vector>
 #include <simstr/sstring.h>
 #include <cassert>
 #include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 
 #ifndef __has_declspec_attribute
@@ -36,6 +43,36 @@
     #define SIMJSON_API
 #endif
 
+#ifndef SIMJSON_STATS
+/*!
+ * @ru @brief Сбор статистики разбора и сериализации: 0 - выключен, 1 - счётчики, 2 - счётчики и такты по фазам.
+ *  Задаётся при сборке библиотеки (опция CMake SIMJSON_STATS), когда выключен, счётчики не обновляются вообще.
+ * @en @brief Collecting parse and store statistics: 0 - off, 1 - counters, 2 - counters and cycles per phase.
+ *  Set when building the library (the CMake option SIMJSON_STATS), when off, the counters are not updated at all.
+ */
+#define SIMJSON_STATS 0
+#endif
+
+#ifndef SIMJSON_PMR_ARRAYS
+/*!
+ * @ru @brief Массивы с полиморфным аллокатором: 0 - std::vector, 1 - std::pmr::vector.
+ *  При 1 источник памяти, переданный в конструктор, Clone или parse, даёт память и элементам каждого массива,
+ *  а не только самому контейнеру. Задаётся при сборке библиотеки (опция CMake SIMJSON_PMR_ARRAYS).
+ * @en @brief Arrays with a polymorphic allocator: 0 - std::vector, 1 - std::pmr::vector.
+ *  With 1 the memory resource passed to the constructor, Clone or parse also supplies the elements of every array,
+ *  not only the container itself. Set when building the library (the CMake option SIMJSON_PMR_ARRAYS).
+ */
+#define SIMJSON_PMR_ARRAYS 0
+#endif
+
+// Пустой член класса без своего адреса, MSVC понимает только свой атрибут
+// An empty class member without its own address, MSVC understands only its own attribute
+#if defined(_MSC_VER) && !defined(__clang__)
+#define SIMJSON_NO_UNIQUE_ADDRESS [[msvc::no_unique_address]]
+#else
+#define SIMJSON_NO_UNIQUE_ADDRESS [[no_unique_address]]
+#endif
+
 /*!
  * @ru @brief Пространство имён для объектов библиотеки
  * @en @brief Library namespace
@@ -60,11 +97,13 @@ public:
     struct emptyString_t {};
     struct emptyObject_t {};
     struct emptyArray_t {};
+    struct rawNumber_t {};
 
     inline static const null_t null;
     inline static const emptyString_t emptyString;
     inline static const emptyObject_t emptyObject;
     inline static const emptyArray_t emptyArray;
+    inline static const rawNumber_t rawNumber;
 };
 
 enum class JsonParseResult {
@@ -72,17 +111,212 @@ enum class JsonParseResult {
     Pending,
     NoNeedMore,
     Error,
+    LimitExceeded,
+};
+
+/*!
+ * @ru @brief Ограничения на ресурсы и настройки парсинга. При превышении любого из ограничений парсинг прерывается
+ *  с результатом JsonParseResult::LimitExceeded. По умолчанию ограничений нет.
+ * @en @brief Resource limits and settings for parsing. If any of the limits is exceeded, parsing is aborted
+ *  with the result JsonParseResult::LimitExceeded. There are no limits by default.
+ */
+struct ParseLimits {
+    /// @ru Максимальная вложенность массивов и объектов.
+    /// @en Maximum nesting depth of arrays and objects.
+    size_t max_depth = size_t(-1);
+    /// @ru Максимальная длина строки или ключа в символах.
+    /// @en Maximum length of a string or key in symbols.
+    size_t max_string_length = size_t(-1);
+    /// @ru Максимальное количество json-значений.
+    /// @en Maximum number of json values.
+    size_t max_values = size_t(-1);
+    /// @ru Максимальный объём памяти под дерево значений, в байтах. Считается приблизительно.
+    /// @en Maximum amount of memory for the value tree, in bytes. Calculated approximately.
+    size_t max_bytes = size_t(-1);
+    /// @ru Проверять, что строки и ключи - корректный UTF-8 (для входного текста в char и char8_t).
+    ///  Некорректные последовательности дают JsonParseResult::Error.
+    /// @en Check that strings and keys are valid UTF-8 (for input text in char and char8_t).
+    ///  Invalid sequences give JsonParseResult::Error.
+    bool validate_utf8 = false;
+    /// @ru Сохранять числа в виде исходного текста и переводить в число при обращении. Тогда store выводит
+    ///  числа как в исходном тексте, а целые больше int64_t доступны через number_uint или текстом через raw_number.
+    /// @en Keep numbers as the source text and convert them on access. Then store outputs numbers as in
+    ///  the source text, and integers larger than int64_t are available via number_uint or as text via raw_number.
+    bool raw_numbers = false;
+    /// @ru Хранить однородные массивы целых, вещественных или логических значений упакованными, без JsonValue на
+    ///  каждый элемент. Числа доступны через as_span, обычный API массива тоже работает.
+    /// @en Keep homogeneous arrays of integer, real or boolean values packed, without a JsonValue per element.
+    ///  The numbers are available via as_span, the usual array API works too.
+    bool packed_arrays = false;
+};
+
+/*!
+ * @ru @brief Статистика разбора JSON. Заполняется, только если библиотека собрана с SIMJSON_STATS.
+ * @details Время по фазам (при SIMJSON_STATS=2) - в тактах процессора, где их нет - в тиках steady_clock.
+ *  Выделения памяти считаются так же приблизительно, как для ParseLimits::max_bytes.
+ * @en @brief JSON parse statistics. Filled only if the library is built with SIMJSON_STATS.
+ * @details Time per phase (with SIMJSON_STATS=2) is in CPU cycles, where there are none - in steady_clock ticks.
+ *  Memory allocations are counted as approximately as for ParseLimits::max_bytes.
+ */
+struct JsonParseStats {
+    /// @ru Обработано байтов входного текста. @en Bytes of input text processed.
+    size_t bytes{};
+    /// @ru Количество значений по Json::Type. @en Number of values by Json::Type.
+    size_t values[Json::Array + 1]{};
+    /// @ru Раскодировано escape-последовательностей. @en Escape sequences decoded.
+    size_t escapes{};
+    /// @ru Разобрано целых чисел. @en Integers parsed.
+    size_t integers{};
+    /// @ru Разобрано вещественных чисел. @en Real numbers parsed.
+    size_t reals{};
+    /// @ru Целые, не влезшие в int64_t и ставшие вещественными. @en Integers that did not fit into int64_t and became real.
+    size_t fallbacks{};
+    /// @ru Наибольшая вложенность массивов и объектов. @en Maximum nesting depth of arrays and objects.
+    size_t max_depth{};
+    /// @ru Выделений памяти под дерево. @en Memory allocations for the tree.
+    size_t allocations{};
+    /// @ru Байтов памяти под дерево. @en Bytes of memory for the tree.
+    size_t allocated_bytes{};
+    /// @ru Всё время разбора. @en The whole parse time.
+    uint64_t cycles_total{};
+    /// @ru Создание строк и ключей: раскодирование и перекодирование. @en Creating strings and keys: unescaping and transcoding.
+    uint64_t cycles_strings{};
+    /// @ru Перевод чисел. @en Converting numbers.
+    uint64_t cycles_numbers{};
+    /// @ru Вставка в объекты и массивы. @en Inserting into objects and arrays.
+    uint64_t cycles_insert{};
+
+    /// @ru Просмотр текста - всё остальное время. @en Scanning the text - all the rest of the time.
+    uint64_t cycles_scan() const {
+        return cycles_total - cycles_strings - cycles_numbers - cycles_insert;
+    }
+    SIMJSON_API JsonParseStats& operator+=(const JsonParseStats& other);
+    /*!
+     * @ru @brief Сумма статистики разборов через JsonValueTempl::parse в текущем потоке.
+     * @en @brief The sum of statistics of parses via JsonValueTempl::parse in the current thread.
+     */
+    SIMJSON_API static JsonParseStats& thread_total();
+};
+
+/// @ru Статистика разбора в парсере, когда библиотека собрана без SIMJSON_STATS: пустая и не занимает места.
+/// @en Parse statistics in a parser when the library is built without SIMJSON_STATS: empty and takes no space.
+struct JsonNoParseStats {};
+
+/*!
+ * @ru @brief Статистика сериализации store и store_utf8 в текущем потоке. Заполняется, только если библиотека
+ *  собрана с SIMJSON_STATS, накапливается, пока её не сбросят.
+ * @en @brief Statistics of store and store_utf8 serialization in the current thread. Filled only if the library
+ *  is built with SIMJSON_STATS, accumulates until it is reset.
+ */
+struct JsonStoreStats {
+    /// @ru Количество вызовов. @en Number of calls.
+    size_t calls{};
+    /// @ru Записано байтов. @en Bytes written.
+    size_t bytes{};
+    /// @ru Количество значений по Json::Type. @en Number of values by Json::Type.
+    size_t values[Json::Array + 1]{};
+    /// @ru Строк и ключей, потребовавших экранирования. @en Strings and keys that needed escaping.
+    size_t escaped_strings{};
+    /// @ru Наибольшая вложенность массивов и объектов. @en Maximum nesting depth of arrays and objects.
+    size_t max_depth{};
+    /// @ru Подсчёт длины результата. @en Measuring the result length.
+    uint64_t cycles_measure{};
+    /// @ru Запись результата. @en Writing the result.
+    uint64_t cycles_write{};
+
+    SIMJSON_API static JsonStoreStats& thread_total();
 };
 
 struct StreamedJsonParserBase {
 
     unsigned line_{};
     unsigned col_{};
+    ParseLimits limits_{};
+    // Статистика текущего разбора, заполняется при SIMJSON_STATS, без неё - пустая
+    // Statistics of the current parse, filled with SIMJSON_STATS, empty without it
+    SIMJSON_NO_UNIQUE_ADDRESS std::conditional_t<SIMJSON_STATS != 0, JsonParseStats, JsonNoParseStats> stats_{};
+    // Источник памяти для создаваемых объектов и массивов, nullptr - обычная куча
+    // Memory resource for created objects and arrays, nullptr - the usual heap
+    std::pmr::memory_resource* resource_{};
 
 protected:
+    // Пропуск значений, не попавших в проекцию
+    // Skipping values not included in the projection
+    bool skipNext_{};
+    // Вложенность пропускаемого значения: true - объект, false - массив, и что в нём ожидается дальше
+    // Nesting of the skipped value: true - object, false - array, and what is expected in it next
+    std::vector<bool> skipStack_;
+    int skipExpect_{};
     int state_ {};
     u16s currentUnicode_[2]{};
     int idxUnicode_{};
+    size_t values_{};
+    size_t bytes_{};
+    // Состояние проверки UTF-8: сколько ещё ждём байтов продолжения и их допустимый диапазон
+    // UTF-8 check state: how many continuation bytes are still expected and their allowed range
+    unsigned utf8Need_{};
+    unsigned utf8Lo_{0x80};
+    unsigned utf8Hi_{0xBF};
+
+    void resetState() {
+        line_ = 0;
+        col_ = 0;
+        skipNext_ = false;
+        skipStack_.clear();
+        skipExpect_ = 0;
+        state_ = 0;
+        currentUnicode_[0] = currentUnicode_[1] = 0;
+        idxUnicode_ = 0;
+        values_ = 0;
+        bytes_ = 0;
+        utf8Need_ = 0;
+        utf8Lo_ = 0x80;
+        utf8Hi_ = 0xBF;
+        stats_ = {};
+    }
+
+    bool overBytes(size_t bytes) {
+        bytes_ += bytes;
+#if SIMJSON_STATS != 0
+        stats_.allocations++;
+        stats_.allocated_bytes += bytes;
+#endif
+        return bytes_ > limits_.max_bytes;
+    }
+
+    bool checkUtf8(unsigned symbol) {
+        if (!utf8Need_) {
+            if (symbol < 0x80) {
+                return true;
+            }
+            if (symbol < 0xC2 || symbol > 0xF4) {
+                return false;
+            }
+            if (symbol < 0xE0) {
+                utf8Need_ = 1;
+            } else if (symbol < 0xF0) {
+                // Отсекаем избыточные формы и суррогаты
+                // Reject overlong forms and surrogates
+                utf8Need_ = 2;
+                utf8Lo_ = symbol == 0xE0 ? 0xA0 : 0x80;
+                utf8Hi_ = symbol == 0xED ? 0x9F : 0xBF;
+            } else {
+                // Отсекаем избыточные формы и символы больше U+10FFFF
+                // Reject overlong forms and symbols above U+10FFFF
+                utf8Need_ = 3;
+                utf8Lo_ = symbol == 0xF0 ? 0x90 : 0x80;
+                utf8Hi_ = symbol == 0xF4 ? 0x8F : 0xBF;
+            }
+            return true;
+        }
+        if (symbol < utf8Lo_ || symbol > utf8Hi_) {
+            return false;
+        }
+        utf8Lo_ = 0x80;
+        utf8Hi_ = 0xBF;
+        utf8Need_--;
+        return true;
+    }
 };
 
 namespace jt {
@@ -119,6 +353,334 @@ concept JsonObjectSource = requires(const T& t) {
 
 } // namespace jt
 
+/*!
+ * @ru @brief Строковое выражение для вставки текста с экранированием по правилам JSON.
+ * @tparam K - тип символов.
+ * @tparam LowerHex - писать шестнадцатеричные цифры в \\uXXXX строчными, как требует RFC 8785.
+ * @en @brief String expression for inserting text escaped according to JSON rules.
+ * @tparam K - character type.
+ * @tparam LowerHex - write hex digits in \\uXXXX in lower case, as RFC 8785 requires.
+ */
+template<typename K, bool LowerHex = false>
+struct expr_json_str {
+    using symb_type = K;
+    using test_type = std::make_unsigned_t<K>;
+    using ssType = simple_str<K>;
+    ssType text;
+    size_t l;
+
+    size_t length() const noexcept {
+        return l;
+    }
+
+    explicit expr_json_str(ssType t) : text(t) {
+        const K* ptr = text.symbols();
+        size_t add = 0;
+        for (size_t i = text.length(); i-- ;) {
+            test_type s = (test_type)*ptr++;
+            switch (s) {
+            case '\b':
+            case '\f':
+            case '\r':
+            case '\n':
+            case '\t':
+            case '\"':
+            case '\\':
+                add++;
+                break;
+            default:
+                if (s < ' ') {
+                    add += 5; // \u0001
+                }
+            }
+        }
+        l = text.length() + add;
+    }
+
+    K* place(K* ptr) const noexcept{
+        static constexpr ssType repl[] = {
+            uni_string(K, "\\u0000"),
+            uni_string(K, "\\u0001"),
+            uni_string(K, "\\u0002"),
+            uni_string(K, "\\u0003"),
+            uni_string(K, "\\u0004"),
+            uni_string(K, "\\u0005"),
+            uni_string(K, "\\u0006"),
+            uni_string(K, "\\u0007"),
+            uni_string(K, "\\b"),
+            uni_string(K, "\\t"),
+            uni_string(K, "\\n"),
+            uni_string(K, "\\u000B"),
+            uni_string(K, "\\f"),
+            uni_string(K, "\\r"),
+            uni_string(K, "\\u000E"),
+            uni_string(K, "\\u000F"),
+            uni_string(K, "\\u0010"),
+            uni_string(K, "\\u0011"),
+            uni_string(K, "\\u0012"),
+            uni_string(K, "\\u0013"),
+            uni_string(K, "\\u0014"),
+            uni_string(K, "\\u0015"),
+            uni_string(K, "\\u0016"),
+            uni_string(K, "\\u0017"),
+            uni_string(K, "\\u0018"),
+            uni_string(K, "\\u0019"),
+            uni_string(K, "\\u001A"),
+            uni_string(K, "\\u001B"),
+            uni_string(K, "\\u001C"),
+            uni_string(K, "\\u001D"),
+            uni_string(K, "\\u001E"),
+            uni_string(K, "\\u001F"),
+        };
+        const K* r = text.symbols();
+        size_t lenOfText = text.length(), lenOfTail = l - lenOfText;
+        while (lenOfTail) {
+            test_type s = (test_type)*r++;
+            switch (s) {
+            case '\"':
+                *ptr++ = '\\';
+                *ptr++ = '\"';
+                lenOfTail--;
+                break;
+            case '\\':
+                *ptr++ = '\\';
+                *ptr++ = '\\';
+                lenOfTail--;
+                break;
+            default:
+                if (s < ' ') {
+                    ptr = repl[s].place(ptr);
+                    lenOfTail -= repl[s].len - 1;
+                    if constexpr (LowerHex) {
+                        // Буквой может быть только последняя цифра, \\u001A - \\u001F
+                        // Only the last digit can be a letter, \\u001A - \\u001F
+                        if (ptr[-1] >= 'A' && ptr[-1] <= 'F') {
+                            ptr[-1] |= 0x20;
+                        }
+                    }
+                } else {
+                    *ptr++ = s;
+                }
+            }
+            lenOfText--;
+        }
+        if (lenOfText) {
+            std::char_traits<K>::copy(ptr, r, lenOfText);
+            ptr += lenOfText;
+        }
+        return ptr;
+    }
+};
+
+namespace jt {
+
+// Символ после '\\' для коротких escape-последовательностей, или 0
+// Symbol after '\\' for short escape sequences, or 0
+constexpr char short_escape(unsigned char s) {
+    switch (s) {
+    case '\"':
+        return '\"';
+    case '\\':
+        return '\\';
+    case '\b':
+        return 'b';
+    case '\f':
+        return 'f';
+    case '\n':
+        return 'n';
+    case '\r':
+        return 'r';
+    case '\t':
+        return 't';
+    default:
+        return 0;
+    }
+}
+
+/*!
+ * @ru @brief Имя ключа, передаваемое как параметр шаблона. Позволяет экранировать ключ на этапе компиляции.
+ * @en @brief Key name passed as a template parameter. Allows to escape the key at compile time.
+ */
+template<size_t N>
+struct key_name {
+    char symbols[N]{};
+    consteval key_name(const char (&s)[N]) {
+        for (size_t i = 0; i < N; i++) {
+            symbols[i] = s[i];
+        }
+    }
+    static constexpr size_t length() {
+        return N - 1;
+    }
+    constexpr bool is_ascii() const {
+        for (size_t i = 0; i < N - 1; i++) {
+            if ((unsigned char)symbols[i] >= 0x80) {
+                return false;
+            }
+        }
+        return true;
+    }
+    // Длина после экранирования, по тем же правилам, что и в expr_json_str
+    // Length after escaping, by the same rules as in expr_json_str
+    constexpr size_t escaped_length() const {
+        size_t l = N - 1;
+        for (size_t i = 0; i < N - 1; i++) {
+            unsigned char s = (unsigned char)symbols[i];
+            if (short_escape(s)) {
+                l++;
+            } else if (s < ' ') {
+                l += 5;
+            }
+        }
+        return l;
+    }
+};
+
+template<key_name Name>
+struct json_key {};
+
+template<typename K, key_name Name>
+consteval auto make_json_key_text() {
+    static_assert(sizeof(K) == 1 || Name.is_ascii(), "Only ASCII key names are allowed for wide characters");
+    constexpr char hex[] = "0123456789ABCDEF";
+    std::array<K, Name.escaped_length() + 3> res{};
+    size_t pos = 0;
+    res[pos++] = K('\"');
+    for (size_t i = 0; i < Name.length(); i++) {
+        unsigned char s = (unsigned char)Name.symbols[i];
+        if (char e = short_escape(s)) {
+            res[pos++] = K('\\');
+            res[pos++] = K(e);
+        } else if (s < ' ') {
+            res[pos++] = K('\\');
+            res[pos++] = K('u');
+            res[pos++] = K('0');
+            res[pos++] = K('0');
+            res[pos++] = K(hex[s >> 4]);
+            res[pos++] = K(hex[s & 0xF]);
+        } else {
+            res[pos++] = K(s);
+        }
+    }
+    res[pos++] = K('\"');
+    res[pos++] = K(':');
+    return res;
+}
+
+/// @ru Экранированный на этапе компиляции текст ключа в виде `"key":`.
+/// @en The key text escaped at compile time in the form `"key":`.
+template<typename K, key_name Name>
+inline constexpr auto json_key_text = make_json_key_text<K, Name>();
+
+} // namespace jt
+
+/*!
+ * @ru @brief Литерал для ключа, экранируемого на этапе компиляции. Используется в JsonEncoder.
+ * @en @brief Literal for a key escaped at compile time. Used in JsonEncoder.
+ * @~ `e("id"_jk, id);`
+ */
+template<jt::key_name Name>
+constexpr jt::json_key<Name> operator""_jk() {
+    return {};
+}
+
+/*!
+ * @ru @brief Проекция - набор путей, которые надо построить при парсинге. Всё остальное парсер пропускает,
+ *  не создавая строк, чисел и узлов.
+ * @details Пути задаются в виде JSON pointer: "/data/items", "/meta". Пустой путь "" - весь документ.
+ *  Значение по пути строится целиком. В объектах по дороге к путям остаются только нужные ключи.
+ *  Для массивов по дороге к путям проекция применяется к каждому элементу, простые значения по дороге сохраняются.
+ * @tparam K - тип символов.
+ * @en @brief Projection - a set of paths to be built when parsing. The parser skips everything else,
+ *  without creating strings, numbers and nodes.
+ * @details Paths are given as JSON pointers: "/data/items", "/meta". An empty path "" is the whole document.
+ *  The value at a path is built entirely. Objects on the way to the paths keep only the required keys.
+ *  For arrays on the way to the paths, the projection is applied to each element, simple values on the way are kept.
+ * @tparam K - character type.
+ */
+template<typename K>
+class JsonProjection {
+public:
+    inline static const size_t npos = size_t(-1);
+
+    JsonProjection() = default;
+    JsonProjection(std::initializer_list<simple_str<K>> pointers) {
+        for (const auto& p : pointers) {
+            add(p);
+        }
+    }
+    /*!
+     * @ru @brief Добавить путь в виде JSON pointer.
+     * @en @brief Add a path as a JSON pointer.
+     */
+    SIMJSON_API void add(simple_str<K> pointer);
+    /*!
+     * @ru @brief Найти дочерний узел по ключу.
+     * @return индекс узла или npos.
+     * @en @brief Find a child node by key.
+     * @return node index or npos.
+     */
+    size_t find(size_t node, simple_str<K> key) const {
+        for (size_t i = node + 1; i < nodes_.size(); i++) {
+            if (nodes_[i].parent == node && simple_str<K>(nodes_[i].key) == key) {
+                return i;
+            }
+        }
+        return npos;
+    }
+    /*!
+     * @ru @brief Строится ли значение узла целиком.
+     * @en @brief Whether the node value is built entirely.
+     */
+    bool all(size_t node) const {
+        return nodes_[node].all;
+    }
+
+protected:
+    struct Node {
+        sstring<K> key;
+        size_t parent;
+        bool all;
+    };
+    // Узел 0 - корень документа
+    // Node 0 is the document root
+    std::vector<Node> nodes_{Node{{}, npos, false}};
+};
+
+/*!
+ * @ru @brief Сколько памяти в куче занимает дерево json-значения, в байтах, см. JsonValueTempl::memory_usage.
+ * @details Размеры узлов хэш-таблицы, управляющих блоков shared_ptr и буферов строк оцениваются по их устройству
+ *  в стандартной библиотеке и simstr, поэтому результат приблизительный, но стабильный.
+ * @en @brief How much heap memory the tree of a json value takes, in bytes, see JsonValueTempl::memory_usage.
+ * @details Sizes of hash table nodes, shared_ptr control blocks and string buffers are estimated by their layout
+ *  in the standard library and simstr, so the result is approximate but stable.
+ */
+struct JsonMemoryUsage {
+    /// @ru Объекты и массивы: узлы, корзины, занятые элементы, управляющие блоки. @en Objects and arrays: nodes, buckets, used elements, control blocks.
+    size_t containers{};
+    /// @ru Буферы ключей объектов. @en Buffers of object keys.
+    size_t keys{};
+    /// @ru Буферы строковых значений. @en Buffers of string values.
+    size_t strings{};
+    /// @ru Выделенная, но не занятая ёмкость массивов. @en Allocated but unused capacity of arrays.
+    size_t slack{};
+    /// @ru Из всего этого - в объектах и массивах, на которые есть ещё ссылки (use_count > 1).
+    /// @en Of all this - in objects and arrays that are referenced elsewhere too (use_count > 1).
+    size_t shared{};
+
+    /// @ru Всего. @en Total.
+    size_t total() const {
+        return containers + keys + strings + slack;
+    }
+    /// @ru Память, принадлежащая только этому значению. @en Memory owned by this value only.
+    size_t exclusive() const {
+        return total() - shared;
+    }
+};
+
+template<typename K>
+class JsonColumns;
+
 /*!
  * @brief Класс для представления json значения.
  * @tparam K - тип символов.
@@ -133,9 +695,61 @@ public:
 
     using json_value = JsonValueTempl<K>;
     using obj_type = hashStrMap<K, JsonValueTempl<K>>;
-    using arr_type = std::vector<JsonValueTempl<K>>;
+    // Вектор для элементов массивов, см. SIMJSON_PMR_ARRAYS
+    // A vector for array elements, see SIMJSON_PMR_ARRAYS
+    template<typename T>
+    using vector_type = std::conditional_t<SIMJSON_PMR_ARRAYS != 0, std::pmr::vector<T>, std::vector<T>>;
+    using arr_type = vector_type<JsonValueTempl<K>>;
     using json_object = std::shared_ptr<obj_type>;
     using json_array = std::shared_ptr<arr_type>;
+    /*!
+     * @ru @brief Упакованный однородный массив. Значения лежат подряд в векторе своего типа.
+     * @details size, as_span, value_at и сериализация читают упакованные значения напрямую. Обращения по ссылке
+     *  к константному значению (at, operator[], as_array) один раз строят постоянные элементы-копии,
+     *  ссылки на них действительны, пока жив массив. Для изменения массив распаковывается через unpack.
+     * @en @brief A packed homogeneous array. The values lie in a row in the vector of their type.
+     * @details size, as_span, value_at and serialization read the packed values directly. Access by reference
+     *  to a constant value (at, operator[], as_array) builds permanent element copies once, references
+     *  to them are valid while the array is alive. To modify the array it is unpacked via unpack.
+     */
+    struct packed_type {
+        // Integer, Real или Boolean
+        // Integer, Real or Boolean
+        Type type;
+        vector_type<int64_t> integers;
+        vector_type<double> reals;
+        vector_type<uint8_t> booleans;
+        // Элементы как json-значения, строятся при первом обращении по ссылке
+        // Elements as json values, built on the first access by reference
+        mutable json_array items;
+        mutable std::once_flag built;
+
+        explicit packed_type(Type t, std::pmr::memory_resource* resource = nullptr)
+            : type(t), integers(make_vector<int64_t>(resource)), reals(make_vector<double>(resource)), booleans(make_vector<uint8_t>(resource)) {}
+        packed_type(const packed_type& other, std::pmr::memory_resource* resource = nullptr) : packed_type(other.type, resource) {
+            // Присваивание pmr-вектору сохраняет его источник памяти
+            // Assignment to a pmr vector keeps its memory resource
+            integers = other.integers;
+            reals = other.reals;
+            booleans = other.booleans;
+        }
+        /// @ru Источник памяти значений, nullptr без SIMJSON_PMR_ARRAYS. @en Memory resource of the values, nullptr without SIMJSON_PMR_ARRAYS.
+        std::pmr::memory_resource* resource() const {
+            return vector_resource(integers);
+        }
+
+        size_t size() const {
+            switch (type) {
+            case Integer:
+                return integers.size();
+            case Real:
+                return reals.size();
+            default:
+                return booleans.size();
+            }
+        }
+    };
+    using json_packed = std::shared_ptr<packed_type>;
 
     /// @ru Создает пустой объект с типом Undefined.
     /// @en Creates an empty object of type Undefined.
@@ -147,7 +761,16 @@ public:
     /// @en Move constructor.
     JsonValueTempl(JsonValueTempl&& other) noexcept {
         type_ = other.type_;
-        switch (other.type_) {
+        raw_ = other.raw_;
+        packed_ = other.packed_;
+        other.raw_ = false;
+        other.packed_ = false;
+        if (packed_) {
+            new (&val_.packed) json_packed(std::move(other.val_.packed));
+            other.type_ = Undefined;
+            return;
+        }
+        switch (raw_ ? Text : other.type_) {
         case Json::Text:
             new (&val_.text) strType(std::move(other.val_.text));
             break;
@@ -210,6 +833,12 @@ public:
     /// @ru Конструктор для создания json::null.
     /// @en Constructor for creating json::null.
     JsonValueTempl(const null_t&) : type_(Null) {}
+    /// @ru Конструктор числа, хранимого в виде текста. Текст должен быть корректным числом JSON, type - Integer или Real.
+    /// @en Constructor of a number stored as text. The text must be a valid JSON number, type - Integer or Real.
+    JsonValueTempl(const rawNumber_t&, Type type, strType text) : type_(type), raw_(true) {
+        assert(type == Integer || type == Real);
+        new (&val_.text) strType(std::move(text));
+    }
     /// @ru Конструктор для создания пустой строки.
     /// @en Constructor for creating an empty string.
     JsonValueTempl(const emptyString_t&) : type_(Text) { new (&val_.text) strType; }
@@ -223,9 +852,21 @@ public:
     JsonValueTempl(const emptyArray_t&) : type_(Array) {
         new (&val_.array) json_array(std::make_shared<arr_type>());
     }
-    /// @ru Конструктор для создания дефолтного значения с типом type.
-    /// @en Constructor for creating a default value with type type.
-    SIMJSON_API JsonValueTempl(Type type);
+    /*!
+     * @ru @brief Конструктор для создания дефолтного значения с типом type.
+     * @param type - тип значения.
+     * @param resource - источник памяти для объекта или массива вместе с управляющим блоком shared_ptr. Если не задан -
+     *  используется обычная куча. Элементы массива берутся из него при SIMJSON_PMR_ARRAYS, узлы объекта -
+     *  всегда из обычной кучи.
+     *  Источник должен жить дольше, чем созданное значение и все его копии.
+     * @en @brief Constructor for creating a default value with type type.
+     * @param type - value type.
+     * @param resource - memory resource for an object or array together with the shared_ptr control block. If not
+     *  specified, the usual heap is used. Array elements are taken from it with SIMJSON_PMR_ARRAYS, object nodes
+     *  are always taken from the usual heap.
+     *  The resource must outlive the created value and all its copies.
+     */
+    SIMJSON_API JsonValueTempl(Type type, std::pmr::memory_resource* resource = nullptr);
 
     struct KeyInit : std::pair<const jt::KeyType<K>, json_value> {
         using base = std::pair<const jt::KeyType<K>, json_value>;
@@ -282,12 +923,17 @@ public:
 
     struct Clone {
         const json_value& from;
+        std::pmr::memory_resource* resource{};
     };
     /*!
      * @ru @brief Конструктор клонирования. В этом случае для объектов и массивов создаются "глубокие" копии.
+     *  Если в clone задан resource, память под копию объекта или массива берётся из него, под элементы массивов -
+     *  при SIMJSON_PMR_ARRAYS.
      * @param clone - клонируемый объект.
      * @return копию json-значения.
      * @en @brief Clone constructor. In this case, "deep" copies are created for objects and arrays.
+     *  If resource is specified in clone, memory for a copy of the object or array is taken from it, for array
+     *  elements - with SIMJSON_PMR_ARRAYS.
      * @param clone - cloned object.
      * @return a copy of the json value.
      */
@@ -370,13 +1016,13 @@ public:
     /// @en Get value as integer. The debug version checks that the value is really an integer
     int64_t as_integer() const {
         assert(type_ == Integer);
-        return val_.integer;
+        return int_value();
     }
     /// @ru Получить integer, если хранится integer, или ничего. Пример: auto val = json.integer().value_or(10);
     /// @en Get an integer if the stored value is an integer, or nothing. Example: auto val = json.integer().value_or(10);
     std::optional<int64_t> integer() const {
         if (type_ == Integer) {
-            return val_.integer;
+            return int_value();
         }
         return {};
     }
@@ -385,7 +1031,7 @@ public:
     template<typename Exc, typename ... Args> requires (std::is_constructible_v<Exc, Args...>)
     int64_t integer_or_throw(Args&&...args) const {
         if (type_ == Integer) {
-            return val_.integer;
+            return int_value();
         }
         throw Exc(std::forward<Args>(args)...);
     }
@@ -412,13 +1058,13 @@ public:
     /// @en Get the value as double. The debug version checks that the value is really double
     double as_real() const {
         assert(type_ == Real);
-        return val_.real;
+        return real_value();
     }
     /// @ru Получить double, если хранится double, или ничего. Пример: auto val = json.real().value_or(10.0);
     /// @en Get double if double is stored, or nothing. Example: auto val = json.real().value_or(10.0);
     std::optional<double> real() const {
         if (type_ == Real) {
-            return val_.real;
+            return real_value();
         }
         return {};
     }
@@ -427,7 +1073,7 @@ public:
     template<typename Exc, typename ... Args> requires (std::is_constructible_v<Exc, Args...>)
     double real_or_throw(Args&&...args) {
         if (type_ == Real) {
-            return val_.real;
+            return real_value();
         }
         throw Exc(std::forward<Args>(args)...);
     }
@@ -465,6 +1111,19 @@ public:
         }
         throw Exc(std::forward<Args>(args)...);
     }
+    /// @ru Возвращает uint64_t, если хранится неотрицательное целое, влезающее в uint64_t, либо ничего.
+    ///  Для чисел, сохранённых текстом, работает и для целых больше int64_t.
+    /// @en Returns uint64_t if a non-negative integer that fits into uint64_t is stored, or nothing.
+    ///  For numbers stored as text, it also works for integers larger than int64_t.
+    SIMJSON_API std::optional<uint64_t> number_uint() const;
+    /// @ru Возвращает исходный текст числа, если число хранится текстом, либо ничего.
+    /// @en Returns the source text of the number if the number is stored as text, or nothing.
+    std::optional<ssType> raw_number() const {
+        if (raw_) {
+            return val_.text;
+        }
+        return {};
+    }
 
     // --------------------------------------- Text -----------------------------
 
@@ -518,18 +1177,80 @@ public:
         assert(type_ == Object);
         return val_.object;
     }
-    /// @ru Получить значение как json Array. В отладочной версии проверяется, что значение действительно Array.
-    /// @en Get value as json Array. The debug version checks that the value is indeed an Array.
+    /// @ru Получить значение как json Array для изменения, упакованный массив распаковывается.
+    ///  В отладочной версии проверяется, что значение действительно Array.
+    /// @en Get value as json Array for modification, a packed array is unpacked.
+    ///  The debug version checks that the value is indeed an Array.
     json_array& as_array() {
         assert(type_ == Array);
+        if (packed_) {
+            unpack();
+        }
         return val_.array;
     }
-    /// @ru Получить значение как json Array. В отладочной версии проверяется, что значение действительно Array.
-    /// @en Get value as json Array. The debug version checks that the value is indeed an Array.
+    /// @ru Получить значение как json Array. Для упакованного массива - его постоянные элементы-копии.
+    ///  В отладочной версии проверяется, что значение действительно Array.
+    /// @en Get value as json Array. For a packed array - its permanent element copies.
+    ///  The debug version checks that the value is indeed an Array.
     const json_array& as_array() const {
         assert(type_ == Array);
-        return val_.array;
+        return packed_ ? packedItems() : val_.array;
+    }
+    /// @ru Массив хранится упакованным. @en The array is stored packed.
+    bool is_packed() const {
+        return packed_;
     }
+    /*!
+     * @ru @brief Значения упакованного массива без копирования.
+     * @tparam T - int64_t для целых, double для вещественных, uint8_t для логических значений (0 или 1).
+     * @return Пустой span, если это не упакованный массив с элементами типа T.
+     *  Span перестаёт быть действительным после unpack этого значения, если других копий массива нет.
+     * @en @brief Values of a packed array without copying.
+     * @tparam T - int64_t for integers, double for reals, uint8_t for boolean values (0 or 1).
+     * @return An empty span if this is not a packed array with elements of type T.
+     *  The span is no longer valid after unpack of this value if there are no other copies of the array.
+     */
+    template<typename T>
+    std::span<const T> as_span() const {
+        static_assert(std::is_same_v<T, int64_t> || std::is_same_v<T, double> || std::is_same_v<T, uint8_t>,
+            "as_span supports int64_t, double and uint8_t");
+        if (type_ == Array && packed_) {
+            if constexpr (std::is_same_v<T, int64_t>) {
+                if (val_.packed->type == Integer) {
+                    return val_.packed->integers;
+                }
+            } else if constexpr (std::is_same_v<T, double>) {
+                if (val_.packed->type == Real) {
+                    return val_.packed->reals;
+                }
+            } else {
+                if (val_.packed->type == Boolean) {
+                    return val_.packed->booleans;
+                }
+            }
+        }
+        return {};
+    }
+    /*!
+     * @ru @brief Упаковать массив, если все его элементы - целые, вещественные или логические значения одного типа.
+     * @details Массив, на который ссылаются другие значения, не упаковывается.
+     * @return true, если массив теперь упакован.
+     * @en @brief Pack the array if all its elements are integer, real or boolean values of one type.
+     * @details An array referenced by other values is not packed.
+     * @return true if the array is now packed.
+     */
+    SIMJSON_API bool pack();
+    /*!
+     * @ru @brief Распаковать массив в обычный, чтобы его можно было менять.
+     * @details Распаковывается только это значение, другие копии массива остаются упакованными.
+     *  Span, полученные через as_span, могут перестать быть действительными.
+     * @return true, если массив был упакован.
+     * @en @brief Unpack the array into a usual one so it can be modified.
+     * @details Only this value is unpacked, other copies of the array stay packed.
+     *  Spans obtained via as_span may become invalid.
+     * @return true if the array was packed.
+     */
+    SIMJSON_API bool unpack();
     /// @ru Обменять значения.
     /// @en Exchange values.
     void swap(json_value& other) noexcept {
@@ -664,8 +1385,14 @@ public:
         }
         return as_object()->emplace(std::forward<Key>(key), std::forward<Args>(args)...).first->second;
     }
-    /// @ru Обращение к элементу константного массива по индексу. Если это не json-массив или индекс за границами массива - возвращает ссылку на UNDEFINED.
-    /// @en Accessing a constant array element by index. If this is not a json array or an index outside the bounds of the array, it returns a reference to UNDEFINED.
+    /*!
+     * @ru @brief Обращение к элементу константного массива по индексу.
+     * @return Ссылку на элемент или на UNDEFINED, если это не json-массив или индекс за границами массива.
+     *  Для упакованного массива - ссылку на его постоянную копию элемента, см. packed_type.
+     * @en @brief Accessing a constant array element by index.
+     * @return A reference to the element or to UNDEFINED if this is not a json array or the index is out of bounds.
+     *  For a packed array - a reference to its permanent element copy, see packed_type.
+     */
     const json_value& at(size_t idx) const {
         if (type_ == Array) {
             const auto& arr = *as_array();
@@ -680,17 +1407,25 @@ public:
     const json_value& operator[](size_t idx) const {
         return at(idx);
     }
+    /// @ru Копия элемента массива по индексу, в том числе упакованного. Если элемента нет - Undefined.
+    /// @en A copy of an array element by index, packed arrays included. If there is no element - Undefined.
+    json_value value_at(size_t idx) const {
+        if (type_ == Array && packed_) {
+            return idx < val_.packed->size() ? packedItem(idx) : json_value{};
+        }
+        return at(idx);
+    }
     /*!
      * @ru @brief Обращение к элементу массива по индексу.
      * @param idx - индекс элемента.
      * @return json_value& - ссылку на указанный элемент массива.
-     * @details Если это значение не json-массив - "превращает" его в массив.
+     * @details Если это значение не json-массив - "превращает" его в массив. Упакованный массив распаковывается.
      *      Если индекс == -1 - добавляет в массив ещё один элемент.
      *      Если индекс больше длины массива - увеличивает массив до заданного индекса.
      * @en @brief Access an array element by index.
      * @param idx - element index.
      * @return json_value& - a reference to the specified array element.
-     * @details If this value is not a json array, "turns" it into an array.
+     * @details If this value is not a json array, "turns" it into an array. A packed array is unpacked.
      * If index == -1 - adds one more element to the array.
      * If the index is greater than the length of the array, increases the array to the specified index.
      */
@@ -699,6 +1434,7 @@ public:
             assert(this != &UNDEFINED);
             *this = emptyArray;
         }
+        unpack();
         auto& arr = *as_array();
         if (idx == -1) {
             idx = arr.size();
@@ -712,7 +1448,7 @@ public:
     /// @en The number of elements of a json array or keys of a json object.
     size_t size() const {
         if (type_ == Array) {
-            return as_array()->size();
+            return packed_ ? val_.packed->size() : val_.array->size();
         } else if (type_ == Object) {
             return as_object()->size();
         }
@@ -742,12 +1478,18 @@ public:
     /*!
      * @ru @brief Распарсить текст в json.
      * @param jsonString - строка текста, которую надо распарсить.
+     * @param limits - ограничения на ресурсы при парсинге.
+     * @param resource - источник памяти для объектов и массивов результата, при SIMJSON_PMR_ARRAYS - и для
+     *  элементов массивов, nullptr - обычная куча. Должен жить дольше результата.
      * @return std::tuple<json_value, JsonParseResult, unsigned, unsigned> - tuple, содержащую:
      *  json_value - получившееся значение, если парсинг успешный, или UNDEFINED, в случае ошибок;
      *  JsonParseResult - код ошибки парсинга, Success в случае успеха;
      *  unsigned line, unsigned col - в случае ошибки это номера строки/колонки возникновения ошибки.
      * @en @brief Parse text to json.
      * @param jsonString - the text string to be parsed.
+     * @param limits - resource limits for parsing.
+     * @param resource - memory resource for objects and arrays of the result, with SIMJSON_PMR_ARRAYS - also for
+     *  array elements, nullptr - the usual heap. Must outlive the result.
      * @return std::tuple<json_value, JsonParseResult, unsigned, unsigned> - tuple, содержащую:
      * json_value - the resulting value if the parsing is successful, or UNDEFINED in case of errors;
      * JsonParseResult - parsing error code, Success if successful;
@@ -759,7 +1501,25 @@ public:
         unsigned line;
         unsigned col;
     };
-    static parse_result parse(ssType jsonString);
+    static parse_result parse(ssType jsonString, const ParseLimits& limits = {}, std::pmr::memory_resource* resource = nullptr);
+    /*!
+     * @ru @brief Распарсить текст в json, построив только пути из проекции.
+     * @param projection - какие пути строить.
+     *  Остальные параметры и результат такие же, как у parse.
+     * @en @brief Parse text to json, building only the paths from the projection.
+     * @param projection - which paths to build.
+     *  Other parameters and result are the same as for parse.
+     */
+    static parse_result parse(ssType jsonString, const JsonProjection<K>& projection, const ParseLimits& limits = {}, std::pmr::memory_resource* resource = nullptr);
+    /*!
+     * @ru @brief Распарсить текст в UTF-8 сразу в json с символами K.
+     * @details В отличие от перекодирования всего текста перед parse, перекодируется только содержимое строк и ключей.
+     *  Параметры и результат такие же, как у parse.
+     * @en @brief Parse UTF-8 text directly into json with K symbols.
+     * @details Unlike transcoding the whole text before parse, only the contents of strings and keys are transcoded.
+     *  Parameters and result are the same as for parse.
+     */
+    static parse_result parse_utf8(ssa jsonString, const ParseLimits& limits = {}, std::pmr::memory_resource* resource = nullptr);
     /*!
      * @ru @brief Сериализовать json-значение в строку.
      * @param stream - строка, в которую сохранять.
@@ -781,6 +1541,43 @@ public:
      * @param indent_count - number of indentation characters per level, default 2.
      */
     SIMJSON_API void store(lstring<K, 0, true>& stream, bool prettify = false, bool order_keys = false, K indent_symbol = ' ', unsigned indent_count = 2) const;
+    /*!
+     * @ru @brief Точная длина текста, который выдаст store с такими же параметрами, в символах.
+     * @details store сам считает эту длину, чтобы выделить память под результат один раз. Порядок ключей и символ
+     *  отступа на длину не влияют.
+     * @param prettify - "украшать" переносами строк и отступами.
+     * @param indent_count - количество символов отступа на один уровень.
+     * @en @brief The exact length of the text that store will produce with the same parameters, in symbols.
+     * @details store counts this length itself to allocate memory for the result once. The key order and the indent
+     *  symbol do not affect the length.
+     * @param prettify - "decorate" with line breaks and indents.
+     * @param indent_count - number of indentation characters per level.
+     */
+    SIMJSON_API size_t store_length(bool prettify = false, unsigned indent_count = 2) const;
+    /*!
+     * @ru @brief Сколько памяти в куче занимает это значение со всеми вложенными, за один проход.
+     * @details Общие с другими значениями объекты и массивы считаются целиком и дополнительно попадают в shared.
+     *  Объект, массив или буфер строки, встреченный в дереве несколько раз, считается один раз, поэтому
+     *  слияние строк в compact видно в результате.
+     * @en @brief How much heap memory this value takes with everything nested, in one pass.
+     * @details Objects and arrays shared with other values are counted in full and additionally go into shared.
+     *  An object, array or string buffer met in the tree several times is counted once, so merging strings
+     *  in compact is seen in the result.
+     */
+    SIMJSON_API JsonMemoryUsage memory_usage() const;
+    /*!
+     * @ru @brief Ужать дерево для долгого хранения: убрать запас ёмкости массивов, уменьшить хэш-таблицы объектов
+     *  и слить одинаковые длинные строковые значения в один общий буфер.
+     * @details Значения не меняются. Общие с другими значениями объекты и массивы ужимаются тоже. Ключи объектов не
+     *  сливаются - они хранятся в самих узлах хэш-таблицы.
+     * @return сколько байтов освобождено, оценка как в memory_usage.
+     * @en @brief Compact the tree for long-term storage: drop spare capacity of arrays, shrink hash tables of objects
+     *  and merge identical long string values into one shared buffer.
+     * @details The values do not change. Objects and arrays shared with other values are compacted too. Object keys are
+     *  not merged - they are stored in the hash table nodes themselves.
+     * @return how many bytes were released, estimated as in memory_usage.
+     */
+    SIMJSON_API size_t compact();
     /*!
      * @ru @brief Сериализовать json-значение в строку.
      * @param prettify - "украшать", в случае true в строке будут добавляться переносы строк и отступы.
@@ -806,12 +1603,116 @@ public:
         store(res, prettify, order_keys, indent_symbol, indent_count);
         return res;
     }
+    /*!
+     * @ru @brief Сериализовать json-значение сразу в строку UTF-8, не создавая промежуточную строку в символах K.
+     *  Параметры такие же, как у store.
+     * @en @brief Serialize json value directly to a UTF-8 string, without creating an intermediate string in K symbols.
+     *  Parameters are the same as for store.
+     */
+    SIMJSON_API void store_utf8(lstring<u8s, 0, true>& stream, bool prettify = false, bool order_keys = false, u8s indent_symbol = ' ', unsigned indent_count = 2) const;
+    /*!
+     * @ru @brief Сериализовать json-значение сразу в строку UTF-8.
+     * @return строку с JSON в UTF-8.
+     * @en @brief Serialize json value directly to a UTF-8 string.
+     * @return a string containing JSON in UTF-8.
+     */
+    lstring<u8s, 0, true> store_utf8(bool prettify = false, bool order_keys = false, u8s indent_symbol = ' ', unsigned indent_count = 2) const {
+        lstring<u8s, 0, true> res;
+        store_utf8(res, prettify, order_keys, indent_symbol, indent_count);
+        return res;
+    }
+    /*!
+     * @ru @brief Сериализовать json-значение в канонический вид по RFC 8785 (JCS), пригодный для подписи и хэширования.
+     * @details Ключи упорядочиваются по кодовым единицам UTF-16, числа выводятся по правилам ECMAScript
+     *  (как double), лишних пробелов нет. Канонический вид определён для UTF-8, поэтому вывод всегда в UTF-8.
+     *  NaN и бесконечности в JCS недопустимы и выводятся как null.
+     * @param stream - строка, в которую сохранять.
+     * @en @brief Serialize json value into the canonical form of RFC 8785 (JCS), suitable for signing and hashing.
+     * @details Keys are ordered by UTF-16 code units, numbers are output by ECMAScript rules
+     *  (as double), there are no extra spaces. The canonical form is defined for UTF-8, so the output is always UTF-8.
+     *  NaN and infinities are not allowed in JCS and are output as null.
+     * @param stream - the string to save into.
+     */
+    SIMJSON_API void store_canonical(lstring<u8s, 0, true>& stream) const;
+    /*!
+     * @ru @brief Сериализовать json-значение в канонический вид по RFC 8785 (JCS).
+     * @return строку с JSON в UTF-8.
+     * @en @brief Serialize json value into the canonical form of RFC 8785 (JCS).
+     * @return a string containing JSON in UTF-8.
+     */
+    lstring<u8s, 0, true> store_canonical() const {
+        lstring<u8s, 0, true> res;
+        store_canonical(res);
+        return res;
+    }
+    /*!
+     * @ru @brief Разложить массив объектов по колонкам, см. JsonColumns.
+     * @return Колонки, пустые, если это не массив.
+     * @en @brief Split an array of objects into columns, see JsonColumns.
+     * @return Columns, empty if this is not an array.
+     */
+    SIMJSON_API JsonColumns<K> to_columns() const;
 
 protected:
     SIMJSON_API static const json_value UNDEFINED;
 
+    static json_object make_object(std::pmr::memory_resource* resource) {
+        if (resource) {
+            return std::allocate_shared<obj_type>(std::pmr::polymorphic_allocator<obj_type>(resource));
+        }
+        return std::make_shared<obj_type>();
+    }
+    static json_array make_array(std::pmr::memory_resource* resource) {
+        if (resource) {
+            // При SIMJSON_PMR_ARRAYS polymorphic_allocator сам передаст себя в конструктор вектора
+            // With SIMJSON_PMR_ARRAYS polymorphic_allocator will pass itself to the vector constructor
+            return std::allocate_shared<arr_type>(std::pmr::polymorphic_allocator<arr_type>(resource));
+        }
+        return std::make_shared<arr_type>();
+    }
+    static json_packed make_packed(Type type, std::pmr::memory_resource* resource) {
+        if (resource) {
+            return std::allocate_shared<packed_type>(std::pmr::polymorphic_allocator<packed_type>(resource), type, resource);
+        }
+        return std::make_shared<packed_type>(type);
+    }
+    template<typename T>
+    static vector_type<T> make_vector(std::pmr::memory_resource* resource) {
+        if constexpr (SIMJSON_PMR_ARRAYS != 0) {
+            return vector_type<T>(resource ? resource : std::pmr::get_default_resource());
+        } else {
+            return {};
+        }
+    }
+    static std::pmr::memory_resource* vector_resource(const auto& vec) {
+        if constexpr (SIMJSON_PMR_ARRAYS != 0) {
+            return vec.get_allocator().resource();
+        } else {
+            return nullptr;
+        }
+    }
+
+    int64_t int_value() const {
+        return raw_ ? raw_integer() : val_.integer;
+    }
+    double real_value() const {
+        return raw_ ? raw_real() : val_.real;
+    }
+    SIMJSON_API int64_t raw_integer() const;
+    SIMJSON_API double raw_real() const;
+    SIMJSON_API json_value packedItem(size_t idx) const;
+    SIMJSON_API const json_array& packedItems() const;
+    void countMemory(JsonMemoryUsage& usage, std::unordered_set<const void*>& seen, bool shared) const;
+    void compactTree(hashStrMap<K, strType>& texts, size_t& released);
+
     // Тип значения
     Type type_;
+    // Число хранится в val_.text в виде исходного текста
+    // The number is stored in val_.text as the source text
+    bool raw_{};
+    // Массив хранится в val_.packed
+    // The array is stored in val_.packed
+    bool packed_{};
     // Хранимое значение
     union Value {
         Value() : boolean(false){}
@@ -822,29 +1723,109 @@ protected:
         strType text;
         json_object object;
         json_array array;
+        json_packed packed;
     } val_;
 };
 
 /*!
  * @ru @brief Парсер текста в JsonValue. Позволяет парсить JSON порциями текста.
  *  Например, данные приходят пакетами из сети, скармливаем их в processChunk, пока не получим результат
- * @tparam K - тип символов.
+ * @tparam K - тип символов результата.
+ * @tparam I - тип символов входного текста. Если отличается от K, структура JSON разбирается в символах I,
+ *  а в K перекодируется только содержимое строк и ключей, без перекодирования всего текста заранее.
  * @en @brief Parser for text in JsonValue. Allows you to parse JSON in chunks of text.
  * For example, data comes in packets from the network, feed them to processChunk until we get the result
- * @tparam K - character type.
+ * @tparam K - character type of the result.
+ * @tparam I - character type of the input text. If it differs from K, the JSON structure is scanned in I symbols,
+ *  and only the contents of strings and keys are transcoded into K, without transcoding the whole text beforehand.
  */
-template<typename K>
+template<typename K, typename I = K>
 struct StreamedJsonParser : StreamedJsonParserBase {
 
     JsonValueTempl<K> result_;
 
     using strType = typename JsonValueTempl<K>::strType;
-    using ssType = typename JsonValueTempl<K>::ssType;
+    using ssType = simple_str<I>;
+    using item_handler = std::function<bool(JsonValueTempl<K>& item)>;
 
+    // Проекция - какие пути строить, nullptr - строить всё. Должна жить до конца парсинга.
+    // Projection - which paths to build, nullptr - build everything. Must live until the end of parsing.
+    const JsonProjection<K>* projection_{};
+
+    /*!
+     * @ru @brief Подготовить парсер к разбору нового текста.
+     * @details Настройки (limits_, resource_, projection_, streamItems) сохраняются. Уже выделенная память стека
+     *  и буфера текста не освобождается, поэтому повторно используемый парсер не тратится на её выделение.
+     * @en @brief Prepare the parser to parse a new text.
+     * @details The settings (limits_, resource_, projection_, streamItems) are kept. Already allocated memory of the stack
+     *  and the text buffer is not freed, so a reused parser does not spend time allocating it.
+     */
     void reset() {
-        this->~StreamedJsonParser<K>();
-        new (this) StreamedJsonParser<K>;
+        result_ = JsonValueTempl<K>{};
+        resetState();
+        ptr_ = nullptr;
+        startProcess_ = nullptr;
+        stack_.clear();
+        stack_.push_back(&result_);
+        text_.reset();
+        streamArray_ = nullptr;
+        pathMatched_ = 0;
+        streamed_ = 0;
+        streamBytes_ = 0;
+        projNodes_.clear();
+        projNodes_.push_back(0);
     }
+    /*!
+     * @ru @brief Сбросить парсер вместе с настройками, сохранив выделенную память.
+     * @en @brief Reset the parser together with the settings, keeping the allocated memory.
+     */
+    void resetAll() {
+        reset();
+        limits_ = {};
+        resource_ = nullptr;
+        projection_ = nullptr;
+        streamPath_.clear();
+        streamHandler_ = nullptr;
+    }
+    /*!
+     * @ru @brief Освободить память стека и буфера текста, если она выросла больше max_bytes.
+     * @details Вызывать после reset, между разборами. Повторно используемый парсер иначе навсегда сохранит память
+     *  под самый большой из разобранных текстов.
+     * @param max_bytes - сколько памяти стека и буфера текста можно оставить.
+     * @en @brief Free the memory of the stack and the text buffer if it has grown beyond max_bytes.
+     * @details Call after reset, between parses. Otherwise a reused parser keeps the memory for the largest
+     *  of the parsed texts forever.
+     * @param max_bytes - how much memory of the stack and the text buffer may be kept.
+     */
+    void shrink(size_t max_bytes) {
+        if (stack_.capacity() * sizeof(stack_[0]) > max_bytes) {
+            std::vector<JsonValueTempl<K>*>(stack_).swap(stack_);
+        }
+        if (projNodes_.capacity() * sizeof(projNodes_[0]) > max_bytes) {
+            std::vector<size_t>(projNodes_).swap(projNodes_);
+        }
+        if (textPeak_ * sizeof(I) > max_bytes) {
+            text_ = chunked_string_builder<I>{512};
+        }
+        textPeak_ = 0;
+    }
+    /*!
+     * @ru @brief Отдавать элементы массива по заданному пути по мере их разбора, не накапливая их в result_.
+     * @details Память тогда ограничена одним элементом, ограничение limits_.max_bytes тоже считается для одного элемента.
+     *  В result_ массив останется пустым. Вызывать до начала парсинга, настройка сохраняется при reset.
+     * @param path - путь к массиву по ключам объектов: "$" - корневой массив, "$.data" - массив в ключе data
+     *  корневого объекта, "$.data.items" - и так далее.
+     * @param handler - вызывается для каждого готового элемента, после вызова элемент удаляется, поэтому его можно
+     *  забрать через std::move. Если вернёт false, парсинг прекращается с результатом NoNeedMore.
+     * @en @brief Hand over the elements of the array at the given path as they are parsed, without accumulating them in result_.
+     * @details Memory is then bounded by one element, the limits_.max_bytes limit is also counted for one element.
+     *  The array in result_ stays empty. Call before parsing starts, the setting is kept on reset.
+     * @param path - path to the array by object keys: "$" - the root array, "$.data" - the array in the data key
+     *  of the root object, "$.data.items" - and so on.
+     * @param handler - called for each completed element, after the call the element is removed, so it can be
+     *  taken via std::move. If it returns false, parsing stops with the result NoNeedMore.
+     */
+    SIMJSON_API void streamItems(simple_str<K> path, item_handler handler);
     /*!
      * @ru @brief Распарсить весь текст за один раз.
      * @param text.
@@ -875,12 +1856,13 @@ protected:
     template<bool All, bool Last>
     SIMJSON_API JsonParseResult process(ssType chunk);
 
-    static bool isWhiteSpace(K symbol) {
+    static bool isWhiteSpace(I symbol) {
         return symbol == ' ' || symbol == '\t' || symbol == '\n' || symbol == '\r';
     }
 
     strType getText();
-    bool processUnicode(K symbol);
+    static strType transcode(ssType text);
+    bool processUnicode(I symbol);
 
     template<bool Compound, int NewState, typename ... Args>
     JsonValueTempl<K>* addValue(JsonValueTempl<K>* current, Args&& ... args);
@@ -890,19 +1872,400 @@ protected:
     template<bool asInt, bool All>
     JsonValueTempl<K>* addNumber(JsonValueTempl<K>* current);
 
-    const K* ptr_{};
-    const K* startProcess_ {};
+    void emitItem();
+
+    const I* ptr_{};
+    const I* startProcess_ {};
     std::vector<JsonValueTempl<K>*> stack_{&result_};
-    chunked_string_builder<K> text_{512};
+    chunked_string_builder<I> text_{512};
+    // Самый длинный текст в text_ с последнего shrink
+    // The longest text in text_ since the last shrink
+    size_t textPeak_{};
+    // Потоковая отдача элементов массива
+    // Streaming handover of array elements
+    std::vector<strType> streamPath_;
+    item_handler streamHandler_;
+    JsonValueTempl<K>* streamArray_{};
+    // Сколько ключей пути совпало на текущем стеке
+    // How many path keys matched on the current stack
+    size_t pathMatched_{};
+    size_t streamed_{};
+    size_t streamBytes_{};
+    // Узлы проекции для каждого уровня стека
+    // Projection nodes for each stack level
+    std::vector<size_t> projNodes_{0};
 };
 
+/*!
+ * @ru @brief Парсер из пула текущего потока.
+ * @details В каждом потоке хранится по одному парсеру каждого типа, и он повторно используется, сохраняя выделенную
+ *  память, но не больше нескольких килобайт. Если парсер потока уже занят (например, разбор запущен из обработчика streamItems), создаётся отдельный.
+ *  При уничтожении парсер сбрасывается вместе с настройками и возвращается в пул.
+ * @en @brief A parser from the current thread's pool.
+ * @details Each thread keeps one parser of each type, and it is reused keeping the allocated memory,
+ *  but no more than a few kilobytes. If the thread's parser is already busy (for example, parsing is started from a streamItems handler), a separate one is created.
+ *  On destruction the parser is reset together with the settings and returned to the pool.
+ */
+template<typename K, typename I = K>
+class PooledJsonParser {
+public:
+    PooledJsonParser() {
+        Slot& s = slot();
+        if (!s.busy) {
+            s.busy = true;
+            parser_ = &s.parser;
+        } else {
+            own_ = std::make_unique<StreamedJsonParser<K, I>>();
+            parser_ = own_.get();
+        }
+    }
+    ~PooledJsonParser() {
+        if constexpr (SIMJSON_STATS != 0) {
+            JsonParseStats::thread_total() += parser_->stats_;
+        }
+        if (!own_) {
+            parser_->resetAll();
+            parser_->shrink(keep_bytes);
+            slot().busy = false;
+        }
+    }
+    PooledJsonParser(const PooledJsonParser&) = delete;
+    PooledJsonParser& operator=(const PooledJsonParser&) = delete;
+
+    StreamedJsonParser<K, I>& operator*() {
+        return *parser_;
+    }
+    StreamedJsonParser<K, I>* operator->() {
+        return parser_;
+    }
+
+protected:
+    // Сколько памяти стека и буфера текста парсер потока сохраняет между разборами
+    // How much memory of the stack and the text buffer the thread's parser keeps between parses
+    static constexpr size_t keep_bytes = 4096;
+
+    struct Slot {
+        StreamedJsonParser<K, I> parser;
+        bool busy{};
+    };
+    static Slot& slot() {
+        thread_local Slot s;
+        return s;
+    }
+
+    StreamedJsonParser<K, I>* parser_;
+    std::unique_ptr<StreamedJsonParser<K, I>> own_;
+};
+
+template<typename K>
+JsonValueTempl<K>::parse_result JsonValueTempl<K>::parse(ssType jsonString, const ParseLimits& limits, std::pmr::memory_resource* resource) {
+    PooledJsonParser<K> parser;
+    parser->limits_ = limits;
+    parser->resource_ = resource;
+    auto res = parser->parseAll(jsonString);
+    return {std::move(parser->result_), res, parser->line_, parser->col_};
+}
+
 template<typename K>
-JsonValueTempl<K>::parse_result JsonValueTempl<K>::parse(ssType jsonString) {
-    StreamedJsonParser<K> parser;
-    auto res = parser.parseAll(jsonString);
-    return {std::move(parser.result_), res, parser.line_, parser.col_};
+JsonValueTempl<K>::parse_result JsonValueTempl<K>::parse(ssType jsonString, const JsonProjection<K>& projection, const ParseLimits& limits, std::pmr::memory_resource* resource) {
+    PooledJsonParser<K> parser;
+    parser->limits_ = limits;
+    parser->resource_ = resource;
+    parser->projection_ = &projection;
+    auto res = parser->parseAll(jsonString);
+    return {std::move(parser->result_), res, parser->line_, parser->col_};
 }
 
+template<typename K>
+JsonValueTempl<K>::parse_result JsonValueTempl<K>::parse_utf8(ssa jsonString, const ParseLimits& limits, std::pmr::memory_resource* resource) {
+    PooledJsonParser<K, u8s> parser;
+    parser->limits_ = limits;
+    parser->resource_ = resource;
+    auto res = parser->parseAll(jsonString);
+    return {std::move(parser->result_), res, parser->line_, parser->col_};
+}
+
+/*!
+ * @ru @brief Колонка значений одного ключа из массива объектов, в раскладке Apache Arrow.
+ * @details Битовые карты - по биту на строку, младший бит первым. Отсутствующий ключ, null и undefined дают
+ *  строку без значения, в буфере данных на её месте ноль или пустая строка.
+ * @en @brief A column of values of one key from an array of objects, in the Apache Arrow layout.
+ * @details Bitmaps have a bit per row, the least significant bit first. A missing key, null and undefined give
+ *  a row without value, in the data buffer there is zero or an empty string in its place.
+ */
+template<typename K>
+struct JsonColumn {
+    using strType = sstring<K>;
+
+    strType name;
+    /// @ru Тип колонки: Null (только пустые значения), Integer, Real, Boolean или Text.
+    ///  Целые и вещественные дают Real, прочие смеси типов, объекты и массивы - Text с JSON-текстом значения.
+    /// @en Column type: Null (only empty values), Integer, Real, Boolean or Text.
+    ///  Integers and reals give Real, other type mixes, objects and arrays give Text with the JSON text of the value.
+    Json::Type type = Json::Null;
+    size_t null_count{};
+    /// @ru Битовая карта наличия значений. @en Validity bitmap.
+    std::vector<uint8_t> validity;
+    /// @ru Значения Integer. @en Integer values.
+    std::vector<int64_t> integers;
+    /// @ru Значения Real. @en Real values.
+    std::vector<double> reals;
+    /// @ru Значения Boolean, битовая карта. @en Boolean values, a bitmap.
+    std::vector<uint8_t> booleans;
+    /// @ru Для Text: смещения строк в data, на одно больше строк (LargeUtf8). @en For Text: offsets of strings in data, one more than rows (LargeUtf8).
+    std::vector<int64_t> offsets{0};
+    /// @ru Для Text: текст всех строк подряд в UTF-8. @en For Text: the text of all rows in a row in UTF-8.
+    std::vector<u8s> data;
+
+    bool is_valid(size_t row) const {
+        return (validity[row / 8] >> (row % 8)) & 1;
+    }
+    bool boolean(size_t row) const {
+        return (booleans[row / 8] >> (row % 8)) & 1;
+    }
+    simple_str<u8s> text(size_t row) const {
+        return {data.data() + offsets[row], size_t(offsets[row + 1] - offsets[row])};
+    }
+};
+
+/*!
+ * @ru @brief Разложение массива объектов по колонкам (struct-of-arrays) в раскладке Apache Arrow.
+ * @details Схема выводится по ходу: колонка создаётся для каждого нового ключа, прошлые строки в ней пустые,
+ *  тип колонки расширяется при появлении значений другого типа. Записи добавляются по одной, поэтому можно
+ *  раскладывать массив прямо при парсинге, вызывая add из обработчика StreamedJsonParser::streamItems.
+ * @en @brief Splitting an array of objects into columns (struct-of-arrays) in the Apache Arrow layout.
+ * @details The schema is inferred on the way: a column is created for each new key, the previous rows in it are empty,
+ *  the column type widens when values of another type appear. Records are added one at a time, so an array
+ *  can be split right while parsing, by calling add from the StreamedJsonParser::streamItems handler.
+ */
+template<typename K>
+class JsonColumns {
+public:
+    std::vector<JsonColumn<K>> columns;
+
+    /// @ru Количество строк. @en Number of rows.
+    size_t rows() const {
+        return rows_;
+    }
+    /// @ru Добавить строку. Если запись не объект, все колонки в строке пустые.
+    /// @en Add a row. If the record is not an object, all columns in the row are empty.
+    SIMJSON_API void add(const JsonValueTempl<K>& record);
+    /// @ru Найти колонку по ключу. @en Find a column by key.
+    const JsonColumn<K>* find(simple_str<K> name) const {
+        auto it = index_.find(name);
+        return it == index_.end() ? nullptr : &columns[it->second];
+    }
+
+protected:
+    size_t rows_{};
+    hashStrMap<K, size_t> index_;
+};
+
+/*!
+ * @ru @brief Индекс по полю элементов массива объектов для поиска за O(1).
+ * @details Ключ - текст или целое число по пути внутри элемента. Для повторяющихся ключей находится первый элемент.
+ *  Индекс держит ссылку на сам массив. Поиск только читает индекс и его можно вызывать из разных потоков
+ *  одновременно. Найденный элемент проверяется, и если его ключ уже другой, поиск возвращает nullptr.
+ *  Индекс сам не следит за массивом: после каждого изменения массива его надо обновить явно, иначе поиск
+ *  не найдёт добавленные или сдвинутые элементы. update() - после добавления в конец или удаления,
+ *  update(pos) - после изменения ключа элемента, rebuild - после любых других изменений.
+ *  Изменение длины массива видно через is_stale(), в отладочной сборке поиск по такому индексу прерывается assert.
+ * @tparam K - тип символов.
+ * @en @brief An index by a field of the elements of an array of objects for O(1) lookup.
+ * @details The key is text or an integer at a path inside the element. For repeated keys the first element is found.
+ *  The index holds a reference to the array itself. Lookup only reads the index and can be called from different
+ *  threads at the same time. The found element is checked, and if its key is already different, lookup returns nullptr.
+ *  The index does not watch the array itself: after every change of the array it must be updated explicitly,
+ *  otherwise lookup does not find appended or shifted elements. update() - after appending to the end or removing,
+ *  update(pos) - after the key of an element changed, rebuild - after any other changes.
+ *  A change of the array length is seen via is_stale(), in a debug build lookup in such an index stops on assert.
+ * @tparam K - character type.
+ * @~ `JsonIndex<u8s> bySku(json("items"_h), "/meta/sku"); const JsonValue* item = bySku.find("A-100");`
+ */
+template<typename K>
+class JsonIndex {
+public:
+    using json_value = JsonValueTempl<K>;
+    using ssType = simple_str<K>;
+
+    JsonIndex() = default;
+    /*!
+     * @ru @brief Построить индекс.
+     * @param array - массив объектов. Если это не массив, индекс пустой.
+     * @param path - путь к ключу внутри элемента в виде JSON pointer: "/id", "/meta/sku".
+     * @en @brief Build the index.
+     * @param array - an array of objects. If it is not an array, the index is empty.
+     * @param path - path to the key inside the element as a JSON pointer: "/id", "/meta/sku".
+     */
+    SIMJSON_API JsonIndex(const json_value& array, ssType path);
+    /// @ru Найти элемент по текстовому ключу, nullptr - если нет. @en Find an element by a text key, nullptr if none.
+    SIMJSON_API const json_value* find(ssType key) const;
+    /// @ru Найти элемент по целому ключу, nullptr - если нет. @en Find an element by an integer key, nullptr if none.
+    SIMJSON_API const json_value* find(int64_t key) const;
+    /// @ru Перестроить индекс целиком. @en Rebuild the whole index.
+    SIMJSON_API void rebuild();
+    /*!
+     * @ru @brief Добавить в индекс новые элементы в конце массива, если массив уменьшился - перестроить.
+     * @en @brief Add new elements at the end of the array to the index, if the array shrank - rebuild.
+     */
+    SIMJSON_API void update();
+    /// @ru Обновить индекс после изменения ключа элемента pos. @en Update the index after the key of the element pos changed.
+    SIMJSON_API void update(size_t pos);
+    /// @ru Количество ключей в индексе. @en Number of keys in the index.
+    size_t size() const {
+        return texts_.size() + integers_.size();
+    }
+    /*!
+     * @ru @brief Длина массива изменилась после построения индекса, нужен update().
+     * @details Изменение ключа на месте так не обнаруживается, после него вызывают update(pos).
+     * @en @brief The array length changed after the index was built, update() is needed.
+     * @details A key changed in place is not detected this way, call update(pos) after it.
+     */
+    bool is_stale() const {
+        return array_.is_array() && !array_.is_packed() && array_.as_array()->size() != indexed_;
+    }
+
+protected:
+    const json_value* keyOf(const json_value& item) const;
+    void add(size_t pos);
+    template<typename T>
+    const json_value* lookup(const T& key) const;
+
+    json_value array_;
+    std::vector<sstring<K>> path_;
+    hashStrMap<K, size_t> texts_;
+    std::unordered_map<int64_t, size_t> integers_;
+    // Сколько элементов массива уже в индексе
+    // How many array elements are already in the index
+    size_t indexed_{};
+};
+
+/*!
+ * @ru @brief Вид токена, возвращаемого JsonTokenReader.
+ * @en @brief Kind of token returned by JsonTokenReader.
+ */
+enum class JsonToken {
+    NeedMore,       ///< @ru Нужны ещё данные, вызовите feed. @en More data needed, call feed.
+    End,            ///< @ru JSON-значение полностью прочитано. @en The JSON value is completely read.
+    Error,          ///< @ru Ошибка в JSON. @en Error in JSON.
+    StartObject,
+    EndObject,
+    StartArray,
+    EndArray,
+    Key,            ///< @ru Ключ объекта, текст в text(). @en Object key, text in text().
+    String,         ///< @ru Строка, текст в text(). @en String, text in text().
+    Integer,        ///< @ru Целое число, в integer(), исходный текст в text(). @en Integer, in integer(), source text in text().
+    Real,           ///< @ru Вещественное число, в real(), исходный текст в text(). @en Real number, in real(), source text in text().
+    True,
+    False,
+    Null,
+};
+
+/*!
+ * @ru @brief Потоковое чтение JSON по токенам, без построения дерева значений.
+ * @details Текст подаётся порциями через feed, токены забираются через next. Если токен не помещается в поданные
+ *  данные, next возвращает JsonToken::NeedMore, недочитанный хвост копируется, и после следующего feed чтение
+ *  продолжается с этого токена. Строки и ключи без экранирования отдаются прямо из поданного текста, поэтому
+ *  значение text() действительно, пока жива порция и до следующего вызова next или feed.
+ * @tparam K - тип символов.
+ * @en @brief Streaming token-by-token JSON reading, without building a value tree.
+ * @details The text is supplied in chunks via feed, tokens are taken via next. If a token does not fit into the supplied
+ *  data, next returns JsonToken::NeedMore, the unread tail is copied, and after the next feed reading continues
+ *  from this token. Strings and keys without escapes are returned directly from the supplied text, so
+ *  the value of text() is valid while the chunk is alive and until the next call to next or feed.
+ * @tparam K - character type.
+ */
+template<typename K>
+class JsonTokenReader {
+public:
+    using ssType = simple_str<K>;
+
+    /*!
+     * @ru @brief Подать очередную порцию текста.
+     * @param chunk - порция текста.
+     * @param last - признак, что это последняя порция.
+     * @en @brief Supply the next chunk of text.
+     * @param chunk - a chunk of text.
+     * @param last - a sign that this is the last chunk.
+     */
+    SIMJSON_API void feed(ssType chunk, bool last = false);
+    /*!
+     * @ru @brief Прочитать следующий токен.
+     * @en @brief Read the next token.
+     */
+    SIMJSON_API JsonToken next();
+    /*!
+     * @ru @brief Пропустить следующее значение целиком, вместе со всеми вложенными.
+     * @return Последний токен пропущенного значения, либо NeedMore - тогда после feed надо снова вызвать skip_value,
+     *  либо Error или End.
+     * @en @brief Skip the next value entirely, with all the nested ones.
+     * @return The last token of the skipped value, or NeedMore - then call skip_value again after feed,
+     *  or Error or End.
+     */
+    SIMJSON_API JsonToken skip_value();
+    /*!
+     * @ru @brief Текущая вложенность в объекты и массивы.
+     * @en @brief Current nesting depth in objects and arrays.
+     */
+    size_t depth() const {
+        return stack_.size();
+    }
+    /// @ru Текст последнего ключа, строки или числа. @en Text of the last key, string or number.
+    ssType text() const {
+        return text_;
+    }
+    /// @ru Значение последнего токена Integer. @en Value of the last Integer token.
+    int64_t integer() const {
+        return integer_;
+    }
+    /// @ru Значение последнего токена Real или Integer. @en Value of the last Real or Integer token.
+    double real() const {
+        return real_;
+    }
+
+protected:
+    enum Expect {
+        ExpectValue,
+        ExpectFirstValue,
+        ExpectKey,
+        ExpectFirstKey,
+        ExpectColon,
+        ExpectComma,
+        ExpectEnd,
+        ExpectError,
+    };
+
+    JsonToken readString(JsonToken token);
+    JsonToken readNumber();
+    JsonToken readLiteral(ssType literal, JsonToken token);
+    JsonToken closeContainer(bool object);
+    JsonToken needMore(size_t start);
+    JsonToken error() {
+        expect_ = ExpectError;
+        return JsonToken::Error;
+    }
+    JsonToken valueDone(JsonToken token) {
+        expect_ = stack_.empty() ? ExpectEnd : ExpectComma;
+        return token;
+    }
+
+    ssType data_;
+    size_t pos_{};
+    bool last_{};
+    Expect expect_{ExpectValue};
+    // true - объект, false - массив
+    // true - object, false - array
+    std::vector<bool> stack_;
+    size_t skipDepth_{};
+    ssType text_;
+    int64_t integer_{};
+    double real_{};
+    // Необработанный хвост прошлых порций и раскодированные строки с экранированием
+    // Unprocessed tail of previous chunks and decoded strings with escapes
+    lstring<K, 0, true> tail_;
+    lstring<K, 0, true> unescaped_;
+};
+
 /// @ru Алиас для JsonValue с символами char.
 /// @en Alias ​​for JsonValue with char characters.
 using JsonValue = JsonValueTempl<u8s>;
@@ -927,6 +2290,368 @@ inline SIMJSON_API const JsonValueTempl<K> JsonValueTempl<K>::UNDEFINED;
 #else
 #endif
 
+namespace jt {
+
+template<typename T, typename E>
+concept JsonFieldsSource = requires(const T& t, E& e) {
+    t.json_fields(e);
+};
+
+template<typename T>
+concept JsonRange = requires(const T& t) {
+    t.begin();
+    t.end();
+};
+
+template<typename T>
+concept JsonPairRange = JsonRange<T> && requires(const T& t) {
+    t.begin()->first;
+    t.begin()->second;
+};
+
+template<typename T>
+struct is_optional : std::false_type {};
+
+template<typename T>
+struct is_optional<std::optional<T>> : std::true_type {};
+
+} // namespace jt
+
+/*!
+ * @ru @brief Кодировщик значений в JSON, пишущий сразу в строку, без создания промежуточного JsonValueTempl.
+ * @details Поддерживает bool, целые и вещественные числа, строки, std::optional (пустой - null), Json::null,
+ *  JsonValueTempl<K>, контейнеры пар ключ-значение (как объекты), прочие контейнеры (как массивы), а также
+ *  пользовательские структуры с методом `template<typename E> void json_fields(E& e) const`, в котором
+ *  поля перечисляются вызовами `e("name"_jk, value)`. Ключи, заданные через `_jk`, экранируются на этапе компиляции.
+ *  Экранирование строк и формат чисел те же, что и в JsonValueTempl::store.
+ * @tparam K - тип символов.
+ * @tparam Buffer - тип строки, в которую производится запись. Должен поддерживать `+=` для строковых выражений.
+ * @en @brief An encoder of values into JSON that writes directly to a string, without creating an intermediate JsonValueTempl.
+ * @details Supports bool, integer and floating point numbers, strings, std::optional (empty - null), Json::null,
+ *  JsonValueTempl<K>, containers of key-value pairs (as objects), other containers (as arrays), and also
+ *  user structures with a method `template<typename E> void json_fields(E& e) const`, in which
+ *  fields are listed by calls `e("name"_jk, value)`. Keys specified via `_jk` are escaped at compile time.
+ *  String escaping and number format are the same as in JsonValueTempl::store.
+ * @tparam K - character type.
+ * @tparam Buffer - the type of string to write to. Must support `+=` for string expressions.
+ */
+template<typename K, typename Buffer = lstring<K, 0, true>>
+class JsonEncoder {
+public:
+    using ssType = simple_str<K>;
+
+    explicit JsonEncoder(Buffer& buffer) : buffer_(buffer) {}
+
+    /// @ru Записать значение.
+    /// @en Write a value.
+    template<typename T>
+    JsonEncoder& value(const T& v) {
+        write(v);
+        return *this;
+    }
+    /// @ru Записать поле объекта с ключом, экранированным при компиляции. Вызывается из json_fields.
+    /// @en Write an object field with a key escaped at compile time. Called from json_fields.
+    template<jt::key_name Name, typename T>
+    JsonEncoder& operator()(jt::json_key<Name>, const T& v) {
+        constexpr const auto& key = jt::json_key_text<K, Name>;
+        if (!first_) {
+            buffer_ += e_c(1, K(','));
+        }
+        first_ = false;
+        buffer_ += ssType{key.data(), key.size()};
+        write(v);
+        return *this;
+    }
+    /// @ru Записать поле объекта с ключом, известным только во время выполнения. Вызывается из json_fields.
+    /// @en Write an object field with a key known only at runtime. Called from json_fields.
+    template<typename T>
+    JsonEncoder& operator()(ssType key, const T& v) {
+        writeKey(key);
+        write(v);
+        return *this;
+    }
+
+protected:
+    void writeKey(ssType key) {
+        buffer_ += e_c(first_ ? 0 : 1, K(',')) + uni_string(K, "\"") + expr_json_str<K>{key} + uni_string(K, "\":");
+        first_ = false;
+    }
+
+    template<typename T>
+    void write(const T& v) {
+        using V = std::remove_cvref_t<T>;
+        if constexpr (std::is_same_v<V, bool>) {
+            if (v)
+                buffer_ += uni_string(K, "true");
+            else
+                buffer_ += uni_string(K, "false");
+        } else if constexpr (std::is_same_v<V, Json::null_t> || std::is_same_v<V, std::nullptr_t>) {
+            buffer_ += uni_string(K, "null");
+        } else if constexpr (std::is_integral_v<V>) {
+            buffer_ += e_num<K>(static_cast<std::conditional_t<std::is_signed_v<V>, int64_t, uint64_t>>(v));
+        } else if constexpr (std::is_floating_point_v<V>) {
+            buffer_ += e_num<K>(static_cast<double>(v));
+        } else if constexpr (std::is_same_v<V, JsonValueTempl<K>>) {
+            static_assert(std::is_same_v<Buffer, lstring<K, 0, true>>, "JsonValueTempl can be written only into lstring<K, 0, true>");
+            v.store(buffer_);
+        } else if constexpr (jt::is_optional<V>::value) {
+            if (v) {
+                write(*v);
+            } else {
+                buffer_ += uni_string(K, "null");
+            }
+        } else if constexpr (std::is_convertible_v<const V&, ssType>) {
+            buffer_ += uni_string(K, "\"") + expr_json_str<K>{ssType(v)} + uni_string(K, "\"");
+        } else if constexpr (jt::JsonFieldsSource<V, JsonEncoder>) {
+            buffer_ += uni_string(K, "{");
+            bool first = std::exchange(first_, true);
+            v.json_fields(*this);
+            first_ = first;
+            buffer_ += uni_string(K, "}");
+        } else if constexpr (jt::JsonPairRange<V>) {
+            buffer_ += uni_string(K, "{");
+            bool first = std::exchange(first_, true);
+            for (const auto& [key, val] : v) {
+                if constexpr (std::is_same_v<std::remove_cvref_t<decltype(key)>, jt::KeyType<K>>) {
+                    writeKey(key.str);
+                } else {
+                    writeKey(ssType(key));
+                }
+                write(val);
+            }
+            first_ = first;
+            buffer_ += uni_string(K, "}");
+        } else if constexpr (jt::JsonRange<V>) {
+            buffer_ += uni_string(K, "[");
+            bool printed = false;
+            for (const auto& e : v) {
+                if (printed) {
+                    buffer_ += e_c(1, K(','));
+                }
+                write(e);
+                printed = true;
+            }
+            buffer_ += uni_string(K, "]");
+        } else {
+            static_assert(!sizeof(V), "Type can not be encoded into JSON");
+        }
+    }
+
+    Buffer& buffer_;
+    bool first_{true};
+};
+
+/*!
+ * @ru @brief Закодировать значение в JSON строку без создания промежуточного JsonValueTempl.
+ * @tparam K - тип символов результата.
+ * @param value - значение, см. JsonEncoder.
+ * @return строку с JSON.
+ * @en @brief Encode a value into a JSON string without creating an intermediate JsonValueTempl.
+ * @tparam K - character type of result.
+ * @param value - value, see JsonEncoder.
+ * @return a string containing JSON.
+ */
+template<typename K = u8s, typename T>
+lstring<K, 0, true> to_json(const T& value) {
+    lstring<K, 0, true> res;
+    JsonEncoder<K>{res}.value(value);
+    return res;
+}
+
+namespace jt {
+
+// FNV-1a хэш ключа, одинаково вычисляемый при компиляции и во время выполнения
+// FNV-1a key hash, computed the same way at compile time and at runtime
+template<typename K>
+constexpr uint64_t key_hash(const K* ptr, size_t len) {
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < len; i++) {
+        h ^= uint64_t(std::make_unsigned_t<K>(ptr[i]));
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+template<typename K, key_name Name>
+consteval auto make_key_chars() {
+    static_assert(sizeof(K) == 1 || Name.is_ascii(), "Only ASCII key names are allowed for wide characters");
+    std::array<K, Name.length() + 1> res{};
+    for (size_t i = 0; i < Name.length(); i++) {
+        res[i] = K(Name.symbols[i]);
+    }
+    return res;
+}
+
+template<typename K, key_name Name>
+inline constexpr auto key_chars = make_key_chars<K, Name>();
+
+template<size_t A, size_t B>
+constexpr bool same_key_name(const key_name<A>& a, const key_name<B>& b) {
+    if constexpr (A != B) {
+        return false;
+    } else {
+        for (size_t i = 0; i < A; i++) {
+            if (a.symbols[i] != b.symbols[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+template<key_name Name, key_name... Names>
+consteval size_t key_index() {
+    size_t idx = 0, res = sizeof...(Names);
+    ((same_key_name(Name, Names) ? (res = idx, ++idx) : ++idx), ...);
+    if (res == sizeof...(Names)) {
+        throw "Key name is not in the key set";
+    }
+    return res;
+}
+
+template<size_t Count, unsigned Bits>
+struct perfect_hash_table {
+    using slot_type = std::conditional_t<(Count < 255), uint8_t, uint16_t>;
+    uint64_t mult{};
+    // Индекс ключа + 1, 0 - пустой слот
+    // Key index + 1, 0 - empty slot
+    std::array<slot_type, (size_t(1) << Bits)> slots{};
+
+    static constexpr size_t slot(uint64_t hash, uint64_t mult) {
+        return size_t((hash * mult) >> (64 - Bits));
+    }
+};
+
+// Подбираем множитель, при котором все ключи попадают в разные слоты таблицы.
+// Таблица как минимум в 4 раза больше числа ключей, поэтому подходящий множитель находится за несколько попыток.
+// We select a multiplier at which all keys fall into different slots of the table.
+// The table is at least 4 times larger than the number of keys, so a suitable multiplier is found in a few attempts.
+template<size_t Count, unsigned Bits>
+consteval perfect_hash_table<Count, Bits> build_perfect_hash(const std::array<uint64_t, Count>& hashes) {
+    using table = perfect_hash_table<Count, Bits>;
+    for (size_t i = 0; i < Count; i++) {
+        for (size_t j = i + 1; j < Count; j++) {
+            if (hashes[i] == hashes[j]) {
+                throw "Duplicate key names in the key set";
+            }
+        }
+    }
+    for (uint64_t seed = 1; seed < 100000; seed++) {
+        table res{};
+        res.mult = (seed * 0x9E3779B97F4A7C15ull) | 1;
+        bool ok = true;
+        for (size_t i = 0; i < Count && ok; i++) {
+            auto& s = res.slots[table::slot(hashes[i], res.mult)];
+            if (s) {
+                ok = false;
+            } else {
+                s = typename table::slot_type(i + 1);
+            }
+        }
+        if (ok) {
+            return res;
+        }
+    }
+    throw "Can not build perfect hash for the key set";
+}
+
+consteval unsigned perfect_hash_bits(size_t count) {
+    unsigned bits = 2;
+    while ((size_t(1) << bits) < count * 4) {
+        bits++;
+    }
+    return bits;
+}
+
+} // namespace jt
+
+/*!
+ * @ru @brief Набор известных на этапе компиляции ключей с идеальным хэшированием.
+ * @details Позволяет за один проход по json-объекту сопоставить каждому ключу плотный индекс
+ *  и извлечь все известные поля, не выполняя поиск каждого ключа в hashStrMap.
+ *  Пример:
+ * @en @brief A set of keys known at compile time with perfect hashing.
+ * @details Allows in one pass over a json object to map each key to a dense index
+ *  and extract all known fields without searching each key in hashStrMap.
+ *  Example:
+ * @~ @code
+ *  using Keys = JsonKeySet<u8s, "type", "id", "ts">;
+ *  auto fields = Keys::extract(json);
+ *  if (auto type = fields[Keys::index<"type">]) {
+ *      ...
+ *  }
+ *  for (const auto& [key, value] : *json.as_object()) {
+ *      switch (Keys::index_of(key.str)) {
+ *      case Keys::index<"id">:
+ *          ...
+ *      }
+ *  }
+ * @endcode
+ * @tparam K - тип символов.
+ * @tparam Names - имена ключей.
+ * @en @tparam K - character type.
+ * @tparam Names - key names.
+ */
+template<typename K, jt::key_name... Names>
+class JsonKeySet {
+public:
+    using ssType = simple_str<K>;
+    using json_value = JsonValueTempl<K>;
+
+    /// @ru Количество ключей в наборе.
+    /// @en The number of keys in the set.
+    static constexpr size_t count = sizeof...(Names);
+    /// @ru Индекс, возвращаемый для неизвестных ключей.
+    /// @en The index returned for unknown keys.
+    static constexpr size_t npos = count;
+    /// @ru Индекс ключа в наборе, константа времени компиляции.
+    /// @en The index of the key in the set, a compile-time constant.
+    template<jt::key_name Name>
+    static constexpr size_t index = jt::key_index<Name, Names...>();
+
+    using fields = std::array<const json_value*, count>;
+
+    /// @ru Получить индекс ключа в наборе, или npos, если такого ключа нет.
+    /// @en Get the index of the key in the set, or npos if there is no such key.
+    static size_t index_of(ssType key) {
+        size_t idx = table_.slots[table_type::slot(jt::key_hash(key.symbols(), key.length()), table_.mult)];
+        if (idx--) {
+            if (lengths_[idx] == key.length() && std::char_traits<K>::compare(names_[idx], key.symbols(), key.length()) == 0) {
+                return idx;
+            }
+        }
+        return npos;
+    }
+    /*!
+     * @ru @brief Извлечь за один проход все известные поля json-объекта.
+     * @param obj - json-объект.
+     * @return массив указателей на значения полей, индексированный index<"name">. Для отсутствующих полей - nullptr.
+     * @en @brief Extract all known fields of a json object in one pass.
+     * @param obj - json object.
+     * @return an array of pointers to field values, indexed by index<"name">. For missing fields - nullptr.
+     */
+    static fields extract(const json_value& obj) {
+        fields res{};
+        if (obj.is_object()) {
+            for (const auto& [key, value] : *obj.as_object()) {
+                if (size_t idx = index_of(key.str); idx != npos) {
+                    res[idx] = &value;
+                }
+            }
+        }
+        return res;
+    }
+
+protected:
+    static_assert(count > 0, "Key set can not be empty");
+    static constexpr unsigned bits_ = jt::perfect_hash_bits(count);
+    using table_type = jt::perfect_hash_table<count, bits_>;
+    static constexpr table_type table_ = jt::build_perfect_hash<count, bits_>(
+        {jt::key_hash(jt::key_chars<K, Names>.data(), Names.length())...});
+    static constexpr const K* names_[] = {jt::key_chars<K, Names>.data()...};
+    static constexpr size_t lengths_[] = {Names.length()...};
+};
+
 /*!
  * @ru @brief Прочитать файл в строку.
  * @param filePath.
@@ -0,0 +1,152 @@
+﻿/*
+ * (c) Проект "SimJson", Александр Орефков orefkov@gmail.com
+ * ver. 1.0
+ * Запросы JSONPath к JSON
+ * (c) Project "SimJson", Aleksandr Orefkov orefkov@gmail.com
+ * ver. 1.0
+ * JSONPath queries to JSON
+ */
+
+#pragma once
+#include <simjson/json.h>
+
+namespace simjson {
+
+/*!
+ * @ru @brief Запрос JSONPath (RFC 9535), скомпилированный один раз для многократного выполнения.
+ * @details Поддерживаются имена, `*`, индексы, срезы, рекурсивный спуск `..` и фильтры `?` со сравнениями,
+ *  `&&`, `||`, `!`, проверкой наличия и функциями length, count, value. Функции match и search не поддерживаются.
+ *  Результат - указатели на значения внутри исходного json, без копирования. Фильтры по большим массивам
+ *  выполняются параллельно в общем пуле потоков. Для упакованных массивов (JsonValueTempl::is_packed) выбираются
+ *  их постоянные элементы-копии, результат тот же, что и без упаковки.
+ * @tparam K - тип символов.
+ * @en @brief A JSONPath query (RFC 9535), compiled once for repeated execution.
+ * @details Names, `*`, indexes, slices, recursive descent `..` and `?` filters with comparisons, `&&`, `||`, `!`,
+ *  existence tests and the functions length, count, value are supported. The match and search functions are not supported.
+ *  The result is pointers to values inside the source json, without copying. Filters over large arrays
+ *  are evaluated in parallel in a shared thread pool. For packed arrays (JsonValueTempl::is_packed) their permanent
+ *  element copies are selected, the result is the same as without packing.
+ * @tparam K - character type.
+ * @~ `JsonPath<u8s> path{"$.items[?@.price > 10].id"}; for (const JsonValue* id : path.select(json)) ...`
+ */
+template<typename K>
+class JsonPath {
+public:
+    using json_value = JsonValueTempl<K>;
+    using strType = sstring<K>;
+    using ssType = simple_str<K>;
+    using node_list = std::vector<const json_value*>;
+
+    /// @ru Начиная с какого размера массива фильтр по нему выполняется параллельно, size_t(-1) - никогда.
+    /// @en From what array size a filter over it is evaluated in parallel, size_t(-1) - never.
+    size_t parallel_threshold = 10000;
+
+    JsonPath() = default;
+    /// @ru Скомпилировать запрос, результат проверяется через is_valid.
+    /// @en Compile the query, the result is checked via is_valid.
+    explicit JsonPath(ssType path) {
+        compile(path);
+    }
+    /*!
+     * @ru @brief Скомпилировать запрос.
+     * @return false при синтаксической ошибке, её позиция - в error_pos.
+     * @en @brief Compile the query.
+     * @return false on a syntax error, its position is in error_pos.
+     */
+    SIMJSON_API bool compile(ssType path);
+    bool is_valid() const {
+        return valid_;
+    }
+    size_t error_pos() const {
+        return errorPos_;
+    }
+    /*!
+     * @ru @brief Выполнить запрос.
+     * @param root - корень документа, значения в результате живут, пока жив он.
+     * @param result - сюда добавляются найденные значения в порядке документа.
+     * @en @brief Execute the query.
+     * @param root - the document root, the values in the result live as long as it does.
+     * @param result - found values are appended here in document order.
+     */
+    SIMJSON_API void select(const json_value& root, node_list& result) const;
+    /// @ru Выполнить запрос и вернуть найденные значения.
+    /// @en Execute the query and return the found values.
+    node_list select(const json_value& root) const {
+        node_list result;
+        select(root, result);
+        return result;
+    }
+
+protected:
+    inline static const size_t npos = size_t(-1);
+
+    enum class Sel { Name, Wildcard, Index, Slice, Filter };
+    struct Selector {
+        Sel kind;
+        strType name{};
+        int64_t index{};
+        int64_t start{};
+        int64_t end{};
+        int64_t step{1};
+        bool hasStart{};
+        bool hasEnd{};
+        size_t expr{};
+    };
+    struct Segment {
+        bool descendant{};
+        std::vector<Selector> selectors;
+    };
+    struct Query {
+        // $ - от корня документа, @ - от текущего значения фильтра
+        // $ - from the document root, @ - from the current filter value
+        bool absolute{};
+        std::vector<Segment> segments;
+    };
+    enum class Op { Or, And, Not, Eq, Ne, Lt, Le, Gt, Ge, Exists, Literal, Singular, Length, Count, Value };
+    struct Expr {
+        Op op;
+        size_t left{};
+        size_t right{};
+        size_t query{};
+        json_value literal{};
+    };
+
+    // Компиляция
+    // Compilation
+    void skipSpaces();
+    bool parseSegments(Query& query);
+    bool parseBracket(Segment& segment);
+    bool parseSelector(Selector& selector);
+    bool parseName(strType& name);
+    bool parseString(strType& text);
+    bool parseInt(int64_t& value);
+    bool parseNumber(json_value& value);
+    size_t parseOr();
+    size_t parseAnd();
+    size_t parseUnary();
+    size_t parseComparable();
+    size_t parseQuery();
+    bool isSingular(const Query& query) const;
+    size_t addExpr(Expr&& expr);
+
+    // Выполнение
+    // Execution
+    void run(const Query& query, const json_value& current, const json_value& root, node_list& result) const;
+    void apply(const Segment& segment, const json_value& node, const json_value& root, node_list& result) const;
+    void applySelector(const Selector& selector, const json_value& node, const json_value& root, node_list& result) const;
+    void filter(const Selector& selector, const json_value& node, const json_value& root, node_list& result) const;
+    bool test(size_t expr, const json_value& current, const json_value& root) const;
+    const json_value* operand(size_t expr, const json_value& current, const json_value& root, json_value& storage) const;
+
+    // Запрос 0 - основной
+    // Query 0 is the main one
+    std::vector<Query> queries_;
+    std::vector<Expr> exprs_;
+    bool valid_{};
+    size_t errorPos_{};
+    const K* begin_{};
+    const K* ptr_{};
+    const K* end_{};
+};
+
+} // namespace simjson
@@ -0,0 +1,61 @@
+﻿/*
+ * (c) Проект "SimJson", Александр Орефков orefkov@gmail.com
+ * ver. 1.0
+ * Кодирование json в MessagePack и обратно
+ * (c) Project "SimJson", Aleksandr Orefkov orefkov@gmail.com
+ * ver. 1.0
+ * Encoding json into MessagePack and back
+ */
+
+#pragma once
+#include <simjson/decoder.h>
+
+namespace simjson {
+
+/*!
+ * @ru @brief Записать json в MessagePack в конец буфера.
+ * @details Целые пишутся в самой короткой форме, вещественные - всегда float64, поэтому после from_msgpack тип числа тот же.
+ *  Строки пишутся в UTF-8, Undefined в объектах пропускается, в массивах пишется как nil.
+ * @en @brief Write json into MessagePack at the end of the buffer.
+ * @details Integers are written in the shortest form, reals - always as float64, so after from_msgpack the number type is the same.
+ *  Strings are written in UTF-8, Undefined in objects is skipped, in arrays it is written as nil.
+ */
+template<typename K>
+SIMJSON_API void to_msgpack(const JsonValueTempl<K>& json, lstring<u8s, 0, true>& out);
+
+/*!
+ * @ru @brief Потоковый разбор MessagePack в JsonValue, данные можно подавать порциями любого размера.
+ * @details Порции и построение дерева - как в StreamedBinaryParser, ограничения limits_ и память resource_ работают
+ *  так же, как в StreamedJsonParser. Данные bin становятся текстом base64url без выравнивания, ext - null, целые ключи
+ *  словарей - их десятичным текстом. uint64 больше максимального int64_t становится вещественным.
+ * @tparam K - тип символов результата.
+ * @en @brief Streaming parsing of MessagePack into JsonValue, data can be fed in chunks of any size.
+ * @details Chunks and tree building are as in StreamedBinaryParser, the limits_ and the resource_ memory work
+ *  the same as in StreamedJsonParser. bin data becomes base64url text without padding, ext - null, integer map keys -
+ *  their decimal text. uint64 above the int64_t maximum becomes real.
+ * @tparam K - character type of the result.
+ */
+template<typename K>
+struct StreamedMsgpackParser : StreamedBinaryParser<K, StreamedMsgpackParser<K>> {
+protected:
+    using base = StreamedBinaryParser<K, StreamedMsgpackParser<K>>;
+    friend base;
+    using base::error_;
+    using base::stack_;
+    using base::addValue;
+    using base::addString;
+    using base::overString;
+    using base::openContainer;
+
+    size_t decodeItem(const uint8_t* ptr, size_t size);
+};
+
+/*!
+ * @ru @brief Разобрать MessagePack в json.
+ * @en @brief Parse MessagePack into json.
+ * @~ `auto [json, err, line, col] = from_msgpack<u8s>(data);`
+ */
+template<typename K>
+SIMJSON_API typename JsonValueTempl<K>::parse_result from_msgpack(ssa data, const ParseLimits& limits = {}, std::pmr::memory_resource* resource = nullptr);
+
+} // namespace simjson
@@ -0,0 +1,86 @@
+﻿/*
+ * (c) Проект "SimJson", Александр Орефков orefkov@gmail.com
+ * ver. 1.0
+ * Отложенное уничтожение больших json-деревьев
+ * (c) Project "SimJson", Aleksandr Orefkov orefkov@gmail.com
+ * ver. 1.0
+ * Deferred destruction of large json trees
+ */
+
+#pragma once
+#include <simjson/json.h>
+#include <condition_variable>
+#include <thread>
+
+namespace simjson {
+
+/*!
+ * @ru @brief Уничтожение больших json-деревьев вне рабочего потока и без рекурсии.
+ * @details Обычный деструктор JsonValueTempl рекурсивно обходит всё дерево в вызывающем потоке, что долго
+ *  для больших документов и может переполнить стек на очень глубоких. retire забирает значение в очередь, а
+ *  разбирает её либо фоновый поток, либо сам владелец через drain. Дерево разбирается итеративно, через явный стек.
+ *  Объекты и массивы, на которые есть ещё ссылки, не трогаются - отпускается только своя ссылка.
+ * @tparam K - тип символов.
+ * @en @brief Destruction of large json trees off the working thread and without recursion.
+ * @details The usual JsonValueTempl destructor walks the whole tree recursively in the calling thread, which is slow
+ *  for large documents and may overflow the stack on very deep ones. retire takes the value into a queue, and
+ *  either a background thread or the owner via drain takes it apart. The tree is taken apart iteratively, with an explicit stack.
+ *  Objects and arrays referenced elsewhere are not touched - only the own reference is released.
+ * @tparam K - character type.
+ * @~ `JsonReclaimer<u8s>::background().retire(std::move(oldDocument));`
+ */
+template<typename K>
+class JsonReclaimer {
+public:
+    using json_value = JsonValueTempl<K>;
+
+    /*!
+     * @ru @brief Создать уборщик.
+     * @param background - запустить фоновый поток. Иначе очередь разбирается только через drain.
+     * @en @brief Create a reclaimer.
+     * @param background - start a background thread. Otherwise the queue is taken apart only via drain.
+     */
+    SIMJSON_API explicit JsonReclaimer(bool background = true);
+    /// @ru Дожидается разбора всей очереди. @en Waits until the whole queue is taken apart.
+    SIMJSON_API ~JsonReclaimer();
+    JsonReclaimer(const JsonReclaimer&) = delete;
+    JsonReclaimer& operator=(const JsonReclaimer&) = delete;
+
+    /*!
+     * @ru @brief Отдать значение на уничтожение. Простые значения и общие с кем-то объекты и массивы
+     *  отпускаются сразу, они дёшевы.
+     * @en @brief Hand over a value for destruction. Simple values and objects and arrays shared with someone
+     *  are released at once, they are cheap.
+     */
+    SIMJSON_API void retire(json_value&& value);
+    /*!
+     * @ru @brief Разобрать очередь в текущем потоке.
+     * @return сколько объектов и массивов уничтожено.
+     * @en @brief Take the queue apart in the current thread.
+     * @return how many objects and arrays were destroyed.
+     */
+    SIMJSON_API size_t drain();
+    /// @ru Сколько значений ждут в очереди. @en How many values are waiting in the queue.
+    SIMJSON_API size_t pending() const;
+
+    /*!
+     * @ru @brief Уничтожить значение в текущем потоке без рекурсии.
+     * @return сколько объектов и массивов уничтожено.
+     * @en @brief Destroy a value in the current thread without recursion.
+     * @return how many objects and arrays were destroyed.
+     */
+    SIMJSON_API static size_t destroy(json_value&& value);
+    /// @ru Общий для процесса уборщик с фоновым потоком. @en A process-wide reclaimer with a background thread.
+    SIMJSON_API static JsonReclaimer& background();
+
+protected:
+    void run();
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::vector<json_value> queue_;
+    bool stop_{};
+    std::thread thread_;
+};
+
+} // namespace simjson
@@ -0,0 +1,113 @@
+﻿/*
+ * (c) Проект "SimJson", Александр Орефков orefkov@gmail.com
+ * ver. 1.0
+ * Общая между потоками неизменяемая копия json с горячей перезагрузкой
+ * (c) Project "SimJson", Aleksandr Orefkov orefkov@gmail.com
+ * ver. 1.0
+ * An immutable json copy shared between threads with hot reload
+ */
+
+#pragma once
+#include <simjson/json.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <thread>
+
+namespace simjson {
+
+/*!
+ * @ru @brief Публикация неизменяемых json-документов (например, конфига) для чтения из многих потоков без мьютекса.
+ * @details get отдаёт текущий снимок, он не меняется, пока жив, даже если уже опубликован новый. Публикация -
+ *  атомарная замена std::shared_ptr. Чтобы не трогать счётчик ссылок на каждом запросе, поток может держать свой
+ *  снимок и брать новый, только когда изменился version. watch следит за файлом из фонового потока:
+ *  при изменении времени записи или размера файл перечитывается, недостающие ключи берутся из значений по умолчанию,
+ *  и новый снимок публикуется. Если файл не прочитался или в нём ошибка, остаётся прежний снимок.
+ * @tparam K - тип символов.
+ * @en @brief Publishing immutable json documents (for example, a config) for reading from many threads without a mutex.
+ * @details get returns the current snapshot, it does not change while alive, even if a new one is already published.
+ *  Publishing is an atomic replacement of a std::shared_ptr. To avoid touching the reference counter on every request,
+ *  a thread can keep its own snapshot and take a new one only when version changed. watch follows a file from a
+ *  background thread: when the write time or size changes, the file is reread, missing keys are taken from the defaults,
+ *  and the new snapshot is published. If the file could not be read or has an error, the previous snapshot stays.
+ * @tparam K - character type.
+ * @~ `JsonSnapshot<u8s> config; config.watch("app.json", defaults); ... auto cfg = config.get(); (*cfg)["workers"]...`
+ */
+template<typename K>
+class JsonSnapshot {
+public:
+    using json_value = JsonValueTempl<K>;
+    using snapshot = std::shared_ptr<const json_value>;
+
+    JsonSnapshot() : current_(std::make_shared<const json_value>()) {}
+    explicit JsonSnapshot(json_value value) : current_(std::make_shared<const json_value>(std::move(value))) {}
+    /// @ru Останавливает слежение за файлом. @en Stops watching the file.
+    SIMJSON_API ~JsonSnapshot();
+    JsonSnapshot(const JsonSnapshot&) = delete;
+    JsonSnapshot& operator=(const JsonSnapshot&) = delete;
+
+    /// @ru Текущий снимок. @en The current snapshot.
+    snapshot get() const {
+#ifdef __cpp_lib_atomic_shared_ptr
+        return current_.load(std::memory_order_acquire);
+#else
+        return std::atomic_load_explicit(&current_, std::memory_order_acquire);
+#endif
+    }
+    /// @ru Номер публикации, растёт с каждой новой. @en Publication number, grows with each new one.
+    uint64_t version() const {
+        return version_.load(std::memory_order_acquire);
+    }
+    /*!
+     * @ru @brief Опубликовать новый документ. Значение больше не должно меняться через другие ссылки на его объекты и массивы.
+     * @en @brief Publish a new document. The value must not be changed anymore through other references to its objects and arrays.
+     */
+    SIMJSON_API void publish(json_value value);
+    /*!
+     * @ru @brief Прочитать файл в UTF-8, дополнить значениями по умолчанию и опубликовать.
+     * @param path - путь к файлу.
+     * @param defaults - значения по умолчанию, значения из файла важнее. Сами не меняются, снимок получает их полную копию.
+     * @return результат разбора, при ошибке чтения файла - JsonParseResult::Error. Публикуется только при Success.
+     * @en @brief Read a UTF-8 file, complete it with defaults and publish.
+     * @param path - path to the file.
+     * @param defaults - default values, the values from the file take precedence. They are not changed themselves,
+     *  the snapshot gets a full copy of them.
+     * @return the parse result, on a file read error - JsonParseResult::Error. Published only on Success.
+     */
+    SIMJSON_API JsonParseResult load(stra path, const json_value& defaults = {});
+    /*!
+     * @ru @brief Загрузить файл и следить за ним из фонового потока, перечитывая при изменении.
+     * @param defaults - значения по умолчанию, копируются полностью один раз, дальнейшие изменения исходных не видны.
+     * @param interval - как часто проверять файл.
+     * @return результат первой загрузки. Слежение запускается в любом случае, при ошибке файл перечитывается на следующей проверке.
+     * @en @brief Load the file and watch it from a background thread, rereading on change.
+     * @param defaults - default values, fully copied once, later changes to the originals are not seen.
+     * @param interval - how often to check the file.
+     * @return the result of the first load. Watching is started in any case, on an error the file is reread at the next check.
+     */
+    SIMJSON_API JsonParseResult watch(stra path, const json_value& defaults = {}, std::chrono::milliseconds interval = std::chrono::seconds(1));
+    /// @ru Прекратить слежение за файлом. @en Stop watching the file.
+    SIMJSON_API void stop();
+
+protected:
+    // Загрузка с уже скопированными значениями по умолчанию
+    // Loading with already copied defaults
+    JsonParseResult loadFile(stra path, const json_value& defaults);
+
+#ifdef __cpp_lib_atomic_shared_ptr
+    std::atomic<snapshot> current_;
+#else
+    snapshot current_;
+#endif
+    std::atomic<uint64_t> version_{};
+    // Слежение за файлом
+    // Watching the file
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stop_{};
+    std::thread thread_;
+    stringa path_;
+    json_value defaults_;
+};
+
+} // namespace simjson
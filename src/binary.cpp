@@ -0,0 +1,453 @@
+﻿/*
+ * (c) Проект "SimJson", Александр Орефков orefkov@gmail.com
+ * ver. 1.0
+ * Двоичный снимок json для чтения без разбора
+ */
+
+#include <simjson/binary.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace simjson {
+using namespace simstr;
+using namespace simstr::literals;
+
+// Формат: заголовок, затем узлы, каждый с границы 8 байт: u32 тип (Json::Type), u32 счётчик, далее по типу:
+//  Boolean - значение в счётчике, Integer/Real - 8 байт числа, Text - символы и завершающий 0,
+//  Array - смещения элементов по 8 байт, Object - записи {хэш ключа, смещение ключа (узел Text), смещение значения}
+//  по 8 байт, упорядоченные по хэшу.
+// Format: a header, then nodes, each from an 8 byte boundary: u32 type (Json::Type), u32 counter, then by type:
+//  Boolean - the value in the counter, Integer/Real - 8 bytes of the number, Text - the symbols and a terminating 0,
+//  Array - element offsets of 8 bytes, Object - records {key hash, key offset (a Text node), value offset}
+//  of 8 bytes each, ordered by hash.
+struct binary_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t symbol_size;
+    uint32_t byte_order;
+    uint64_t root;
+};
+
+static constexpr char binaryMagic[4] = {'S', 'J', 'S', 'B'};
+static constexpr uint32_t binaryVersion = 1;
+static constexpr uint32_t binaryByteOrder = 0x01020304;
+
+template<typename K>
+static uint64_t binaryKeyHash(simple_str<K> key) {
+    // FNV-1a по кодовым единицам, одинаковый во всех процессах
+    // FNV-1a over code units, the same in all processes
+    uint64_t hash = 14695981039346656037ull;
+    const K* ptr = key.symbols();
+    for (size_t i = 0, e = key.length(); i < e; i++) {
+        hash ^= uint64_t(std::make_unsigned_t<K>(ptr[i]));
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+template<typename K>
+struct binary_writer {
+    using json_value = JsonValueTempl<K>;
+    using ssType = simple_str<K>;
+
+    struct entry {
+        uint64_t hash;
+        uint64_t key;
+        uint64_t value;
+    };
+
+    lstring<u8s, 0, true>& out;
+    // Одинаковые ключи пишутся один раз
+    // Identical keys are written once
+    hashStrMap<K, uint64_t> keys{};
+
+    uint64_t pos() const {
+        return out.length();
+    }
+
+    char* grow(size_t bytes) {
+        size_t at = out.length();
+        return out.set_size(at + bytes) + at;
+    }
+
+    template<typename T>
+    void put(const T& value) {
+        std::memcpy(grow(sizeof(T)), &value, sizeof(T));
+    }
+
+    uint64_t head(Json::Type type, uint32_t count) {
+        if (size_t rest = pos() % 8) {
+            std::memset(grow(8 - rest), 0, 8 - rest);
+        }
+        uint64_t at = pos();
+        put(uint32_t(type));
+        put(count);
+        return at;
+    }
+
+    uint64_t text(ssType value) {
+        uint64_t at = head(Json::Text, uint32_t(value.length()));
+        size_t bytes = value.length() * sizeof(K);
+        char* ptr = grow(bytes + sizeof(K));
+        std::memcpy(ptr, value.symbols(), bytes);
+        std::memset(ptr + bytes, 0, sizeof(K));
+        return at;
+    }
+
+    template<typename T>
+    uint64_t number(Json::Type type, T value) {
+        uint64_t at = head(type, 0);
+        put(value);
+        return at;
+    }
+
+    uint64_t array(const std::vector<uint64_t>& items) {
+        uint64_t at = head(Json::Array, uint32_t(items.size()));
+        if (!items.empty()) {
+            std::memcpy(grow(items.size() * 8), items.data(), items.size() * 8);
+        }
+        return at;
+    }
+
+    uint64_t write(const json_value& json) {
+        switch (json.type()) {
+        case Json::Null:
+            return head(Json::Null, 0);
+        case Json::Boolean:
+            return head(Json::Boolean, json.as_boolean() ? 1 : 0);
+        case Json::Integer:
+            return number(Json::Integer, json.as_integer());
+        case Json::Real:
+            return number(Json::Real, json.as_real());
+        case Json::Text:
+            return text(json.as_text());
+        case Json::Array: {
+            std::vector<uint64_t> items;
+            items.reserve(json.size());
+            if (json.is_packed()) {
+                for (int64_t v : json.template as_span<int64_t>()) {
+                    items.push_back(number(Json::Integer, v));
+                }
+                for (double v : json.template as_span<double>()) {
+                    items.push_back(number(Json::Real, v));
+                }
+                for (uint8_t v : json.template as_span<uint8_t>()) {
+                    items.push_back(head(Json::Boolean, v ? 1 : 0));
+                }
+            } else {
+                for (const auto& item : *json.as_array()) {
+                    items.push_back(write(item));
+                }
+            }
+            return array(items);
+        }
+        case Json::Object: {
+            std::vector<entry> entries;
+            entries.reserve(json.as_object()->size());
+            for (const auto& [key, value] : *json.as_object()) {
+                if (value.is_undefined()) {
+                    continue;
+                }
+                uint64_t valueAt = write(value);
+                auto [it, inserted] = keys.try_emplace(key.str, 0);
+                if (inserted) {
+                    it->second = text(key.str);
+                }
+                entries.push_back({binaryKeyHash<K>(key.str), it->second, valueAt});
+            }
+            std::sort(entries.begin(), entries.end(), [](const entry& a, const entry& b) {
+                return a.hash < b.hash;
+            });
+            uint64_t at = head(Json::Object, uint32_t(entries.size()));
+            if (!entries.empty()) {
+                std::memcpy(grow(entries.size() * sizeof(entry)), entries.data(), entries.size() * sizeof(entry));
+            }
+            return at;
+        }
+        default:
+            return head(Json::Undefined, 0);
+        }
+    }
+};
+
+template<typename K>
+SIMJSON_API JsonBinaryValue<K> JsonBinaryValue<K>::make(const char* base, size_t size, uint64_t offset) {
+    JsonBinaryValue value;
+    // Смещение из чужих данных может быть любым, сравниваем без переполнения
+    // An offset from foreign data can be anything, compare without overflow
+    if (offset < sizeof(binary_header) || offset % 8 || offset > size || size - offset < 8) {
+        return value;
+    }
+    value.base_ = base;
+    value.size_ = size;
+    value.offset_ = offset;
+    uint64_t count = value.count(), need = 8;
+    switch (value.type()) {
+    case Json::Integer:
+    case Json::Real:
+        need += 8;
+        break;
+    case Json::Text:
+        need += (count + 1) * sizeof(K);
+        break;
+    case Json::Array:
+        need += count * 8;
+        break;
+    case Json::Object:
+        need += count * 24;
+        break;
+    case Json::Undefined:
+    case Json::Null:
+    case Json::Boolean:
+        break;
+    default:
+        return {};
+    }
+    if (need > size - offset) {
+        return {};
+    }
+    return value;
+}
+
+template<typename K>
+SIMJSON_API JsonBinaryValue<K> JsonBinaryValue<K>::at(ssType key) const {
+    if (!is_object()) {
+        return {};
+    }
+    uint64_t hash = binaryKeyHash<K>(key);
+    uint64_t table = offset_ + 8;
+    size_t lo = 0, hi = count();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (read<uint64_t>(table + mid * 24) < hash) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    // При совпадении хэшей сверяем сами ключи
+    // On equal hashes compare the keys themselves
+    for (size_t e = count(); lo < e && read<uint64_t>(table + lo * 24) == hash; lo++) {
+        if (make(base_, size_, read<uint64_t>(table + lo * 24 + 8)).as_text() == key) {
+            return make(base_, size_, read<uint64_t>(table + lo * 24 + 16));
+        }
+    }
+    return {};
+}
+
+template<typename K>
+SIMJSON_API JsonBinaryValue<K> JsonBinaryValue<K>::at(size_t idx) const {
+    if (is_array() && idx < count()) {
+        return make(base_, size_, read<uint64_t>(offset_ + 8 + idx * 8));
+    }
+    if (is_object() && idx < count()) {
+        return make(base_, size_, read<uint64_t>(offset_ + 8 + idx * 24 + 16));
+    }
+    return {};
+}
+
+template<typename K>
+SIMJSON_API typename JsonBinaryValue<K>::ssType JsonBinaryValue<K>::key(size_t idx) const {
+    if (is_object() && idx < count()) {
+        return make(base_, size_, read<uint64_t>(offset_ + 8 + idx * 24 + 8)).as_text();
+    }
+    return {};
+}
+
+template<typename K>
+SIMJSON_API JsonValueTempl<K> JsonBinaryValue<K>::to_json() const {
+    switch (type()) {
+    case Json::Null:
+        return json_value(Json::null);
+    case Json::Boolean:
+        return json_value(as_boolean());
+    case Json::Integer:
+        return json_value(as_integer());
+    case Json::Real:
+        return json_value(as_real());
+    case Json::Text:
+        return json_value(typename json_value::strType(as_text()));
+    case Json::Array: {
+        json_value res(Json::emptyArray);
+        auto& items = *res.as_array();
+        items.reserve(size());
+        for (size_t i = 0, e = size(); i < e; i++) {
+            items.emplace_back(at(i).to_json());
+        }
+        return res;
+    }
+    case Json::Object: {
+        json_value res(Json::emptyObject);
+        auto& items = *res.as_object();
+        for (size_t i = 0, e = size(); i < e; i++) {
+            items.try_emplace(key(i), at(i).to_json());
+        }
+        return res;
+    }
+    default:
+        return {};
+    }
+}
+
+template<typename K>
+SIMJSON_API JsonBinary<K>::~JsonBinary() {
+    close();
+}
+
+template<typename K>
+SIMJSON_API bool JsonBinary<K>::attach(const void* data, size_t size) {
+    close();
+    binary_header header;
+    if (!data || size < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, binaryMagic, 4) || header.version != binaryVersion ||
+            header.symbol_size != sizeof(K) || header.byte_order != binaryByteOrder) {
+        return false;
+    }
+    data_ = static_cast<const char*>(data);
+    size_ = size;
+    root_ = header.root;
+    return true;
+}
+
+template<typename K>
+SIMJSON_API bool JsonBinary<K>::open(stra path) {
+    close();
+    const void* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    lstring<wchar_t, 260> widePath{path};
+    HANDLE file = CreateFileW(widePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    HANDLE mapping = GetFileSizeEx(file, &fileSize) && fileSize.QuadPart ?
+        CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+    CloseHandle(file);
+    if (!mapping) {
+        return false;
+    }
+    data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!data) {
+        return false;
+    }
+    size = size_t(fileSize.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) || !st.st_size) {
+        ::close(fd);
+        return false;
+    }
+    size = size_t(st.st_size);
+    data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+#endif
+    if (!attach(data, size)) {
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+#else
+        munmap(const_cast<void*>(data), size);
+#endif
+        return false;
+    }
+    mapped_ = true;
+    return true;
+}
+
+template<typename K>
+SIMJSON_API void JsonBinary<K>::close() {
+    if (mapped_) {
+#ifdef _WIN32
+        UnmapViewOfFile(data_);
+#else
+        munmap(const_cast<char*>(data_), size_);
+#endif
+    }
+    data_ = nullptr;
+    size_ = 0;
+    root_ = 0;
+    mapped_ = false;
+}
+
+template<typename K>
+SIMJSON_API void JsonBinary<K>::store(const json_value& json, lstring<u8s, 0, true>& out) {
+    out.set_size(0);
+    binary_header header{};
+    std::memcpy(header.magic, binaryMagic, 4);
+    header.version = binaryVersion;
+    header.symbol_size = sizeof(K);
+    header.byte_order = binaryByteOrder;
+    binary_writer<K> writer{out};
+    writer.put(header);
+    header.root = writer.write(json);
+    std::memcpy(out.str(), &header, sizeof(header));
+}
+
+template<typename K>
+SIMJSON_API bool JsonBinary<K>::save(const json_value& json, stra path) {
+    lstring<u8s, 0, true> data;
+    store(json, data);
+    // Пишем во временный файл рядом и подменяем им прежний: у тех, кто уже отобразил файл в память,
+    // остаётся старое содержимое целиком
+    // Write to a temporary file nearby and replace the old one with it: those who have already mapped the file
+    // keep the whole old contents
+    static std::atomic<unsigned> counter{0};
+#ifdef _WIN32
+    unsigned pid = unsigned(GetCurrentProcessId());
+#else
+    unsigned pid = unsigned(getpid());
+#endif
+    std::string target{path.c_str()};
+    std::string temp = target + ".tmp" + std::to_string(pid) + "_" + std::to_string(counter++);
+    {
+        std::ofstream file(temp.c_str(), std::ios::binary | std::ios::trunc);
+        if (!file.is_open() || !file.write(data.symbols(), data.length()) || !file.flush()) {
+            file.close();
+            std::remove(temp.c_str());
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(temp, target, ec);
+    if (ec) {
+        std::remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+template class JsonBinaryValue<u8s>;
+template class JsonBinaryValue<u16s>;
+template class JsonBinaryValue<u32s>;
+template class JsonBinaryValue<wchar_t>;
+template class JsonBinary<u8s>;
+template class JsonBinary<u16s>;
+template class JsonBinary<u32s>;
+template class JsonBinary<wchar_t>;
+
+} // namespace simjson
@@ -0,0 +1,234 @@
+﻿/*
+ * (c) Проект "SimJson", Александр Орефков orefkov@gmail.com
+ * ver. 1.0
+ * Кодирование json в CBOR (RFC 8949) и обратно
+ */
+
+#include <simjson/cbor.h>
+#include "codec.h"
+#include <cmath>
+#include <limits>
+
+namespace simjson {
+using namespace simstr;
+using namespace simstr::literals;
+
+namespace {
+
+enum CborMajor {
+    Unsigned,
+    Negative,
+    Bytes,
+    TextString,
+    ArrayItems,
+    MapItems,
+    Tag,
+    Simple,
+};
+
+template<typename K>
+struct cbor_writer : tree_writer<K, cbor_writer<K>> {
+    using tree_writer<K, cbor_writer<K>>::putBig;
+
+    // Заголовок: старший тип и аргумент в наименьшей форме, числа - от старшего байта
+    // Header: the major type and the argument in the shortest form, numbers - big-endian
+    void head(unsigned major, uint64_t value) {
+        if (value < 24) {
+            putBig(uint8_t(major << 5 | value), 0, 0);
+        } else {
+            unsigned bytes = value <= 0xFF ? 1 : value <= 0xFFFF ? 2 : value <= 0xFFFFFFFF ? 4 : 8;
+            putBig(uint8_t(major << 5 | (bytes == 1 ? 24 : bytes == 2 ? 25 : bytes == 4 ? 26 : 27)), value, bytes);
+        }
+    }
+
+    void integer(int64_t value) {
+        if (value >= 0) {
+            head(Unsigned, uint64_t(value));
+        } else {
+            head(Negative, uint64_t(-1 - value));
+        }
+    }
+
+    void real(double value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, 8);
+        putBig(0xFB, bits, 8);
+    }
+
+    void boolean(bool value) {
+        putBig(value ? 0xF5 : 0xF4, 0, 0);
+    }
+
+    void null() {
+        putBig(0xF6, 0, 0);
+    }
+
+    void undefined() {
+        putBig(0xF7, 0, 0);
+    }
+
+    void textHead(size_t size) {
+        head(TextString, size);
+    }
+
+    void arrayHead(size_t size) {
+        head(ArrayItems, size);
+    }
+
+    void mapHead(size_t size) {
+        head(MapItems, size);
+    }
+};
+
+double halfToDouble(unsigned half) {
+    int exp = (half >> 10) & 0x1F;
+    unsigned mant = half & 0x3FF;
+    double value;
+    if (exp == 0) {
+        value = std::ldexp(mant, -24);
+    } else if (exp != 31) {
+        value = std::ldexp(mant + 1024, exp - 25);
+    } else {
+        value = mant == 0 ? std::numeric_limits<double>::infinity() : std::numeric_limits<double>::quiet_NaN();
+    }
+    return half & 0x8000 ? -value : value;
+}
+
+} // namespace
+
+template<typename K>
+SIMJSON_API void to_cbor(const JsonValueTempl<K>& json, lstring<u8s, 0, true>& out) {
+    cbor_writer<K>{{out}}.write(json);
+}
+
+// Разбирает один заголовок с его данными, возвращает сколько байтов занято, 0 - данных пока не хватает
+// Decodes one header with its data, returns how many bytes it took, 0 - not enough data yet
+template<typename K>
+size_t StreamedCborParser<K>::decodeItem(const uint8_t* ptr, size_t size) {
+    unsigned major = ptr[0] >> 5, info = ptr[0] & 31;
+    uint64_t arg = info;
+    size_t used = 1;
+    bool indefinite = info == 31;
+    if (info >= 24 && info <= 27) {
+        size_t bytes = size_t(1) << (info - 24);
+        if (size < 1 + bytes) {
+            return 0;
+        }
+        arg = 0;
+        for (size_t i = 1; i <= bytes; i++) {
+            arg = arg << 8 | ptr[i];
+        }
+        used += bytes;
+    } else if (info > 27 && (!indefinite || major < Bytes || major == Tag)) {
+        error_ = JsonParseResult::Error;
+        return 0;
+    }
+    if (stringMajor_ >= 0 && !(major == unsigned(stringMajor_) && !indefinite) && ptr[0] != 0xFF) {
+        // Внутри строки неопределённой длины только части того же типа
+        // Inside a string of indefinite length only parts of the same type
+        error_ = JsonParseResult::Error;
+        return 0;
+    }
+
+    switch (major) {
+    case Unsigned:
+        if (arg <= uint64_t(std::numeric_limits<int64_t>::max())) {
+            addValue(JsonValueTempl<K>(int64_t(arg)));
+        } else {
+            addValue(JsonValueTempl<K>(double(arg)));
+        }
+        break;
+    case Negative:
+        if (arg <= uint64_t(std::numeric_limits<int64_t>::max())) {
+            addValue(JsonValueTempl<K>(-1 - int64_t(arg)));
+        } else {
+            addValue(JsonValueTempl<K>(-1.0 - double(arg)));
+        }
+        break;
+    case Bytes:
+    case TextString:
+        if (indefinite) {
+            stringMajor_ = int(major);
+            stringParts_.clear();
+            break;
+        }
+        if (arg > size - used) {
+            overString(arg);
+            return 0;
+        }
+        if (stringMajor_ >= 0) {
+            // Части копятся до break, проверяем ограничения до добавления каждой
+            // Parts accumulate until break, check the limits before adding each of them
+            if (overString(stringParts_.size() + arg)) {
+                return 0;
+            }
+            stringParts_.append(reinterpret_cast<const char*>(ptr + used), size_t(arg));
+        } else {
+            addString(ptr + used, size_t(arg), major == TextString);
+        }
+        used += size_t(arg);
+        break;
+    case ArrayItems:
+    case MapItems:
+        openContainer(major == MapItems, arg, indefinite);
+        break;
+    case Tag:
+        // Теги не влияют на json, значение за ними разбирается как есть
+        // Tags do not affect json, the value after them is parsed as is
+        break;
+    case Simple:
+        if (indefinite) {
+            // break - конец строки или контейнера неопределённой длины
+            // break - the end of a string or container of indefinite length
+            if (stringMajor_ >= 0) {
+                std::string parts = std::move(stringParts_);
+                bool text = stringMajor_ == TextString;
+                stringMajor_ = -1;
+                addString(reinterpret_cast<const uint8_t*>(parts.data()), parts.size(), text);
+            } else {
+                closeContainer();
+            }
+        } else if (info == 20 || info == 21) {
+            addValue(JsonValueTempl<K>(info == 21));
+        } else if (info == 25) {
+            addValue(JsonValueTempl<K>(halfToDouble(unsigned(arg))));
+        } else if (info == 26) {
+            uint32_t bits = uint32_t(arg);
+            float value;
+            std::memcpy(&value, &bits, 4);
+            addValue(JsonValueTempl<K>(double(value)));
+        } else if (info == 27) {
+            double value;
+            std::memcpy(&value, &arg, 8);
+            addValue(JsonValueTempl<K>(value));
+        } else {
+            addValue(JsonValueTempl<K>(Json::null));
+        }
+        break;
+    }
+    return error_ == JsonParseResult::Pending ? used : 0;
+}
+
+template<typename K>
+SIMJSON_API typename JsonValueTempl<K>::parse_result from_cbor(ssa data, const ParseLimits& limits, std::pmr::memory_resource* resource) {
+    return decodeAll<StreamedCborParser<K>>(data, limits, resource);
+}
+
+template SIMJSON_API void to_cbor(const JsonValueTempl<u8s>&, lstring<u8s, 0, true>&);
+template SIMJSON_API void to_cbor(const JsonValueTempl<u16s>&, lstring<u8s, 0, true>&);
+template SIMJSON_API void to_cbor(const JsonValueTempl<u32s>&, lstring<u8s, 0, true>&);
+template SIMJSON_API void to_cbor(const JsonValueTempl<wchar_t>&, lstring<u8s, 0, true>&);
+template struct StreamedBinaryParser<u8s, StreamedCborParser<u8s>>;
+template struct StreamedCborParser<u8s>;
+template struct StreamedBinaryParser<u16s, StreamedCborParser<u16s>>;
+template struct StreamedCborParser<u16s>;
+template struct StreamedBinaryParser<u32s, StreamedCborParser<u32s>>;
+template struct StreamedCborParser<u32s>;
+template struct StreamedBinaryParser<wchar_t, StreamedCborParser<wchar_t>>;
+template struct StreamedCborParser<wchar_t>;
+template SIMJSON_API JsonValueTempl<u8s>::parse_result from_cbor<u8s>(ssa, const ParseLimits&, std::pmr::memory_resource*);
+template SIMJSON_API JsonValueTempl<u16s>::parse_result from_cbor<u16s>(ssa, const ParseLimits&, std::pmr::memory_resource*);
+template SIMJSON_API JsonValueTempl<u32s>::parse_result from_cbor<u32s>(ssa, const ParseLimits&, std::pmr::memory_resource*);
+template SIMJSON_API JsonValueTempl<wchar_t>::parse_result from_cbor<wchar_t>(ssa, const ParseLimits&, std::pmr::memory_resource*);
+
+} // namespace simjson
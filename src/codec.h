@@ -0,0 +1,346 @@
+﻿/*
+ * (c) Проект "SimJson", Александр Орефков orefkov@gmail.com
+ * ver. 1.0
+ * Общая реализация двоичных форматов: обход json при записи и построение дерева при разборе
+ */
+
+#pragma once
+#include <simjson/decoder.h>
+#include <cstring>
+#include <string>
+
+namespace simjson {
+
+namespace {
+
+// Запись json в двоичный формат: обход дерева общий, формат пишет заголовки и простые значения.
+// Format должен иметь integer, real, boolean, null, undefined, textHead, arrayHead, mapHead.
+// Writing json into a binary format: the tree walk is common, the format writes headers and simple values.
+// Format must have integer, real, boolean, null, undefined, textHead, arrayHead, mapHead.
+template<typename K, typename Format>
+struct tree_writer {
+    lstring<u8s, 0, true>& out;
+
+    void put(const void* data, size_t size) {
+        size_t at = out.length();
+        std::memcpy(out.set_size(at + size) + at, data, size);
+    }
+
+    // Маркер и за ним число заданной ширины, от старшего байта
+    // A marker followed by a number of the given width, big-endian
+    void putBig(uint8_t marker, uint64_t value, unsigned bytes) {
+        uint8_t buf[9] = {marker};
+        for (unsigned i = 0; i < bytes; i++) {
+            buf[bytes - i] = uint8_t(value >> (i * 8));
+        }
+        put(buf, bytes + 1);
+    }
+
+    void text(simple_str<K> value) {
+        Format& format = static_cast<Format&>(*this);
+        if constexpr (std::is_same_v<K, u8s>) {
+            format.textHead(value.length());
+            put(value.symbols(), value.length());
+        } else {
+            lstring<u8s, 256> utf8{value};
+            format.textHead(utf8.length());
+            put(utf8.symbols(), utf8.length());
+        }
+    }
+
+    void write(const JsonValueTempl<K>& json) {
+        Format& format = static_cast<Format&>(*this);
+        switch (json.type()) {
+        case Json::Undefined:
+            format.undefined();
+            break;
+        case Json::Null:
+            format.null();
+            break;
+        case Json::Boolean:
+            format.boolean(json.as_boolean());
+            break;
+        case Json::Integer:
+            format.integer(json.as_integer());
+            break;
+        case Json::Real:
+            format.real(json.as_real());
+            break;
+        case Json::Text:
+            text(json.as_text());
+            break;
+        case Json::Array:
+            format.arrayHead(json.size());
+            if (json.is_packed()) {
+                for (int64_t v : json.template as_span<int64_t>()) {
+                    format.integer(v);
+                }
+                for (double v : json.template as_span<double>()) {
+                    format.real(v);
+                }
+                for (uint8_t v : json.template as_span<uint8_t>()) {
+                    format.boolean(v != 0);
+                }
+            } else {
+                for (const auto& item : *json.as_array()) {
+                    write(item);
+                }
+            }
+            break;
+        case Json::Object: {
+            // Undefined в объектах не пишется
+            // Undefined in objects is not written
+            size_t count = 0;
+            for (const auto& [key, value] : *json.as_object()) {
+                count += !value.is_undefined();
+            }
+            format.mapHead(count);
+            for (const auto& [key, value] : *json.as_object()) {
+                if (!value.is_undefined()) {
+                    text(key.str);
+                    write(value);
+                }
+            }
+            break;
+        }
+        }
+    }
+};
+
+void base64url(const uint8_t* ptr, size_t size, std::string& out) {
+    static constexpr char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+    for (size_t i = 0; i < size; i += 3) {
+        unsigned chunk = unsigned(ptr[i]) << 16;
+        if (i + 1 < size) {
+            chunk |= unsigned(ptr[i + 1]) << 8;
+        }
+        if (i + 2 < size) {
+            chunk |= ptr[i + 2];
+        }
+        out += alphabet[(chunk >> 18) & 63];
+        out += alphabet[(chunk >> 12) & 63];
+        if (i + 1 < size) {
+            out += alphabet[(chunk >> 6) & 63];
+        }
+        if (i + 2 < size) {
+            out += alphabet[chunk & 63];
+        }
+    }
+}
+
+// Разобрать все данные парсером формата
+// Parse all the data with a format parser
+template<typename Parser>
+auto decodeAll(ssa data, const ParseLimits& limits, std::pmr::memory_resource* resource) {
+    Parser parser;
+    parser.limits_ = limits;
+    parser.resource_ = resource;
+    auto res = parser.parseAll(data);
+    return typename decltype(parser.result_)::parse_result{std::move(parser.result_), res, parser.line_, parser.col_};
+}
+
+} // namespace
+
+template<typename K, typename Decoder>
+SIMJSON_API void StreamedBinaryParser<K, Decoder>::reset() {
+    result_ = JsonValueTempl<K>{};
+    resetState();
+    stack_.clear();
+    pending_.clear();
+    done_ = false;
+    error_ = JsonParseResult::Pending;
+    static_cast<Decoder*>(this)->resetItem();
+}
+
+template<typename K, typename Decoder>
+SIMJSON_API JsonParseResult StreamedBinaryParser<K, Decoder>::processChunk(ssa chunk, bool last) {
+    if (done_) {
+        return JsonParseResult::NoNeedMore;
+    }
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(chunk.symbols());
+    size_t size = chunk.length();
+    if (!pending_.empty()) {
+        pending_.insert(pending_.end(), data, data + size);
+        data = pending_.data();
+        size = pending_.size();
+    }
+    size_t pos = 0;
+    while (!done_ && pos < size) {
+        // Формат возвращает, сколько байтов занял элемент, 0 - данных пока не хватает
+        // The format returns how many bytes the item took, 0 - not enough data yet
+        size_t used = static_cast<Decoder*>(this)->decodeItem(data + pos, size - pos);
+        if (error_ != JsonParseResult::Pending) {
+            return error_;
+        }
+        if (!used) {
+            break;
+        }
+        pos += used;
+        col_ += unsigned(used);
+    }
+    bool rest = pos < size;
+    if (done_) {
+        pending_.clear();
+        return last && !rest ? JsonParseResult::Success : JsonParseResult::NoNeedMore;
+    }
+    if (data == pending_.data()) {
+        pending_.erase(pending_.begin(), pending_.begin() + pos);
+    } else {
+        pending_.assign(data + pos, data + size);
+    }
+    return JsonParseResult::Pending;
+}
+
+template<typename K, typename Decoder>
+bool StreamedBinaryParser<K, Decoder>::addString(const uint8_t* ptr, size_t size, bool text) {
+    strType value;
+    if (text) {
+        if (limits_.validate_utf8) {
+            for (size_t i = 0; i < size; i++) {
+                if (!checkUtf8(ptr[i])) {
+                    error_ = JsonParseResult::Error;
+                    return false;
+                }
+            }
+            if (utf8Need_) {
+                error_ = JsonParseResult::Error;
+                return false;
+            }
+        }
+        value = strType(lstring<K, 64>{ssa{reinterpret_cast<const u8s*>(ptr), size}});
+    } else {
+        std::string encoded;
+        base64url(ptr, size, encoded);
+        value = strType(lstring<K, 64>{ssa{encoded.data(), encoded.size()}});
+    }
+    if (value.length() > limits_.max_string_length || overBytes(value.length() * sizeof(K))) {
+        error_ = JsonParseResult::LimitExceeded;
+        return false;
+    }
+    return addValue(JsonValueTempl<K>(std::move(value)));
+}
+
+template<typename K, typename Decoder>
+bool StreamedBinaryParser<K, Decoder>::addValue(JsonValueTempl<K>&& value) {
+    if (stack_.empty()) {
+        result_ = std::move(value);
+        done_ = true;
+        return true;
+    }
+    Frame& frame = stack_.back();
+    if (frame.map && frame.needKey) {
+        // Ключ словаря: текст или целое число
+        // Map key: text or an integer
+        if (value.is_text()) {
+            frame.key = value.as_text();
+        } else if (value.is_integer()) {
+            frame.key = strType(e_num<K>(value.as_integer()));
+        } else {
+            error_ = JsonParseResult::Error;
+            return false;
+        }
+        frame.needKey = false;
+        return true;
+    }
+    if (++values_ > limits_.max_values) {
+        error_ = JsonParseResult::LimitExceeded;
+        return false;
+    }
+    if (frame.map) {
+        auto [it, inserted] = frame.container->as_object()->try_emplace(frame.key, std::move(value));
+        if (!inserted) {
+            error_ = JsonParseResult::Error;
+            return false;
+        }
+        if (overBytes(sizeof(*it) + 2 * sizeof(void*))) {
+            error_ = JsonParseResult::LimitExceeded;
+            return false;
+        }
+    } else {
+        frame.container->as_array()->emplace_back(std::move(value));
+        if (overBytes(sizeof(JsonValueTempl<K>))) {
+            error_ = JsonParseResult::LimitExceeded;
+            return false;
+        }
+    }
+    complete();
+    return true;
+}
+
+template<typename K, typename Decoder>
+bool StreamedBinaryParser<K, Decoder>::openContainer(bool map, uint64_t count, bool indefinite) {
+    if (stack_.size() + 1 > limits_.max_depth ||
+            overBytes((map ? sizeof(typename JsonValueTempl<K>::obj_type) : sizeof(typename JsonValueTempl<K>::arr_type)) + 2 * sizeof(void*))) {
+        error_ = JsonParseResult::LimitExceeded;
+        return false;
+    }
+    JsonValueTempl<K> container(map ? Json::Object : Json::Array, resource_);
+    JsonValueTempl<K>* place;
+    if (stack_.empty()) {
+        result_ = std::move(container);
+        place = &result_;
+    } else {
+        Frame& frame = stack_.back();
+        if (frame.map && frame.needKey) {
+            error_ = JsonParseResult::Error;
+            return false;
+        }
+        if (++values_ > limits_.max_values) {
+            error_ = JsonParseResult::LimitExceeded;
+            return false;
+        }
+        if (frame.map) {
+            auto [it, inserted] = frame.container->as_object()->try_emplace(frame.key, std::move(container));
+            if (!inserted) {
+                error_ = JsonParseResult::Error;
+                return false;
+            }
+            place = &it->second;
+        } else {
+            frame.container->as_array()->emplace_back(std::move(container));
+            place = &frame.container->as_array()->back();
+        }
+    }
+    stack_.push_back({place, count, map, indefinite, true, {}});
+    if (!indefinite && !count) {
+        stack_.pop_back();
+        complete();
+    }
+    return true;
+}
+
+template<typename K, typename Decoder>
+bool StreamedBinaryParser<K, Decoder>::closeContainer() {
+    // Словарь нельзя закрыть между ключом и значением
+    // A map cannot be closed between a key and a value
+    if (stack_.empty() || !stack_.back().indefinite || !stack_.back().needKey) {
+        error_ = JsonParseResult::Error;
+        return false;
+    }
+    if (limits_.packed_arrays && !stack_.back().map) {
+        stack_.back().container->pack();
+    }
+    stack_.pop_back();
+    complete();
+    return true;
+}
+
+// Элемент текущего контейнера готов: закрываем контейнеры, в которых собраны все элементы
+// An element of the current container is ready: close the containers in which all elements are collected
+template<typename K, typename Decoder>
+void StreamedBinaryParser<K, Decoder>::complete() {
+    while (!stack_.empty()) {
+        Frame& frame = stack_.back();
+        frame.needKey = true;
+        if (frame.indefinite || --frame.remaining) {
+            return;
+        }
+        if (limits_.packed_arrays && !frame.map) {
+            frame.container->pack();
+        }
+        stack_.pop_back();
+    }
+    done_ = true;
+}
+
+} // namespace simjson
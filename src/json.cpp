@@ -14,119 +14,91 @@
 #include <simjson/json.h>
 #include <cmath>
 #include <algorithm>
+#include <charconv>
+#include <cstring>
 #include <fstream>
+#if SIMJSON_STATS > 1
+#include <chrono>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#endif
 
 namespace simjson {
 using namespace simstr;
 using namespace simstr::literals;
 
-template<typename K>
-struct expr_json_str {
-    using symb_type = K;
-    using test_type = std::make_unsigned_t<K>;
-    using ssType = typename JsonValueTempl<K>::ssType;
-    ssType text;
-    size_t l;
-
-    size_t length() const noexcept {
-        return l;
-    }
-
-    explicit expr_json_str(ssType t) : text(t) {
-        const K* ptr = text.symbols();
-        size_t add = 0;
-        for (size_t i = text.length(); i-- ;) {
-            test_type s = (test_type)*ptr++;
-            switch (s) {
-            case '\b':
-            case '\f':
-            case '\r':
-            case '\n':
-            case '\t':
-            case '\"':
-            case '\\':
-                add++;
-                break;
-            default:
-                if (s < ' ') {
-                    add += 5; // \u0001
-                }
-            }
-        }
-        l = text.length() + add;
-    }
-
-    K* place(K* ptr) const noexcept{
-        static constexpr ssType repl[] = {
-            uni_string(K, "\\u0000"),
-            uni_string(K, "\\u0001"),
-            uni_string(K, "\\u0002"),
-            uni_string(K, "\\u0003"),
-            uni_string(K, "\\u0004"),
-            uni_string(K, "\\u0005"),
-            uni_string(K, "\\u0006"),
-            uni_string(K, "\\u0007"),
-            uni_string(K, "\\b"),
-            uni_string(K, "\\t"),
-            uni_string(K, "\\n"),
-            uni_string(K, "\\u000B"),
-            uni_string(K, "\\f"),
-            uni_string(K, "\\r"),
-            uni_string(K, "\\u000E"),
-            uni_string(K, "\\u000F"),
-            uni_string(K, "\\u0010"),
-            uni_string(K, "\\u0011"),
-            uni_string(K, "\\u0012"),
-            uni_string(K, "\\u0013"),
-            uni_string(K, "\\u0014"),
-            uni_string(K, "\\u0015"),
-            uni_string(K, "\\u0016"),
-            uni_string(K, "\\u0017"),
-            uni_string(K, "\\u0018"),
-            uni_string(K, "\\u0019"),
-            uni_string(K, "\\u001A"),
-            uni_string(K, "\\u001B"),
-            uni_string(K, "\\u001C"),
-            uni_string(K, "\\u001D"),
-            uni_string(K, "\\u001E"),
-            uni_string(K, "\\u001F"),
-        };
-        const K* r = text.symbols();
-        size_t lenOfText = text.length(), lenOfTail = l - lenOfText;
-        while (lenOfTail) {
-            test_type s = (test_type)*r++;
-            switch (s) {
-            case '\"':
-                *ptr++ = '\\';
-                *ptr++ = '\"';
-                lenOfTail--;
-                break;
-            case '\\':
-                *ptr++ = '\\';
-                *ptr++ = '\\';
-                lenOfTail--;
-                break;
-            default:
-                if (s < ' ') {
-                    ptr = repl[s].place(ptr);
-                    lenOfTail -= repl[s].len - 1;
-                } else {
-                    *ptr++ = s;
-                }
-            }
-            lenOfText--;
-        }
-        if (lenOfText) {
-            std::char_traits<K>::copy(ptr, r, lenOfText);
-            ptr += lenOfText;
-        }
-        return ptr;
+// Замер времени фазы для статистики, при SIMJSON_STATS < 2 ничего не делает
+// Measuring the time of a phase for statistics, does nothing with SIMJSON_STATS < 2
+template<bool On = (SIMJSON_STATS > 1)>
+struct phase_timer {
+    explicit phase_timer(uint64_t&) {}
+    // Фаза разбора: статистика парсера без SIMJSON_STATS пустая, поле задаётся указателем
+    // A parse phase: the parser statistics are empty without SIMJSON_STATS, the field is given by a pointer
+    template<typename S>
+    phase_timer(S&, uint64_t JsonParseStats::*) {}
+};
+
+#if SIMJSON_STATS > 1
+template<>
+struct phase_timer<true> {
+    uint64_t& target;
+    uint64_t start;
+
+    static uint64_t now() {
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return uint64_t(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+    }
+
+    explicit phase_timer(uint64_t& t) : target(t), start(now()) {}
+    phase_timer(JsonParseStats& stats, uint64_t JsonParseStats::* field) : phase_timer(stats.*field) {}
+    ~phase_timer() {
+        target += now() - start;
     }
 };
+#endif
+
+SIMJSON_API JsonParseStats& JsonParseStats::operator+=(const JsonParseStats& other) {
+    bytes += other.bytes;
+    for (size_t i = 0; i < std::size(values); i++) {
+        values[i] += other.values[i];
+    }
+    escapes += other.escapes;
+    integers += other.integers;
+    reals += other.reals;
+    fallbacks += other.fallbacks;
+    max_depth = std::max(max_depth, other.max_depth);
+    allocations += other.allocations;
+    allocated_bytes += other.allocated_bytes;
+    cycles_total += other.cycles_total;
+    cycles_strings += other.cycles_strings;
+    cycles_numbers += other.cycles_numbers;
+    cycles_insert += other.cycles_insert;
+    return *this;
+}
+
+SIMJSON_API JsonParseStats& JsonParseStats::thread_total() {
+    thread_local JsonParseStats stats;
+    return stats;
+}
+
+SIMJSON_API JsonStoreStats& JsonStoreStats::thread_total() {
+    thread_local JsonStoreStats stats;
+    return stats;
+}
 
 template<typename K>
-SIMJSON_API JsonValueTempl<K>::JsonValueTempl(const JsonValueTempl& other) : type_(other.type_) {
-    switch (type_) {
+SIMJSON_API JsonValueTempl<K>::JsonValueTempl(const JsonValueTempl& other) : type_(other.type_), raw_(other.raw_), packed_(other.packed_) {
+    if (packed_) {
+        new (&val_.packed) json_packed(other.val_.packed); // копируем shared_ptr на массив
+        return;
+    }
+    switch (raw_ ? Text : type_) {
     case Boolean:
         val_.boolean = other.val_.boolean;
         break;
@@ -137,13 +109,13 @@ SIMJSON_API JsonValueTempl<K>::JsonValueTempl(const JsonValueTempl& other) : typ
         val_.real = other.val_.real;
         break;
     case Text:
-        new (&val_.text) strType(other.as_text());
+        new (&val_.text) strType(other.val_.text);
         break;
     case Object:
         new (&val_.object) json_object(other.as_object()); // копируем shared_ptr на объект
         break;
     case Array:
-        new (&val_.array) json_array(other.as_array());    // копируем shared_ptr на массив
+        new (&val_.array) json_array(other.val_.array);    // копируем shared_ptr на массив
         break;
     default:
         break;
@@ -152,15 +124,19 @@ SIMJSON_API JsonValueTempl<K>::JsonValueTempl(const JsonValueTempl& other) : typ
 
 template<typename K>
 SIMJSON_API JsonValueTempl<K>::~JsonValueTempl() {
-    switch (type_) {
+    if (packed_) {
+        val_.packed.~json_packed();
+        return;
+    }
+    switch (raw_ ? Text : type_) {
     case Text:
-        as_text().~strType();
+        val_.text.~strType();
         break;
     case Object:
         as_object().~json_object();
         break;
     case Array:
-        as_array().~json_array();
+        val_.array.~json_array();
         break;
     default:
         break;
@@ -168,7 +144,7 @@ SIMJSON_API JsonValueTempl<K>::~JsonValueTempl() {
 }
 
 template<typename K>
-SIMJSON_API JsonValueTempl<K>::JsonValueTempl(Type type) : type_(type) {
+SIMJSON_API JsonValueTempl<K>::JsonValueTempl(Type type, std::pmr::memory_resource* resource) : type_(type) {
     switch (type_) {
     case Boolean:
         val_.boolean = false;
@@ -183,10 +159,10 @@ SIMJSON_API JsonValueTempl<K>::JsonValueTempl(Type type) : type_(type) {
         val_.real = 0.0;
         break;
     case Object:
-        new (&val_.object) json_object(std::make_shared<obj_type>());
+        new (&val_.object) json_object(make_object(resource));
         break;
     case Array:
-        new (&val_.array) json_array(std::make_shared<arr_type>());
+        new (&val_.array) json_array(make_array(resource));
         break;
     default:
         break;
@@ -194,9 +170,19 @@ SIMJSON_API JsonValueTempl<K>::JsonValueTempl(Type type) : type_(type) {
 }
 
 template<typename K>
-SIMJSON_API JsonValueTempl<K>::JsonValueTempl(const Clone& clone) : type_(clone.from.type_) {
+SIMJSON_API JsonValueTempl<K>::JsonValueTempl(const Clone& clone) : type_(clone.from.type_), raw_(clone.from.raw_) {
     const json_value& other = clone.from;
-    switch (type_) {
+    if (other.is_packed()) {
+        const packed_type& from = *other.val_.packed;
+        packed_ = true;
+        if (clone.resource) {
+            new (&val_.packed) json_packed(std::allocate_shared<packed_type>(std::pmr::polymorphic_allocator<packed_type>(clone.resource), from, clone.resource));
+        } else {
+            new (&val_.packed) json_packed(std::make_shared<packed_type>(from));
+        }
+        return;
+    }
+    switch (raw_ ? Text : type_) {
     case Boolean:
         val_.boolean = other.val_.boolean;
         break;
@@ -207,19 +193,133 @@ SIMJSON_API JsonValueTempl<K>::JsonValueTempl(const Clone& clone) : type_(clone.
         val_.real = other.val_.real;
         break;
     case Text:
-        new (&val_.text) strType(other.as_text());
+        new (&val_.text) strType(other.val_.text);
         break;
     case Object:
-        new (&val_.object) json_object(std::make_shared<obj_type>(*other.as_object()));
+        if (clone.resource) {
+            new (&val_.object) json_object(std::allocate_shared<obj_type>(std::pmr::polymorphic_allocator<obj_type>(clone.resource), *other.as_object()));
+        } else {
+            new (&val_.object) json_object(std::make_shared<obj_type>(*other.as_object()));
+        }
         break;
     case Array:
-        new (&val_.array) json_array(std::make_shared<arr_type>(*other.as_array()));
+        if (clone.resource) {
+            new (&val_.array) json_array(std::allocate_shared<arr_type>(std::pmr::polymorphic_allocator<arr_type>(clone.resource), *other.as_array()));
+        } else {
+            new (&val_.array) json_array(std::make_shared<arr_type>(*other.as_array()));
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+template<typename K>
+SIMJSON_API bool JsonValueTempl<K>::pack() {
+    if (type_ != Array || packed_ || val_.array.use_count() != 1 || val_.array->empty()) {
+        return packed_;
+    }
+    const arr_type& arr = *val_.array;
+    Type type = arr.front().type_;
+    if (type != Integer && type != Real && type != Boolean) {
+        return false;
+    }
+    for (const auto& item : arr) {
+        if (item.type_ != type || item.raw_) {
+            return false;
+        }
+    }
+    // Упакованные значения берут память там же, где и элементы массива
+    // The packed values take memory from the same place as the array elements
+    json_packed packed = make_packed(type, vector_resource(arr));
+    switch (type) {
+    case Integer:
+        packed->integers.reserve(arr.size());
+        for (const auto& item : arr) {
+            packed->integers.push_back(item.val_.integer);
+        }
+        break;
+    case Real:
+        packed->reals.reserve(arr.size());
+        for (const auto& item : arr) {
+            packed->reals.push_back(item.val_.real);
+        }
         break;
     default:
+        packed->booleans.reserve(arr.size());
+        for (const auto& item : arr) {
+            packed->booleans.push_back(item.val_.boolean);
+        }
+    }
+    val_.array.~json_array();
+    new (&val_.packed) json_packed(std::move(packed));
+    packed_ = true;
+    return true;
+}
+
+template<typename K>
+SIMJSON_API bool JsonValueTempl<K>::unpack() {
+    if (!packed_) {
+        return false;
+    }
+    // Забираем свою ссылку на упакованные значения, другие копии их сохраняют
+    // Take our own reference to the packed values, other copies keep them
+    json_packed packed = std::move(val_.packed);
+    val_.packed.~json_packed();
+    packed_ = false;
+    // Уже построенные элементы забираем, если массив только наш: выданные на них ссылки остаются действительными
+    // Take the already built elements if the array is only ours: references handed out to them stay valid
+    if (packed.use_count() == 1 && packed->items) {
+        new (&val_.array) json_array(std::move(packed->items));
+        return true;
+    }
+    new (&val_.array) json_array(make_array(packed->resource()));
+    arr_type& arr = *val_.array;
+    switch (packed->type) {
+    case Integer:
+        arr.assign(packed->integers.begin(), packed->integers.end());
+        break;
+    case Real:
+        arr.assign(packed->reals.begin(), packed->reals.end());
         break;
+    default:
+        arr.reserve(packed->booleans.size());
+        for (uint8_t b : packed->booleans) {
+            arr.emplace_back(b != 0);
+        }
+    }
+    return true;
+}
+
+template<typename K>
+SIMJSON_API JsonValueTempl<K> JsonValueTempl<K>::packedItem(size_t idx) const {
+    const packed_type& packed = *val_.packed;
+    switch (packed.type) {
+    case Integer:
+        return json_value(packed.integers[idx]);
+    case Real:
+        return json_value(packed.reals[idx]);
+    default:
+        return json_value(packed.booleans[idx] != 0);
     }
 }
 
+template<typename K>
+SIMJSON_API const typename JsonValueTempl<K>::json_array& JsonValueTempl<K>::packedItems() const {
+    // Строятся один раз на все копии массива и не меняются, поэтому на них можно отдавать ссылки из разных потоков
+    // Built once for all copies of the array and never change, so references to them can be handed out from different threads
+    const packed_type& packed = *val_.packed;
+    std::call_once(packed.built, [&] {
+        json_array items = make_array(packed.resource());
+        items->reserve(packed.size());
+        for (size_t i = 0, count = packed.size(); i < count; i++) {
+            items->emplace_back(packedItem(i));
+        }
+        packed.items = std::move(items);
+    });
+    return packed.items;
+}
+
 template<typename K>
 SIMJSON_API bool JsonValueTempl<K>::to_boolean() const {
     switch (type_) {
@@ -228,9 +328,9 @@ SIMJSON_API bool JsonValueTempl<K>::to_boolean() const {
         case Text:
             return !as_text().is_empty();
         case Integer:
-            return val_.integer != 0;
+            return int_value() != 0;
         case Real:
-            return val_.real != 0.0;
+            return real_value() != 0.0;
         case Object:
         case Array:
             return true;
@@ -269,18 +369,18 @@ SIMJSON_API std::optional<int64_t> JsonValueTempl<K>::to_integer() const {
         break;
     }
     case Integer:
-        return val_.integer;
+        return int_value();
     case Real:
-        if (is_double_int64(val_.real)) {
-            return static_cast<int64_t>(val_.real);
+        if (double real = real_value(); is_double_int64(real)) {
+            return static_cast<int64_t>(real);
         }
         break;
     case Array:
         // Для массивов в javascript если размер массива равен 0, то 0, если 1, то берётся значение из первого элемента, иначе NaN
-        if (as_array()->size() == 0) {
+        if (size() == 0) {
             return 0;
-        } else if (as_array()->size() == 1) {
-            return (*as_array())[0].to_integer();
+        } else if (size() == 1) {
+            return value_at(0).to_integer();
         }
         break;
     default:
@@ -297,9 +397,9 @@ SIMJSON_API double JsonValueTempl<K>::to_real() const {
     case Json::Text:
         return val_.text.to_double().value_or(std::nan("0"));
     case Json::Integer:
-        return static_cast<double>(val_.integer);
+        return static_cast<double>(int_value());
     case Json::Real:
-        return val_.real;
+        return real_value();
     default:
         return std::nan("");
     }
@@ -308,10 +408,12 @@ SIMJSON_API double JsonValueTempl<K>::to_real() const {
 template<typename K>
 std::optional<int64_t> JsonValueTempl<K>::number_int() const {
     if (type_ == Integer) {
-        return val_.integer;
+        return int_value();
     }
-    if (type_ == Real && is_double_int64(val_.real)) {
-        return static_cast<int64_t>(val_.real);
+    if (type_ == Real) {
+        if (double real = real_value(); is_double_int64(real)) {
+            return static_cast<int64_t>(real);
+        }
     }
     return {};
 }
@@ -319,14 +421,41 @@ std::optional<int64_t> JsonValueTempl<K>::number_int() const {
 template<typename K>
 SIMJSON_API std::optional<double> JsonValueTempl<K>::number_real() const {
     if (type_ == Real) {
-        return val_.real;
+        return real_value();
     }
     if (type_ == Integer) {
-        return static_cast<double>(val_.integer);
+        return static_cast<double>(int_value());
+    }
+    return {};
+}
+
+template<typename K>
+SIMJSON_API std::optional<uint64_t> JsonValueTempl<K>::number_uint() const {
+    if (raw_ && type_ == Real && val_.text[0] != '-') {
+        // Целое больше int64_t хранится как Real, но в тексте остаётся точным
+        // An integer larger than int64_t is stored as Real, but stays exact in the text
+        auto [res, err, _] = ssType(val_.text).template to_int<uint64_t, true, 10, false>();
+        if (err == IntConvertResult::Success) {
+            return res;
+        }
+    }
+    if (auto val = number_int(); val && *val >= 0) {
+        return static_cast<uint64_t>(*val);
     }
     return {};
 }
 
+template<typename K>
+SIMJSON_API int64_t JsonValueTempl<K>::raw_integer() const {
+    auto [res, err, _] = ssType(val_.text).template to_int<int64_t, true, 10, false>();
+    return res;
+}
+
+template<typename K>
+SIMJSON_API double JsonValueTempl<K>::raw_real() const {
+    return ssType(val_.text).template to_double<false, false>().value_or(std::nan("0"));
+}
+
 template<typename K>
 SIMJSON_API typename JsonValueTempl<K>::strType JsonValueTempl<K>::to_text() const {
     switch (type_) {
@@ -341,9 +470,9 @@ SIMJSON_API typename JsonValueTempl<K>::strType JsonValueTempl<K>::to_text() con
     case Array:
     {
         std::vector<strType> res;
-        res.reserve(as_array()->size());
-        for (const auto& e: *as_array())
-            res.emplace_back(e.to_text());
+        res.reserve(size());
+        for (size_t i = 0, count = size(); i < count; i++)
+            res.emplace_back(value_at(i).to_text());
         if constexpr(std::is_same_v<K, u8s>) {
             return e_join(res, ",");
         }
@@ -360,9 +489,9 @@ SIMJSON_API typename JsonValueTempl<K>::strType JsonValueTempl<K>::to_text() con
     case Text:
         return as_text();
     case Integer:
-        return e_num<K>(val_.integer);
+        return e_num<K>(int_value());
     case Real:
-        return e_num<K>(val_.real);
+        return e_num<K>(real_value());
     default:
         return {};
     }
@@ -382,20 +511,25 @@ SIMJSON_API void JsonValueTempl<K>::merge(const json_value& other, bool replace,
             }
         }
     } else if (is_array() && other.is_array()) {
+        // Меняем только этот массив, упакованный другой читаем по значению
+        // Only this array is modified, a packed other one is read by value
+        size_t count = other.size();
         if (append_arrays) {
-            if (other.as_array()->size()) {
+            if (count) {
+                unpack();
                 auto& arr = *as_array();
-                arr.reserve(arr.size() + other.as_array()->size());
-                for (const auto& e : *other.as_array()) {
-                    arr.emplace_back(e);
+                arr.reserve(arr.size() + count);
+                for (size_t i = 0; i < count; i++) {
+                    arr.emplace_back(other.value_at(i));
                 }
             }
         } else if (replace) {
+            unpack();
             auto& arr = *as_array();
             arr.clear();
-            arr.reserve(other.as_array()->size());
-            for (const auto& e : *other.as_array()) {
-                arr.emplace_back(e);
+            arr.reserve(count);
+            for (size_t i = 0; i < count; i++) {
+                arr.emplace_back(other.value_at(i));
             }
         }
     } else if (replace && !other.is_undefined()) {
@@ -403,148 +537,851 @@ SIMJSON_API void JsonValueTempl<K>::merge(const json_value& other, bool replace,
     }
 }
 
-template<typename K>
+// Подсчёт точной длины сериализованного json, без упорядочивания ключей - на длину оно не влияет.
+// Без exact длина только оценивается: строки не экранируются и не перекодируются, дробные числа не форматируются.
+// Counting the exact length of serialized json, without ordering keys - it does not affect the length.
+// Without exact the length is only estimated: strings are not escaped or transcoded, reals are not formatted.
+template<typename K, typename O = K>
+struct json_measure {
+    bool prettify;
+    unsigned indent_count;
+    bool exact = true;
+    // Самая длинная запись double, "-2.2250738585072014e-308"
+    // The longest double notation, "-2.2250738585072014e-308"
+    static constexpr size_t max_real_length = 24;
+
+    static decltype(auto) out(simple_str<K> text) {
+        if constexpr (std::is_same_v<K, O>) {
+            return text;
+        } else {
+            return lstring<O, 128>{text};
+        }
+    }
+
+    static size_t intLength(int64_t v) {
+        uint64_t u = v < 0 ? 0 - uint64_t(v) : uint64_t(v);
+        size_t len = v < 0 ? 2 : 1;
+        for (; u >= 10; u /= 10) {
+            len++;
+        }
+        return len;
+    }
+
+    size_t textLength(simple_str<K> text) const {
+        return exact ? expr_json_str<O>{ out(text) }.length() : text.length();
+    }
+
+    size_t measure(const JsonValueTempl<K>& json, unsigned indent) const {
+        size_t size = 0, count = 0;
+        switch (json.type()) {
+        case Json::Undefined:
+            return 0;
+        case Json::Null:
+            return 4;
+        case Json::Boolean:
+            return json.as_boolean() ? 4 : 5;
+        case Json::Integer:
+            if (auto raw = json.raw_number()) {
+                // Число в исходном виде состоит из ASCII, его длина не зависит от кодировки
+                // A raw number consists of ASCII, its length does not depend on the encoding
+                return raw->length();
+            }
+            return intLength(json.as_integer());
+        case Json::Real:
+            if (auto raw = json.raw_number()) {
+                return raw->length();
+            } else if (!exact) {
+                return max_real_length;
+            } else if constexpr (std::is_same_v<K, O>) {
+                return json.to_text().length();
+            } else {
+                return e_num<O>(json.as_real()).length();
+            }
+        case Json::Text:
+            return 2 + textLength(json.as_text());
+        case Json::Object:
+            for (const auto& it : *json.as_object()) {
+                if (it.second.type() != Json::Undefined) {
+                    // "key": или "key":value
+                    // "key": or "key":value
+                    size += 3 + textLength(it.first.to_str()) + measure(it.second, indent + indent_count);
+                    count++;
+                }
+            }
+            break;
+        case Json::Array:
+            if (json.is_packed()) {
+                count = json.size();
+                for (int64_t v : json.template as_span<int64_t>()) {
+                    size += intLength(v);
+                }
+                if (exact) {
+                    for (double v : json.template as_span<double>()) {
+                        size += e_num<O>(v).length();
+                    }
+                } else {
+                    size += json.template as_span<double>().size() * max_real_length;
+                }
+                for (uint8_t v : json.template as_span<uint8_t>()) {
+                    size += v ? 4 : 5;
+                }
+                break;
+            }
+            for (const auto& it : *json.as_array()) {
+                size += measure(it, indent + indent_count);
+                count++;
+            }
+            break;
+        }
+        // Скобки, запятые между элементами, при "украшении" переносы строк с отступами
+        // Brackets, commas between elements, with prettify line breaks with indents
+        size += 2;
+        if (count) {
+            size += count - 1;
+            if (prettify) {
+                size += count * (1 + indent) + 1 + indent - indent_count;
+                if (json.type() == Json::Object) {
+                    size += count;
+                }
+            }
+        }
+        return size;
+    }
+};
+
+// O - тип символов результата, может отличаться от типа символов json.
+// Сначала длина результата оценивается без форматирования строк и чисел, буфер увеличивается один раз,
+// дальше запись идёт по указателю с проверкой места. Если оценки не хватило (экранирование, перекодирование),
+// буфер растёт, лишнее в конце отрезается.
+// O - symbol type of the result, may differ from the json symbol type.
+// First the length of the result is estimated without formatting strings and numbers, the buffer grows once,
+// then writing goes by pointer with a room check. If the estimate was short (escaping, transcoding),
+// the buffer grows, the excess at the end is cut off.
+template<typename K, typename O = K>
 struct json_store {
-    lstring<K, 0, true>& buffer;
+    lstring<O, 0, true>& buffer;
     bool prettify;
     bool order_keys;
-    K indent_symb;
+    O indent_symb;
     unsigned indent_count;
+    // Общий для всех объектов буфер для упорядочивания ключей, вложенные объекты используют его хвост
+    // A buffer for ordering keys shared by all objects, nested objects use its tail
+    std::vector<const typename JsonValueTempl<K>::obj_type::value_type*> ordered{};
+    // Буфер результата целиком и позиция записи в нём
+    // The whole result buffer and the write position in it
+    O* begin{};
+    O* ptr{};
+    O* end{};
+    // Текущая вложенность, для статистики
+    // Current nesting, for statistics
+    size_t depth{};
+
+    static decltype(auto) out(simple_str<K> text) {
+        return json_measure<K, O>::out(text);
+    }
+
+    void room(size_t count) {
+        if (size_t(end - ptr) < count) {
+            size_t pos = ptr - begin, size = buffer.length();
+            begin = buffer.set_size(std::max(pos + count, size + size / 2));
+            ptr = begin + pos;
+            end = begin + buffer.length();
+        }
+    }
+
+    template<typename E>
+    void put(const E& expr) {
+        room(expr.length());
+        ptr = expr.place(ptr);
+    }
+
+    void put(simple_str<O> text) {
+        room(text.length());
+        std::char_traits<O>::copy(ptr, text.symbols(), text.length());
+        ptr += text.length();
+    }
+
+    template<size_t N>
+    void put(const O(&text)[N]) {
+        room(N - 1);
+        ptr = std::copy(text, text + N - 1, ptr);
+    }
+
+    void run(const JsonValueTempl<K>& json) {
+        size_t size;
+        {
+            phase_timer timer{stats().cycles_measure};
+            size = json_measure<K, O>{prettify, indent_count, false}.measure(json, indent_count);
+        }
+        size_t start = buffer.length();
+        begin = buffer.set_size(start + size);
+        ptr = begin + start;
+        end = ptr + size;
+        {
+            phase_timer timer{stats().cycles_write};
+            store(json, indent_count);
+        }
+        size = ptr - begin - start;
+        buffer.set_size(start + size);
+        if constexpr (SIMJSON_STATS != 0) {
+            stats().calls++;
+            stats().bytes += size * sizeof(O);
+        }
+    }
+
+    static JsonStoreStats& stats() {
+        return JsonStoreStats::thread_total();
+    }
+
+    void countText(const expr_json_str<O>& text) {
+        if constexpr (SIMJSON_STATS != 0) {
+            if (text.length() != text.text.length()) {
+                stats().escaped_strings++;
+            }
+        }
+    }
+
+    // Упакованный массив выводим одним циклом по его значениям, без разбора типа каждого элемента
+    // A packed array is output in one loop over its values, without checking the type of each element
+    template<typename T>
+    void storePacked(std::span<const T> values, unsigned indent) {
+        if constexpr (SIMJSON_STATS != 0) {
+            stats().values[std::is_same_v<T, int64_t> ? Json::Integer : std::is_same_v<T, double> ? Json::Real : Json::Boolean] += values.size();
+        }
+        bool printed = false;
+        for (T v : values) {
+            put(e_if(printed, e_c(1, O(','))) + e_if(prettify, uni_string(O, "\n") + e_c(indent, indent_symb)));
+            if constexpr (std::is_same_v<T, uint8_t>) {
+                if (v) {
+                    put(uni_string(O, "true"));
+                } else {
+                    put(uni_string(O, "false"));
+                }
+            } else {
+                put(e_num<O>(v));
+            }
+            printed = true;
+        }
+    }
 
     void store(const JsonValueTempl<K>& json, unsigned indent) {
         bool printed = false;
+        if constexpr (SIMJSON_STATS != 0) {
+            if (!json.is_packed()) {
+                stats().values[json.type()]++;
+            }
+            if (json.type() == Json::Object || json.type() == Json::Array) {
+                depth++;
+                stats().max_depth = std::max(stats().max_depth, depth);
+            }
+        }
         switch (json.type()) {
         case Json::Undefined:
             break;
         case Json::Null:
-            buffer += uni_string(K, "null");
+            put(uni_string(O, "null"));
             break;
         case Json::Boolean:
             if (json.as_boolean())
-                buffer += uni_string(K, "true");
+                put(uni_string(O, "true"));
             else
-                buffer += uni_string(K, "false");
+                put(uni_string(O, "false"));
             break;
         case Json::Integer:
-            buffer += e_num<K>(json.as_integer());
+            if (auto raw = json.raw_number()) {
+                put(simple_str<O>(out(*raw)));
+            } else {
+                put(e_num<O>(json.as_integer()));
+            }
             break;
         case Json::Real:
-            buffer += json.to_text();
+            if (auto raw = json.raw_number()) {
+                put(simple_str<O>(out(*raw)));
+            } else if constexpr (std::is_same_v<K, O>) {
+                put(simple_str<O>(json.to_text()));
+            } else {
+                put(e_num<O>(json.as_real()));
+            }
             break;
-        case Json::Text:
-            buffer += uni_string(K, "\"") + expr_json_str<K>{ json.as_text() } + uni_string(K, "\"");
+        case Json::Text: {
+            decltype(auto) source = out(json.as_text());
+            expr_json_str<O> text{ source };
+            countText(text);
+            put(uni_string(O, "\"") + text + uni_string(O, "\""));
             break;
+        }
         case Json::Object:
-            buffer += uni_string(K, "{");
+            put(uni_string(O, "{"));
             if (order_keys && json.as_object()->size() > 1) {
-                std::vector<typename JsonValueTempl<K>::obj_type::iterator> keys;
-                keys.reserve(json.as_object()->size());
-                for (auto it = json.as_object()->begin(), e = json.as_object()->end(); it != e; ++it) {
-                    keys.emplace_back(it);
+                size_t base = ordered.size();
+                for (const auto& it : *json.as_object()) {
+                    ordered.emplace_back(&it);
                 }
-                std::sort(keys.begin(), keys.end(), [](const auto& s1, const auto& s2) {
+                std::sort(ordered.begin() + base, ordered.end(), [](const auto& s1, const auto& s2) {
                     return s1->first.str < s2->first.str;
                 });
-                for (const auto& it : keys) {
+                for (size_t i = base, e = ordered.size(); i < e; i++) {
+                    const auto* it = ordered[i];
                     if (it->second.type() != Json::Undefined) {
-                        buffer +=
-                            e_c(printed ? 1 : 0, K(',')) +
-                            e_if(prettify, uni_string(K, "\n") + e_c(indent, indent_symb)) +
-                            uni_string(K, "\"") +
-                            expr_json_str<K>{ it->first.to_str() } +
-                            e_choice(prettify, uni_string(K, "\": "), uni_string(K, "\":"));
+                        decltype(auto) name = out(it->first.to_str());
+                        expr_json_str<O> key{ name };
+                        countText(key);
+                        put(
+                            e_c(printed ? 1 : 0, O(',')) +
+                            e_if(prettify, uni_string(O, "\n") + e_c(indent, indent_symb)) +
+                            uni_string(O, "\"") +
+                            key +
+                            e_choice(prettify, uni_string(O, "\": "), uni_string(O, "\":")));
                         printed = true;
                         store(it->second, indent + indent_count);
                     }
                 }
+                ordered.resize(base);
             } else {
                 for (const auto& it : *json.as_object()) {
                     if (it.second.type() != Json::Undefined) {
-                        buffer +=
-                            e_c(printed ? 1 : 0, K(',')) +
-                            e_if(prettify, uni_string(K, "\n") + e_c(indent, indent_symb)) +
-                            uni_string(K, "\"") +
-                            expr_json_str<K>{ it.first.to_str() } +
-                            e_choice(prettify, uni_string(K, "\": "), uni_string(K, "\":"));
+                        decltype(auto) name = out(it.first.to_str());
+                        expr_json_str<O> key{ name };
+                        countText(key);
+                        put(
+                            e_c(printed ? 1 : 0, O(',')) +
+                            e_if(prettify, uni_string(O, "\n") + e_c(indent, indent_symb)) +
+                            uni_string(O, "\"") +
+                            key +
+                            e_choice(prettify, uni_string(O, "\": "), uni_string(O, "\":")));
                         printed = true;
                         store(it.second, indent + indent_count);
                     }
                 }
             }
             if (prettify && printed) {
-                buffer += uni_string(K, "\n") + e_c(indent - indent_count, indent_symb);
+                put(uni_string(O, "\n") + e_c(indent - indent_count, indent_symb));
             }
-            buffer += uni_string(K, "}");
+            put(uni_string(O, "}"));
             break;
         case Json::Array:
-            buffer += uni_string(K, "[");
-            for (const auto& it : *json.as_array()) {
-                buffer += e_if(printed, e_c(1, K(','))) + e_if(prettify, uni_string(K, "\n") + e_c(indent, indent_symb));
-                store(it, indent + indent_count);
+            put(uni_string(O, "["));
+            if (json.is_packed()) {
+                storePacked(json.template as_span<int64_t>(), indent);
+                storePacked(json.template as_span<double>(), indent);
+                storePacked(json.template as_span<uint8_t>(), indent);
                 printed = true;
+            } else {
+                for (const auto& it : *json.as_array()) {
+                    put(e_if(printed, e_c(1, O(','))) + e_if(prettify, uni_string(O, "\n") + e_c(indent, indent_symb)));
+                    store(it, indent + indent_count);
+                    printed = true;
+                }
             }
             if (prettify && printed) {
-                buffer += uni_string(K, "\n") + e_c(indent - indent_count, indent_symb);
+                put(uni_string(O, "\n") + e_c(indent - indent_count, indent_symb));
             }
-            buffer += uni_string(K, "]");
+            put(uni_string(O, "]"));
             break;
         }
+        if constexpr (SIMJSON_STATS != 0) {
+            if (json.type() == Json::Object || json.type() == Json::Array) {
+                depth--;
+            }
+        }
     }
 };
 
+// Последовательное чтение строки кодовыми единицами UTF-16, для упорядочивания ключей по RFC 8785
+// Sequential reading of a string by UTF-16 code units, for ordering keys according to RFC 8785
 template<typename K>
-SIMJSON_API void JsonValueTempl<K>::store(lstring<K, 0, true>& stream, bool prettify, bool order_keys, K indent_symbol, unsigned indent_count) const {
-    json_store<K>{stream, prettify, order_keys, indent_symbol, indent_count}.store(*this, indent_count);
-}
+struct utf16_reader {
+    const K* ptr;
+    const K* end;
+    u16s low{};
 
-enum States {
-    WaitValue,
-    Done,
-    WaitKey,
-    WaitColon,
-    WaitComma,
-    ProcessT,
-    ProcessTr,
-    ProcessTru,
-    ProcessF,
-    ProcessFa,
-    ProcessFal,
-    ProcessFals,
-    ProcessN,
-    ProcessNu,
-    ProcessNul,
-    ProcessString,
-    ProcessStringSlash,
-    ProcessStringSlashU,
-    ProcessStringSlashU1,
-    ProcessStringSlashU2,
-    ProcessStringSlashU3,
-    ProcessStringSlashU4,
-    ProcessStringSlashU4Slash,
-    ProcessStringSlashU4SlashU,
-    ProcessStringSlashU4SlashU1,
-    ProcessStringSlashU4SlashU2,
-    ProcessStringSlashU4SlashU3,
-    ProcessNumber,
-    ProcessNumberSign,
-    ProcessNumberZero,
-    ProcessNumberDot,
-    ProcessNumberDotNumber,
-    ProcessNumberDotNumberExp,
-    ProcessNumberDotNumberExpSign,
-    ProcessNumberDotNumberExpSignNumber,
+    bool next(u16s& unit) {
+        if (low) {
+            unit = low;
+            low = 0;
+            return true;
+        }
+        if (ptr == end) {
+            return false;
+        }
+        char32_t cp;
+        if constexpr (sizeof(K) == 2) {
+            unit = u16s(*ptr++);
+            return true;
+        } else if constexpr (sizeof(K) == 4) {
+            cp = char32_t(*ptr++);
+        } else {
+            unsigned s = (unsigned char)*ptr++;
+            unsigned count = s < 0xE0 ? 1 : s < 0xF0 ? 2 : 3;
+            cp = s < 0x80 ? s : s & (0x3F >> count);
+            if (s >= 0x80) {
+                for (; count && ptr < end; count--) {
+                    cp = (cp << 6) | ((unsigned char)*ptr++ & 0x3F);
+                }
+            }
+        }
+        if (cp >= 0x10000) {
+            cp -= 0x10000;
+            unit = u16s(0xD800 + (cp >> 10));
+            low = u16s(0xDC00 + (cp & 0x3FF));
+        } else {
+            unit = u16s(cp);
+        }
+        return true;
+    }
 };
 
-enum StartSymbols {
-    ErrorSymbol,
-    Object,
-    Array,
-    True,
-    False,
-    Null,
-    String,
-    Number,
-    Zero,
+template<typename K>
+struct json_store_canonical {
+    using item_type = typename JsonValueTempl<K>::obj_type::value_type;
+
+    lstring<u8s, 0, true>& buffer;
+    // Ключ сортировки - первые 4 кодовые единицы UTF-16, при равенстве сравниваем целиком.
+    // Буфер общий для всех объектов, вложенные объекты используют его хвост.
+    // The sort key is the first 4 UTF-16 code units, if they are equal, compare entirely.
+    // The buffer is shared by all objects, nested objects use its tail.
+    std::vector<std::pair<uint64_t, const item_type*>> ordered{};
+
+    static uint64_t prefix(simple_str<K> key) {
+        utf16_reader<K> reader{key.begin(), key.end()};
+        uint64_t res = 0;
+        for (unsigned i = 0; i < 4; i++) {
+            u16s unit = 0;
+            reader.next(unit);
+            res = (res << 16) | unit;
+        }
+        return res;
+    }
+
+    static bool less(simple_str<K> k1, simple_str<K> k2) {
+        utf16_reader<K> r1{k1.begin(), k1.end()}, r2{k2.begin(), k2.end()};
+        for (;;) {
+            u16s u1, u2;
+            bool has1 = r1.next(u1), has2 = r2.next(u2);
+            if (!has1 || !has2) {
+                return !has1 && has2;
+            }
+            if (u1 != u2) {
+                return u1 < u2;
+            }
+        }
+    }
+
+    void text(simple_str<K> text) {
+        if constexpr (std::is_same_v<K, u8s>) {
+            buffer += uni_string(u8s, "\"") + expr_json_str<u8s, true>{ text } + uni_string(u8s, "\"");
+        } else {
+            lstring<u8s, 128> utf8{text};
+            buffer += uni_string(u8s, "\"") + expr_json_str<u8s, true>{ utf8 } + uni_string(u8s, "\"");
+        }
+    }
+
+    // Number.prototype.toString из ECMAScript
+    // Number.prototype.toString from ECMAScript
+    void number(double value) {
+        if (!std::isfinite(value)) {
+            buffer += uni_string(u8s, "null");
+            return;
+        }
+        if (value == 0) {
+            // В том числе -0
+            // Including -0
+            buffer += uni_string(u8s, "0");
+            return;
+        }
+        // Кратчайшие цифры, однозначно задающие число: [-]d[.ddd]e(+|-)dd
+        // The shortest digits that uniquely identify the number: [-]d[.ddd]e(+|-)dd
+        char sci[32];
+        char* sciEnd = std::to_chars(sci, sci + sizeof(sci), value, std::chars_format::scientific).ptr;
+        char digits[20];
+        int k = 0, exp = 0;
+        const char* p = sci;
+        bool negative = *p == '-';
+        if (negative) {
+            p++;
+        }
+        for (; p < sciEnd && *p != 'e'; p++) {
+            if (*p != '.') {
+                digits[k++] = *p;
+            }
+        }
+        std::from_chars(p + 1 + (p[1] == '+'), sciEnd, exp);
+        int n = exp + 1;
+
+        char res[40];
+        char* r = res;
+        if (negative) {
+            *r++ = '-';
+        }
+        if (k <= n && n <= 21) {
+            r = std::copy(digits, digits + k, r);
+            r = std::fill_n(r, n - k, '0');
+        } else if (0 < n && n <= 21) {
+            r = std::copy(digits, digits + n, r);
+            *r++ = '.';
+            r = std::copy(digits + n, digits + k, r);
+        } else if (-6 < n && n <= 0) {
+            *r++ = '0';
+            *r++ = '.';
+            r = std::fill_n(r, -n, '0');
+            r = std::copy(digits, digits + k, r);
+        } else {
+            *r++ = digits[0];
+            if (k > 1) {
+                *r++ = '.';
+                r = std::copy(digits + 1, digits + k, r);
+            }
+            *r++ = 'e';
+            *r++ = n - 1 < 0 ? '-' : '+';
+            r = std::to_chars(r, res + sizeof(res), n - 1 < 0 ? 1 - n : n - 1).ptr;
+        }
+        buffer += ssa{res, size_t(r - res)};
+    }
+
+    void store(const JsonValueTempl<K>& json) {
+        switch (json.type()) {
+        case Json::Undefined:
+            break;
+        case Json::Null:
+            buffer += uni_string(u8s, "null");
+            break;
+        case Json::Boolean:
+            buffer += e_choice(json.as_boolean(), uni_string(u8s, "true"), uni_string(u8s, "false"));
+            break;
+        case Json::Integer: {
+            // Числа в JCS - это double, целые до 2^53 выводятся точно
+            // Numbers in JCS are doubles, integers up to 2^53 are output exactly
+            int64_t value = json.as_integer();
+            if (value <= (int64_t(1) << 53) && value >= -(int64_t(1) << 53)) {
+                buffer += e_num<u8s>(value);
+            } else {
+                number(double(value));
+            }
+            break;
+        }
+        case Json::Real:
+            number(json.as_real());
+            break;
+        case Json::Text:
+            text(json.as_text());
+            break;
+        case Json::Object: {
+            buffer += uni_string(u8s, "{");
+            size_t base = ordered.size();
+            for (const auto& it : *json.as_object()) {
+                if (it.second.type() != Json::Undefined) {
+                    ordered.emplace_back(prefix(it.first.str), &it);
+                }
+            }
+            std::sort(ordered.begin() + base, ordered.end(), [](const auto& s1, const auto& s2) {
+                if (s1.first != s2.first) {
+                    return s1.first < s2.first;
+                }
+                return less(s1.second->first.str, s2.second->first.str);
+            });
+            for (size_t i = base, e = ordered.size(); i < e; i++) {
+                const item_type* it = ordered[i].second;
+                if (i > base) {
+                    buffer += uni_string(u8s, ",");
+                }
+                text(it->first.str);
+                buffer += uni_string(u8s, ":");
+                store(it->second);
+            }
+            ordered.resize(base);
+            buffer += uni_string(u8s, "}");
+            break;
+        }
+        case Json::Array: {
+            buffer += uni_string(u8s, "[");
+            bool printed = false;
+            if (json.is_packed()) {
+                // Без построения обычного массива
+                // Without building a usual array
+                for (size_t i = 0, e = json.size(); i < e; i++) {
+                    if (i) {
+                        buffer += uni_string(u8s, ",");
+                    }
+                    if (auto ints = json.template as_span<int64_t>(); !ints.empty()) {
+                        store(JsonValueTempl<K>(ints[i]));
+                    } else if (auto reals = json.template as_span<double>(); !reals.empty()) {
+                        store(JsonValueTempl<K>(reals[i]));
+                    } else {
+                        store(JsonValueTempl<K>(json.template as_span<uint8_t>()[i] != 0));
+                    }
+                }
+                buffer += uni_string(u8s, "]");
+                break;
+            }
+            for (const auto& it : *json.as_array()) {
+                if (printed) {
+                    buffer += uni_string(u8s, ",");
+                }
+                if (it.is_undefined()) {
+                    buffer += uni_string(u8s, "null");
+                } else {
+                    store(it);
+                }
+                printed = true;
+            }
+            buffer += uni_string(u8s, "]");
+            break;
+        }
+        }
+    }
+};
+
+template<typename K>
+SIMJSON_API void JsonValueTempl<K>::store_canonical(lstring<u8s, 0, true>& stream) const {
+    json_store_canonical<K>{stream}.store(*this);
+}
+
+template<typename K>
+SIMJSON_API void JsonValueTempl<K>::store(lstring<K, 0, true>& stream, bool prettify, bool order_keys, K indent_symbol, unsigned indent_count) const {
+    json_store<K>{stream, prettify, order_keys, indent_symbol, indent_count}.run(*this);
+}
+
+template<typename K>
+SIMJSON_API size_t JsonValueTempl<K>::store_length(bool prettify, unsigned indent_count) const {
+    return json_measure<K>{prettify, indent_count}.measure(*this, indent_count);
+}
+
+template<typename K>
+SIMJSON_API void JsonValueTempl<K>::store_utf8(lstring<u8s, 0, true>& stream, bool prettify, bool order_keys, u8s indent_symbol, unsigned indent_count) const {
+    json_store<K, u8s>{stream, prettify, order_keys, indent_symbol, indent_count}.run(*this);
+}
+
+// Память строки simstr: короткие строки лежат в самом объекте sstring, длинные - в буфере со счётчиком ссылок и длиной
+// Memory of a simstr string: short strings lie in the sstring object itself, long ones - in a buffer with a reference counter and length
+template<typename K>
+static size_t textMemory(size_t length) {
+    if ((length + 1) * sizeof(K) < sizeof(sstring<K>)) {
+        return 0;
+    }
+    return 2 * sizeof(size_t) + (length + 1) * sizeof(K);
+}
+
+// Управляющий блок make_shared: указатель на таблицу виртуальных функций и два счётчика
+// The make_shared control block: a pointer to the virtual function table and two counters
+static constexpr size_t controlBlockMemory = sizeof(void*) + 2 * sizeof(int);
+
+template<typename K>
+void JsonValueTempl<K>::countMemory(JsonMemoryUsage& usage, std::unordered_set<const void*>& seen, bool shared) const {
+    auto add = [&](size_t& field, size_t bytes) {
+        field += bytes;
+        if (shared) {
+            usage.shared += bytes;
+        }
+    };
+    // Буфер строки может делиться между значениями (копии, слияние в compact), считаем его один раз
+    // A string buffer may be shared between values (copies, merging in compact), count it once
+    auto addText = [&](size_t& field, simple_str<K> text) {
+        if (size_t bytes = textMemory<K>(text.length()); bytes && seen.insert(text.symbols()).second) {
+            add(field, bytes);
+        }
+    };
+    auto countArray = [&](const json_array& array) {
+        shared = shared || array.use_count() > 1;
+        add(usage.containers, sizeof(arr_type) + controlBlockMemory + array->size() * sizeof(JsonValueTempl));
+        add(usage.slack, (array->capacity() - array->size()) * sizeof(JsonValueTempl));
+        for (const auto& value : *array) {
+            value.countMemory(usage, seen, shared);
+        }
+    };
+    // Объект или массив, доступный по нескольким путям, считаем один раз
+    // An object or array reachable by several paths is counted once
+    const void* container = packed_ ? static_cast<const void*>(val_.packed.get())
+        : type_ == Object ? static_cast<const void*>(val_.object.get())
+        : type_ == Array ? static_cast<const void*>(val_.array.get()) : nullptr;
+    if (container && !seen.insert(container).second) {
+        return;
+    }
+    if (packed_) {
+        const packed_type& packed = *val_.packed;
+        shared = shared || val_.packed.use_count() > 1;
+        add(usage.containers, sizeof(packed_type) + controlBlockMemory +
+            packed.integers.size() * sizeof(int64_t) + packed.reals.size() * sizeof(double) + packed.booleans.size());
+        add(usage.slack, (packed.integers.capacity() - packed.integers.size()) * sizeof(int64_t) +
+            (packed.reals.capacity() - packed.reals.size()) * sizeof(double) + packed.booleans.capacity() - packed.booleans.size());
+        if (packed.items) {
+            add(usage.containers, sizeof(arr_type) + controlBlockMemory + packed.items->size() * sizeof(JsonValueTempl));
+            add(usage.slack, (packed.items->capacity() - packed.items->size()) * sizeof(JsonValueTempl));
+        }
+        return;
+    }
+    if (raw_) {
+        addText(usage.strings, val_.text);
+        return;
+    }
+    switch (type_) {
+    case Text:
+        addText(usage.strings, val_.text);
+        break;
+    case Object: {
+        const obj_type& object = *val_.object;
+        // use_count больше 1 - объект виден и из других значений
+        // use_count greater than 1 - the object is visible from other values too
+        shared = shared || val_.object.use_count() > 1;
+        // Узел: пара ключ-значение, указатель на следующий узел и хэш
+        // Node: key-value pair, pointer to the next node and hash
+        add(usage.containers, sizeof(obj_type) + controlBlockMemory + object.bucket_count() * sizeof(void*) +
+            object.size() * (sizeof(typename obj_type::value_type) + 2 * sizeof(void*)));
+        for (const auto& [key, value] : object) {
+            addText(usage.keys, key.to_str());
+            value.countMemory(usage, seen, shared);
+        }
+        break;
+    }
+    case Array:
+        countArray(val_.array);
+        break;
+    default:
+        break;
+    }
+}
+
+template<typename K>
+SIMJSON_API JsonMemoryUsage JsonValueTempl<K>::memory_usage() const {
+    JsonMemoryUsage usage;
+    std::unordered_set<const void*> seen;
+    countMemory(usage, seen, false);
+    return usage;
+}
+
+template<typename K>
+void JsonValueTempl<K>::compactTree(hashStrMap<K, strType>& texts, size_t& released) {
+    auto shrink = [&](auto& vector) {
+        released += (vector.capacity() - vector.size()) * sizeof(vector[0]);
+        vector.shrink_to_fit();
+    };
+    if (packed_) {
+        shrink(val_.packed->integers);
+        shrink(val_.packed->reals);
+        shrink(val_.packed->booleans);
+        return;
+    }
+    switch (raw_ ? Text : type_) {
+    case Text:
+        // Короткие строки и так лежат в самом значении
+        // Short strings lie in the value itself anyway
+        if (size_t bytes = textMemory<K>(val_.text.length())) {
+            auto [it, inserted] = texts.try_emplace(ssType(val_.text), val_.text);
+            if (!inserted && it->second.symbols() != val_.text.symbols()) {
+                val_.text = it->second;
+                released += bytes;
+            }
+        }
+        break;
+    case Object: {
+        obj_type& object = *val_.object;
+        size_t buckets = object.bucket_count();
+        object.rehash(0);
+        if (object.bucket_count() < buckets) {
+            released += (buckets - object.bucket_count()) * sizeof(void*);
+        }
+        for (auto& [key, value] : object) {
+            value.compactTree(texts, released);
+        }
+        break;
+    }
+    case Array:
+        shrink(*val_.array);
+        for (auto& value : *val_.array) {
+            value.compactTree(texts, released);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+template<typename K>
+SIMJSON_API size_t JsonValueTempl<K>::compact() {
+    hashStrMap<K, strType> texts;
+    size_t released = 0;
+    compactTree(texts, released);
+    return released;
+}
+
+enum States {
+    WaitValue,
+    Done,
+    WaitKey,
+    WaitColon,
+    WaitComma,
+    ProcessT,
+    ProcessTr,
+    ProcessTru,
+    ProcessF,
+    ProcessFa,
+    ProcessFal,
+    ProcessFals,
+    ProcessN,
+    ProcessNu,
+    ProcessNul,
+    ProcessString,
+    ProcessStringSlash,
+    ProcessStringSlashU,
+    ProcessStringSlashU1,
+    ProcessStringSlashU2,
+    ProcessStringSlashU3,
+    ProcessStringSlashU4,
+    ProcessStringSlashU4Slash,
+    ProcessStringSlashU4SlashU,
+    ProcessStringSlashU4SlashU1,
+    ProcessStringSlashU4SlashU2,
+    ProcessStringSlashU4SlashU3,
+    ProcessNumber,
+    ProcessNumberSign,
+    ProcessNumberZero,
+    ProcessNumberDot,
+    ProcessNumberDotNumber,
+    ProcessNumberDotNumberExp,
+    ProcessNumberDotNumberExpSign,
+    ProcessNumberDotNumberExpSignNumber,
+    SkipValue,
+    SkipScalar,
+    SkipString,
+    SkipStringSlash,
+    SkipCompound,
+    LimitReached,
+};
+
+// Что ожидается внутри пропускаемого объекта или массива
+// What is expected inside a skipped object or array
+enum SkipExpect {
+    SkipFirstValue,
+    SkipFirstKey,
+    SkipWantValue,
+    SkipWantKey,
+    SkipWantColon,
+    SkipWantComma,
+    SkipInScalar,
+};
+
+// Символы, из которых состоят числа, true, false и null
+// Symbols that numbers, true, false and null consist of
+template<typename I>
+static bool isScalarSymbol(I symbol) {
+    switch (symbol) {
+    case '+': case '-': case '.':
+    case 'E': case 'e': case 't': case 'r': case 'u': case 'f': case 'a': case 'l': case 's': case 'n':
+        return true;
+    default:
+        return symbol >= '0' && symbol <= '9';
+    }
+}
+
+enum StartSymbols {
+    ErrorSymbol,
+    Object,
+    Array,
+    True,
+    False,
+    Null,
+    String,
+    Number,
+    Zero,
     NegateNumber
 };
 
@@ -576,15 +1413,22 @@ inline static const char START_SYMBOLS[] = {
     Object
 };
 
-template<typename K>
+template<typename K, typename I>
 template<bool All, bool Last>
-SIMJSON_API JsonParseResult StreamedJsonParser<K>::process(ssType chunk) {
+SIMJSON_API JsonParseResult StreamedJsonParser<K, I>::process(ssType chunk) {
+    if (state_ == LimitReached) {
+        return JsonParseResult::LimitExceeded;
+    }
     ptr_ = chunk.begin();
-    const K* end = chunk.end();
+    const I* end = chunk.end();
     JsonValueTempl<K>* current = stack_.empty() ? nullptr : stack_.back();
+    phase_timer timer{stats_, &JsonParseStats::cycles_total};
+#if SIMJSON_STATS != 0
+    stats_.bytes += chunk.length() * sizeof(I);
+#endif
 
     for (; ptr_ < end ; ptr_++) {
-        K symbol = *ptr_;
+        I symbol = *ptr_;
         if (symbol == '\n') {
             line_++;
             col_ = 0;
@@ -599,6 +1443,7 @@ SIMJSON_API JsonParseResult StreamedJsonParser<K>::process(ssType chunk) {
         case WaitColon:
         case WaitComma:
         case Done:
+        case SkipValue:
             if (isWhiteSpace(symbol)) {
                 continue;
             }
@@ -610,22 +1455,24 @@ SIMJSON_API JsonParseResult StreamedJsonParser<K>::process(ssType chunk) {
         }
         switch (state_) {
         case WaitValue:
-            if (std::make_unsigned_t<K>(symbol) > sizeof(START_SYMBOLS)) {
+            if (std::make_unsigned_t<I>(symbol) > sizeof(START_SYMBOLS)) {
                 return JsonParseResult::Error;
             }
             switch(START_SYMBOLS[(size_t)symbol]) {
             case ErrorSymbol:
-                if (symbol == ']' && current->is_array() && !current->as_array()->size()) {
+                // Из потокового массива элементы удаляются, поэтому для него смотрим, были ли элементы вообще
+                // Elements are removed from the streamed array, so for it check if there were any elements at all
+                if (symbol == ']' && current->is_array() && (current == streamArray_ ? !streamed_ : !current->as_array()->size())) {
                     state_ = WaitComma;
                     current = popStack();
                     break;
                 }
                 return JsonParseResult::Error;
             case Object:
-                current = addValue<true, WaitKey>(current, Json::emptyObject);
+                current = addValue<true, WaitKey>(current, Json::Object, resource_);
                 break;
             case Array:
-                current = addValue<true, WaitValue>(current, Json::emptyArray);
+                current = addValue<true, WaitValue>(current, Json::Array, resource_);
                 break;
             case True:
                 state_ = ProcessT;
@@ -667,7 +1514,8 @@ SIMJSON_API JsonParseResult StreamedJsonParser<K>::process(ssType chunk) {
             break;
         case WaitColon:
             if (symbol == ':') {
-                state_ = WaitValue;
+                state_ = skipNext_ ? SkipValue : WaitValue;
+                skipNext_ = false;
             } else {
                 return JsonParseResult::Error;
             }
@@ -752,19 +1600,62 @@ SIMJSON_API JsonParseResult StreamedJsonParser<K>::process(ssType chunk) {
             }
             break;
         case ProcessString:
+            if constexpr (sizeof(I) == 1) {
+                // Проверка идёт в том же проходе, байты ASCII вне последовательности сразу пропускаются.
+                // Состояние проверки сохраняется между порциями текста.
+                // The check runs in the same pass, ASCII bytes outside a sequence are skipped at once.
+                // The check state is kept between chunks of text.
+                if (limits_.validate_utf8 && (utf8Need_ || std::make_unsigned_t<I>(symbol) >= 0x80) &&
+                        !checkUtf8(std::make_unsigned_t<I>(symbol))) {
+                    return JsonParseResult::Error;
+                }
+            }
             if (symbol == '\"') {
                 // end of string, add to value
-                auto value = getText();
+                strType value;
+                {
+                    phase_timer timer{stats_, &JsonParseStats::cycles_strings};
+                    value = getText();
+                }
+                if (value.length() > limits_.max_string_length || overBytes(value.length() * sizeof(K))) {
+                    state_ = LimitReached;
+                    return JsonParseResult::LimitExceeded;
+                }
 
                 if (current->is_object()) {
+                    size_t node = projNodes_.back();
+                    if (projection_ && !projection_->all(node)) {
+                        node = projection_->find(node, value);
+                        if (node == JsonProjection<K>::npos) {
+                            // Ключа нет в проекции, его значение пропускаем
+                            // The key is not in the projection, skip its value
+                            skipNext_ = true;
+                            state_ = WaitColon;
+                            break;
+                        }
+                    }
                     // value is key name
+                    phase_timer insertTimer{stats_, &JsonParseStats::cycles_insert};
                     const auto& [newVal, not_exist] = current->as_object()->try_emplace(std::move(value));
                     if (!not_exist) {
                         // key already exist
                         return JsonParseResult::Error;
                     }
+                    // узел hashStrMap: пара ключ-значение, указатель на следующий узел и хэш
+                    // hashStrMap node: key-value pair, pointer to next node and hash
+                    if (overBytes(sizeof(*newVal) + 2 * sizeof(void*))) {
+                        state_ = LimitReached;
+                        return JsonParseResult::LimitExceeded;
+                    }
+                    if (streamHandler_ && pathMatched_ + 1 == stack_.size() && pathMatched_ < streamPath_.size() &&
+                            newVal->first.str == simple_str<K>(streamPath_[pathMatched_])) {
+                        pathMatched_++;
+                    }
                     current = &newVal->second;
                     stack_.push_back(current);
+                    if (projection_) {
+                        projNodes_.push_back(node);
+                    }
                     state_ = WaitColon;
                 } else {
                     current = addValue<false, WaitComma>(current, std::move(value));
@@ -772,49 +1663,52 @@ SIMJSON_API JsonParseResult StreamedJsonParser<K>::process(ssType chunk) {
             } else if (symbol == '\\') {
                 if (startProcess_) {
                     if (ptr_ - startProcess_ > 1) {
-                        text_ << typename JsonValueTempl<K>::ssType{startProcess_ + 1, size_t(ptr_ - startProcess_ - 1)};
+                        text_ << ssType{startProcess_ + 1, size_t(ptr_ - startProcess_ - 1)};
                     }
                     startProcess_ = nullptr;
                 }
                 state_ = ProcessStringSlash;
-            } else if (std::make_unsigned_t<K>(symbol) < ' ') {
+            } else if (std::make_unsigned_t<I>(symbol) < ' ') {
                 return JsonParseResult::Error;
             } else if (!startProcess_) {
                 text_ << symbol;
             }
             break;
         case ProcessStringSlash:
+#if SIMJSON_STATS != 0
+            stats_.escapes++;
+#endif
             switch(symbol) {
             case '\\':
-                text_ << K('\\');
+                text_ << I('\\');
                 state_ = ProcessString;
                 break;
             case '\"':
-                text_ << K('\"');
+                text_ << I('\"');
                 state_ = ProcessString;
                 break;
             case '/':
-                text_ << K('/');
+                text_ << I('/');
                 state_ = ProcessString;
                 break;
             case 'b':
-                text_ << K('\b');
+                text_ << I('\b');
                 state_ = ProcessString;
                 break;
             case 'f':
-                text_ << K('\f');
+                text_ << I('\f');
                 state_ = ProcessString;
                 break;
             case 'n':
-                text_ << K('\n');
+                text_ << I('\n');
                 state_ = ProcessString;
                 break;
             case 'r':
-                text_ << K('\r');
+                text_ << I('\r');
                 state_ = ProcessString;
                 break;
             case 't':
-                text_ << K('\t');
+                text_ << I('\t');
                 state_ = ProcessString;
                 break;
             case 'u':
@@ -848,14 +1742,14 @@ SIMJSON_API JsonParseResult StreamedJsonParser<K>::process(ssType chunk) {
             if (!processUnicode(symbol)) {
                 return JsonParseResult::Error;
             }
-            if constexpr (sizeof(K) == 2) {
-                text_ << (K)currentUnicode_[0];
+            if constexpr (sizeof(I) == 2) {
+                text_ << (I)currentUnicode_[0];
             } else {
                 if (currentUnicode_[0] >= 0xD800 && currentUnicode_[0] < 0xDC00) {
                     // surrogate pair
                     state_ = ProcessStringSlashU4;
                 } else {
-                    text_ << lstring<K, 10>{ssu{currentUnicode_, 1}};
+                    text_ << lstring<I, 10>{ssu{currentUnicode_, 1}};
                     state_ = ProcessString;
                 }
             }
@@ -898,9 +1792,121 @@ SIMJSON_API JsonParseResult StreamedJsonParser<K>::process(ssType chunk) {
             if (!processUnicode(symbol)) {
                 return JsonParseResult::Error;
             }
-            text_ << lstring<K, 10>{ssu{currentUnicode_, 2}};
+            text_ << lstring<I, 10>{ssu{currentUnicode_, 2}};
             state_ = ProcessString;
             break;
+        case SkipValue:
+            // Пропускаемое значение не разбирается, но проверяется его строение и алфавит простых значений
+            // The skipped value is not parsed, but its structure and the alphabet of scalars are checked
+            if (symbol == '{' || symbol == '[') {
+                skipStack_.assign(1, symbol == '{');
+                skipExpect_ = symbol == '{' ? SkipFirstKey : SkipFirstValue;
+                state_ = SkipCompound;
+                // Ограничение вложенности действует и на пропускаемые значения
+                // The nesting limit applies to skipped values too
+                if (stack_.size() + skipStack_.size() > limits_.max_depth) {
+                    state_ = LimitReached;
+                    return JsonParseResult::LimitExceeded;
+                }
+            } else if (symbol == '\"') {
+                skipStack_.clear();
+                state_ = SkipString;
+            } else if (isScalarSymbol(symbol)) {
+                state_ = SkipScalar;
+            } else {
+                return JsonParseResult::Error;
+            }
+            break;
+        case SkipScalar:
+            if (symbol == ',' || symbol == '}' || symbol == ']' || isWhiteSpace(symbol)) {
+                state_ = WaitComma;
+                goto processSymbol;
+            } else if (!isScalarSymbol(symbol)) {
+                return JsonParseResult::Error;
+            }
+            break;
+        case SkipString:
+            if (symbol == '\"') {
+                state_ = skipStack_.empty() ? WaitComma : SkipCompound;
+            } else if (symbol == '\\') {
+                state_ = SkipStringSlash;
+            } else {
+                // Внутри строки не бывает переводов строк, пропускаем сразу до кавычки или слеша
+                // There are no line breaks inside a string, skip right to a quote or slash
+                const I* p = ptr_ + 1;
+                while (p < end && *p != '\"' && *p != '\\') {
+                    p++;
+                }
+                col_ += unsigned(p - ptr_ - 1);
+                ptr_ = p - 1;
+            }
+            break;
+        case SkipStringSlash:
+            state_ = SkipString;
+            break;
+        case SkipCompound:
+            if (skipExpect_ == SkipInScalar) {
+                if (isScalarSymbol(symbol)) {
+                    break;
+                }
+                skipExpect_ = SkipWantComma;
+            }
+            if (isWhiteSpace(symbol)) {
+                break;
+            }
+            switch (symbol) {
+            case '\"':
+                if (skipExpect_ == SkipWantComma || skipExpect_ == SkipWantColon) {
+                    return JsonParseResult::Error;
+                }
+                // Строка в объекте на месте ключа - ключ, за ним ждём двоеточие
+                // A string in an object in place of a key is a key, a colon is expected after it
+                skipExpect_ = skipExpect_ == SkipFirstKey || skipExpect_ == SkipWantKey ? SkipWantColon : SkipWantComma;
+                state_ = SkipString;
+                break;
+            case '{':
+            case '[':
+                if (skipExpect_ != SkipFirstValue && skipExpect_ != SkipWantValue) {
+                    return JsonParseResult::Error;
+                }
+                skipStack_.push_back(symbol == '{');
+                skipExpect_ = symbol == '{' ? SkipFirstKey : SkipFirstValue;
+                if (stack_.size() + skipStack_.size() > limits_.max_depth) {
+                    state_ = LimitReached;
+                    return JsonParseResult::LimitExceeded;
+                }
+                break;
+            case '}':
+            case ']':
+                if (skipStack_.back() != (symbol == '}') ||
+                    (skipExpect_ != SkipWantComma && skipExpect_ != (symbol == '}' ? SkipFirstKey : SkipFirstValue))) {
+                    return JsonParseResult::Error;
+                }
+                skipStack_.pop_back();
+                skipExpect_ = SkipWantComma;
+                if (skipStack_.empty()) {
+                    state_ = WaitComma;
+                }
+                break;
+            case ':':
+                if (skipExpect_ != SkipWantColon) {
+                    return JsonParseResult::Error;
+                }
+                skipExpect_ = SkipWantValue;
+                break;
+            case ',':
+                if (skipExpect_ != SkipWantComma) {
+                    return JsonParseResult::Error;
+                }
+                skipExpect_ = skipStack_.back() ? SkipWantKey : SkipWantValue;
+                break;
+            default:
+                if ((skipExpect_ != SkipFirstValue && skipExpect_ != SkipWantValue) || !isScalarSymbol(symbol)) {
+                    return JsonParseResult::Error;
+                }
+                skipExpect_ = SkipInScalar;
+            }
+            break;
         case ProcessNumber:
             if (symbol == '.') {
                 state_ = ProcessNumberDot;
@@ -1006,6 +2012,14 @@ SIMJSON_API JsonParseResult StreamedJsonParser<K>::process(ssType chunk) {
             }
             startProcess_ = nullptr;
         }
+        // Не даём неограниченно копить строку или число между порциями
+        // Do not allow to accumulate a string or number between chunks without limit
+        if (text_.length() > limits_.max_string_length) {
+            state_ = LimitReached;
+        }
+    }
+    if (state_ == LimitReached) {
+        return JsonParseResult::LimitExceeded;
     }
     if (state_ == Done) {
         return Last && ptr_ == end ? JsonParseResult::Success : JsonParseResult::NoNeedMore;
@@ -1013,63 +2027,199 @@ SIMJSON_API JsonParseResult StreamedJsonParser<K>::process(ssType chunk) {
     return JsonParseResult::Pending;
 }
 
-template<typename K>
-typename JsonValueTempl<K>::strType StreamedJsonParser<K>::getText() {
+template<typename K, typename I>
+typename JsonValueTempl<K>::strType StreamedJsonParser<K, I>::getText() {
     if (startProcess_) {
         ssType text{startProcess_ + 1, size_t(ptr_ - startProcess_ - 1)};
         startProcess_ = nullptr;
-        return text;
+        return transcode(text);
     }
-    strType text(text_);
-    text_.reset();
-    return text;
-}
-
-template<typename K>
-bool StreamedJsonParser<K>::processUnicode(K symbol) {
-    if (symbol >= '0' && symbol <= '9') {
-        currentUnicode_[idxUnicode_] = currentUnicode_[idxUnicode_] * 16 + symbol - '0';
-    } else if (symbol >= 'a' && symbol <= 'f') {
-        currentUnicode_[idxUnicode_] = currentUnicode_[idxUnicode_] * 16 + symbol + 10 - 'a';
-    } else if (symbol >= 'A' && symbol <= 'F') {
-        currentUnicode_[idxUnicode_] = currentUnicode_[idxUnicode_] * 16 + symbol + 10 - 'A';
+    textPeak_ = std::max(textPeak_, text_.length());
+    if constexpr (std::is_same_v<K, I>) {
+        strType text(text_);
+        text_.reset();
+        return text;
     } else {
-        return false;
+        strType text;
+        if (text_.is_continuous()) {
+            text = transcode({text_.begin(), text_.length()});
+        } else {
+            typename JsonValueTempl<I>::strType joined(text_);
+            text = transcode(joined);
+        }
+        text_.reset();
+        return text;
     }
-    return true;
 }
 
-template<typename K>
-template<bool Compound, int NewState, typename ... Args>
-JsonValueTempl<K>* StreamedJsonParser<K>::addValue(JsonValueTempl<K>* current, Args&& ... args) {
+template<typename K, typename I>
+typename JsonValueTempl<K>::strType StreamedJsonParser<K, I>::transcode(ssType text) {
+    if constexpr (std::is_same_v<K, I>) {
+        return text;
+    } else {
+        if constexpr (sizeof(I) == 1) {
+            // Ключи и строки JSON чаще всего в ASCII, их просто расширяем, проверяя по 8 байт за раз
+            // JSON keys and strings are mostly ASCII, just widen them, checking 8 bytes at a time
+            const I* ptr = text.begin();
+            size_t len = text.length(), i = 0;
+            for (; i + 8 <= len; i += 8) {
+                uint64_t block;
+                std::memcpy(&block, ptr + i, 8);
+                if (block & 0x8080808080808080ull) {
+                    break;
+                }
+            }
+            for (; i < len; i++) {
+                if (std::make_unsigned_t<I>(ptr[i]) >= 0x80) {
+                    break;
+                }
+            }
+            if (i == len) {
+                lstring<K, 0, true> wide;
+                K* out = wide.set_size(len);
+                for (size_t j = 0; j < len; j++) {
+                    out[j] = K(ptr[j]);
+                }
+                return wide;
+            }
+        }
+        return lstring<K, 0, true>{text};
+    }
+}
+
+template<typename K, typename I>
+bool StreamedJsonParser<K, I>::processUnicode(I symbol) {
+    if (symbol >= '0' && symbol <= '9') {
+        currentUnicode_[idxUnicode_] = currentUnicode_[idxUnicode_] * 16 + symbol - '0';
+    } else if (symbol >= 'a' && symbol <= 'f') {
+        currentUnicode_[idxUnicode_] = currentUnicode_[idxUnicode_] * 16 + symbol + 10 - 'a';
+    } else if (symbol >= 'A' && symbol <= 'F') {
+        currentUnicode_[idxUnicode_] = currentUnicode_[idxUnicode_] * 16 + symbol + 10 - 'A';
+    } else {
+        return false;
+    }
+    return true;
+}
+
+template<typename K, typename I>
+template<bool Compound, int NewState, typename ... Args>
+JsonValueTempl<K>* StreamedJsonParser<K, I>::addValue(JsonValueTempl<K>* current, Args&& ... args) {
     state_ = NewState;
+    if (++values_ > limits_.max_values) {
+        state_ = LimitReached;
+        return nullptr;
+    }
     if (current->is_array()) {
-        current->as_array()->emplace_back(std::forward<Args>(args)...);
+        {
+            phase_timer timer{stats_, &JsonParseStats::cycles_insert};
+            current->as_array()->emplace_back(std::forward<Args>(args)...);
+        }
+#if SIMJSON_STATS != 0
+        stats_.values[current->as_array()->back().type()]++;
+#endif
+        if (overBytes(sizeof(JsonValueTempl<K>))) {
+            state_ = LimitReached;
+            return nullptr;
+        }
         if  constexpr (Compound) {
             current = &current->as_array()->back();
             stack_.emplace_back(current);
+            if (projection_) {
+                projNodes_.push_back(projNodes_.back());
+            }
+        } else if (current == streamArray_) {
+            emitItem();
         }
-        return current;
     } else {
         new (current) JsonValueTempl<K>(std::forward<Args>(args)...);
+#if SIMJSON_STATS != 0
+        stats_.values[current->type()]++;
+#endif
         if  constexpr (!Compound) {
             return popStack();
-        } else {
-            return current;
         }
     }
+    if constexpr (Compound) {
+#if SIMJSON_STATS != 0
+        stats_.max_depth = std::max(stats_.max_depth, stack_.size());
+#endif
+        // Сам контейнер и управляющий блок shared_ptr
+        // The container itself and the shared_ptr control block
+        if (stack_.size() > limits_.max_depth ||
+                overBytes((current->is_object() ? sizeof(typename JsonValueTempl<K>::obj_type) : sizeof(typename JsonValueTempl<K>::arr_type)) + 2 * sizeof(void*))) {
+            state_ = LimitReached;
+            return nullptr;
+        }
+        if (streamHandler_ && !streamArray_ && current->is_array() &&
+                pathMatched_ == streamPath_.size() && stack_.size() == pathMatched_ + 1) {
+            streamArray_ = current;
+            streamBytes_ = bytes_;
+        }
+    }
+    return current;
 }
 
-template<typename K>
-JsonValueTempl<K>* StreamedJsonParser<K>::popStack() {
+template<typename K, typename I>
+JsonValueTempl<K>* StreamedJsonParser<K, I>::popStack() {
+    if (stack_.back() == streamArray_) {
+        streamArray_ = nullptr;
+    } else if (limits_.packed_arrays && stack_.back()->is_array()) {
+        stack_.back()->pack();
+    }
     stack_.pop_back();
+    if (projection_) {
+        projNodes_.pop_back();
+    }
     if (stack_.empty()) {
         state_ = Done;
         return nullptr;
     }
+    if (pathMatched_ >= stack_.size()) {
+        pathMatched_ = stack_.size() - 1;
+    }
+    if (stack_.back() == streamArray_) {
+        emitItem();
+    }
     return stack_.back();
 }
 
+template<typename K, typename I>
+void StreamedJsonParser<K, I>::emitItem() {
+    auto& items = *streamArray_->as_array();
+    streamed_++;
+    bool next = streamHandler_(items.back());
+    items.clear();
+    // Память под отданный элемент освобождена
+    // The memory for the handed over element is released
+    bytes_ = streamBytes_;
+    if (!next) {
+        state_ = Done;
+    }
+}
+
+template<typename K, typename I>
+SIMJSON_API void StreamedJsonParser<K, I>::streamItems(simple_str<K> path, item_handler handler) {
+    streamPath_.clear();
+    streamHandler_ = std::move(handler);
+    // "$", "$.data.items" или "data.items"
+    // "$", "$.data.items" or "data.items"
+    const K* ptr = path.begin();
+    const K* end = path.end();
+    if (ptr < end && *ptr == '$') {
+        ptr++;
+    }
+    while (ptr < end) {
+        if (*ptr == '.') {
+            ptr++;
+        }
+        const K* start = ptr;
+        while (ptr < end && *ptr != '.') {
+            ptr++;
+        }
+        streamPath_.emplace_back(simple_str<K>{start, size_t(ptr - start)});
+    }
+}
+
 template<typename K, bool All>
 struct extractor {
     using strType = typename JsonValueTempl<K>::strType;
@@ -1097,26 +2247,52 @@ struct extractor<K, true> {
     }
 };
 
-template<typename K>
+template<typename K, typename I>
 template<bool asInt, bool All>
-JsonValueTempl<K>* StreamedJsonParser<K>::addNumber(JsonValueTempl<K>* current) {
-    extractor<K, All> e;
+JsonValueTempl<K>* StreamedJsonParser<K, I>::addNumber(JsonValueTempl<K>* current) {
+    extractor<I, All> e;
     ssType ssValue = e.extract(startProcess_, ptr_, text_);
     JsonValueTempl<K> jsonValue;
+    {
+        phase_timer timer{stats_, &JsonParseStats::cycles_numbers};
+        if (limits_.raw_numbers) {
+            // Классифицируем так же, как при обычном разборе: целые, не влезающие в int64_t, становятся Real.
+            // До 18 цифр целое точно влезает, переводить не нужно.
+            // Classify the same way as in normal parsing: integers that do not fit into int64_t become Real.
+            // Up to 18 digits an integer surely fits, no need to convert.
+            bool isInt = asInt;
+            if (asInt && ssValue.length() > 18) {
+                auto [res, err, _] = ssValue.template to_int<int64_t, true, 10, false>();
+                isInt = err == IntConvertResult::Success;
+            }
+            jsonValue = JsonValueTempl<K>(Json::rawNumber, isInt ? Json::Integer : Json::Real, transcode(ssValue));
+        } else {
+            if constexpr (asInt) {
+                auto [res, err, _] = ssValue.template to_int<int64_t, true, 10, false>();
+                if (err == IntConvertResult::Success) {
+                    jsonValue = res;
+                }
+            }
 
-    if constexpr (asInt) {
-        auto [res, err, _] = ssValue.template to_int<int64_t, true, 10, false>();
-        if (err == IntConvertResult::Success) {
-            jsonValue = res;
+            if (!asInt || jsonValue.is_undefined()) {
+                jsonValue = ssValue.template to_double<false, false>().value_or(std::nan("0"));
+            }
         }
     }
-
-    if (!asInt || jsonValue.is_undefined()) {
-        jsonValue = ssValue.template to_double<false, false>().value_or(std::nan("0"));
+#if SIMJSON_STATS != 0
+    if (jsonValue.is_integer()) {
+        stats_.integers++;
+    } else {
+        stats_.reals++;
+        if (asInt) {
+            stats_.fallbacks++;
+        }
     }
+#endif
 
     if constexpr (!All) {
         if (!startProcess_) {
+            textPeak_ = std::max(textPeak_, text_.length());
             text_.reset();
         }
     }
@@ -1125,6 +2301,685 @@ JsonValueTempl<K>* StreamedJsonParser<K>::addNumber(JsonValueTempl<K>* current)
     return addValue<false, WaitComma>(current, std::move(jsonValue));
 }
 
+template<typename K>
+SIMJSON_API void JsonTokenReader<K>::feed(ssType chunk, bool last) {
+    last_ = last;
+    size_t rest = data_.length() - pos_;
+    if (!rest) {
+        data_ = chunk;
+    } else {
+        lstring<K, 0, true> joined;
+        K* ptr = joined.set_size(rest + chunk.length());
+        std::char_traits<K>::copy(ptr, data_.begin() + pos_, rest);
+        std::char_traits<K>::copy(ptr + rest, chunk.begin(), chunk.length());
+        tail_ = std::move(joined);
+        data_ = {tail_.symbols(), tail_.length()};
+    }
+    pos_ = 0;
+}
+
+template<typename K>
+JsonToken JsonTokenReader<K>::needMore(size_t start) {
+    if (last_) {
+        return error();
+    }
+    // Порция может быть перезаписана вызывающим, сохраняем недочитанный хвост у себя
+    // The chunk may be overwritten by the caller, save the unread tail
+    lstring<K, 0, true> rest{ssType{data_.begin() + start, data_.length() - start}};
+    tail_ = std::move(rest);
+    data_ = {tail_.symbols(), tail_.length()};
+    pos_ = 0;
+    return JsonToken::NeedMore;
+}
+
+template<typename K>
+SIMJSON_API JsonToken JsonTokenReader<K>::next() {
+    const K* ptr = data_.begin();
+    size_t len = data_.length();
+    for (;;) {
+        while (pos_ < len && (ptr[pos_] == ' ' || ptr[pos_] == '\t' || ptr[pos_] == '\n' || ptr[pos_] == '\r')) {
+            pos_++;
+        }
+        if (expect_ == ExpectError) {
+            return JsonToken::Error;
+        }
+        if (pos_ == len) {
+            if (expect_ == ExpectEnd) {
+                return JsonToken::End;
+            }
+            return needMore(pos_);
+        }
+        K symbol = ptr[pos_];
+        switch (expect_) {
+        case ExpectEnd:
+            return error();
+        case ExpectColon:
+            if (symbol != ':') {
+                return error();
+            }
+            pos_++;
+            expect_ = ExpectValue;
+            continue;
+        case ExpectComma:
+            if (symbol == ',') {
+                pos_++;
+                expect_ = stack_.back() ? ExpectKey : ExpectValue;
+                continue;
+            }
+            if (symbol == '}' && stack_.back()) {
+                return closeContainer(true);
+            }
+            if (symbol == ']' && !stack_.back()) {
+                return closeContainer(false);
+            }
+            return error();
+        case ExpectFirstKey:
+            if (symbol == '}') {
+                return closeContainer(true);
+            }
+            [[fallthrough]];
+        case ExpectKey:
+            if (symbol != '\"') {
+                return error();
+            }
+            return readString(JsonToken::Key);
+        case ExpectFirstValue:
+            if (symbol == ']') {
+                return closeContainer(false);
+            }
+            [[fallthrough]];
+        default:
+            switch (symbol) {
+            case '{':
+                pos_++;
+                stack_.push_back(true);
+                expect_ = ExpectFirstKey;
+                return JsonToken::StartObject;
+            case '[':
+                pos_++;
+                stack_.push_back(false);
+                expect_ = ExpectFirstValue;
+                return JsonToken::StartArray;
+            case '\"':
+                return readString(JsonToken::String);
+            case 't':
+                return readLiteral(uni_string(K, "true"), JsonToken::True);
+            case 'f':
+                return readLiteral(uni_string(K, "false"), JsonToken::False);
+            case 'n':
+                return readLiteral(uni_string(K, "null"), JsonToken::Null);
+            default:
+                if (symbol == '-' || (symbol >= '0' && symbol <= '9')) {
+                    return readNumber();
+                }
+                return error();
+            }
+        }
+    }
+}
+
+template<typename K>
+SIMJSON_API JsonToken JsonTokenReader<K>::skip_value() {
+    if (!skipDepth_) {
+        JsonToken token = next();
+        if (token != JsonToken::StartObject && token != JsonToken::StartArray) {
+            return token;
+        }
+        skipDepth_ = depth();
+    }
+    for (;;) {
+        JsonToken token = next();
+        if (token == JsonToken::NeedMore) {
+            return token;
+        }
+        if (token == JsonToken::Error || token == JsonToken::End || depth() < skipDepth_) {
+            skipDepth_ = 0;
+            return token;
+        }
+    }
+}
+
+template<typename K>
+JsonToken JsonTokenReader<K>::closeContainer(bool object) {
+    pos_++;
+    stack_.pop_back();
+    return valueDone(object ? JsonToken::EndObject : JsonToken::EndArray);
+}
+
+template<typename K>
+JsonToken JsonTokenReader<K>::readLiteral(ssType literal, JsonToken token) {
+    size_t available = std::min(literal.length(), data_.length() - pos_);
+    for (size_t i = 1; i < available; i++) {
+        if (data_.begin()[pos_ + i] != literal.begin()[i]) {
+            return error();
+        }
+    }
+    if (available < literal.length()) {
+        return needMore(pos_);
+    }
+    pos_ += literal.length();
+    return valueDone(token);
+}
+
+template<typename K>
+JsonToken JsonTokenReader<K>::readNumber() {
+    const K* ptr = data_.begin();
+    size_t len = data_.length(), i = pos_;
+    bool isInt = true;
+    auto digits = [&]() {
+        size_t start = i;
+        while (i < len && ptr[i] >= '0' && ptr[i] <= '9') {
+            i++;
+        }
+        return i > start;
+    };
+    if (ptr[i] == '-') {
+        i++;
+    }
+    if (i < len && ptr[i] == '0') {
+        i++;
+    } else if (!digits()) {
+        return i == len ? needMore(pos_) : error();
+    }
+    if (i < len && ptr[i] == '.') {
+        isInt = false;
+        i++;
+        if (!digits()) {
+            return i == len ? needMore(pos_) : error();
+        }
+    }
+    if (i < len && (ptr[i] == 'e' || ptr[i] == 'E')) {
+        isInt = false;
+        i++;
+        if (i < len && (ptr[i] == '-' || ptr[i] == '+')) {
+            i++;
+        }
+        if (!digits()) {
+            return i == len ? needMore(pos_) : error();
+        }
+    }
+    if (i == len && !last_) {
+        // Число может продолжиться в следующей порции
+        // The number may continue in the next chunk
+        return needMore(pos_);
+    }
+    text_ = {ptr + pos_, i - pos_};
+    pos_ = i;
+    if (isInt) {
+        auto [res, err, _] = text_.template to_int<int64_t, true, 10, false>();
+        if (err == IntConvertResult::Success) {
+            integer_ = res;
+            real_ = static_cast<double>(res);
+            return valueDone(JsonToken::Integer);
+        }
+    }
+    real_ = text_.template to_double<false, false>().value_or(std::nan("0"));
+    return valueDone(JsonToken::Real);
+}
+
+template<typename K>
+static bool read_hex4(const K* ptr, u16s& result) {
+    result = 0;
+    for (unsigned i = 0; i < 4; i++) {
+        K symbol = ptr[i];
+        if (symbol >= '0' && symbol <= '9') {
+            result = result * 16 + symbol - '0';
+        } else if (symbol >= 'a' && symbol <= 'f') {
+            result = result * 16 + symbol + 10 - 'a';
+        } else if (symbol >= 'A' && symbol <= 'F') {
+            result = result * 16 + symbol + 10 - 'A';
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename K>
+JsonToken JsonTokenReader<K>::readString(JsonToken token) {
+    const K* ptr = data_.begin();
+    size_t len = data_.length(), start = pos_, i = pos_ + 1;
+    bool escaped = false;
+    while (i < len) {
+        K symbol = ptr[i];
+        if (symbol == '\"') {
+            break;
+        } else if (symbol == '\\') {
+            escaped = true;
+            i += 2;
+        } else if (std::make_unsigned_t<K>(symbol) < ' ') {
+            return error();
+        } else {
+            i++;
+        }
+    }
+    if (i >= len) {
+        return needMore(start);
+    }
+    pos_ = i + 1;
+    expect_ = token == JsonToken::Key ? ExpectColon : (stack_.empty() ? ExpectEnd : ExpectComma);
+    if (!escaped) {
+        text_ = {ptr + start + 1, i - start - 1};
+        return token;
+    }
+    // Раскодированная строка не длиннее исходной
+    // The decoded string is not longer than the source
+    size_t end = i;
+    K* out = unescaped_.set_size(end - start - 1);
+    K* begin = out;
+    for (size_t j = start + 1; j < end;) {
+        K symbol = ptr[j++];
+        if (symbol != '\\') {
+            *out++ = symbol;
+            continue;
+        }
+        symbol = ptr[j++];
+        switch (symbol) {
+        case '\\':
+        case '\"':
+        case '/':
+            *out++ = symbol;
+            break;
+        case 'b':
+            *out++ = K('\b');
+            break;
+        case 'f':
+            *out++ = K('\f');
+            break;
+        case 'n':
+            *out++ = K('\n');
+            break;
+        case 'r':
+            *out++ = K('\r');
+            break;
+        case 't':
+            *out++ = K('\t');
+            break;
+        case 'u': {
+            u16s units[2];
+            if (end - j < 4 || !read_hex4(ptr + j, units[0])) {
+                return error();
+            }
+            j += 4;
+            if constexpr (sizeof(K) == 2) {
+                *out++ = K(units[0]);
+            } else {
+                size_t count = 1;
+                if (units[0] >= 0xD800 && units[0] < 0xDC00) {
+                    // surrogate pair
+                    if (end - j < 6 || ptr[j] != '\\' || ptr[j + 1] != 'u' || !read_hex4(ptr + j + 2, units[1])) {
+                        return error();
+                    }
+                    j += 6;
+                    count = 2;
+                }
+                lstring<K, 10> decoded{ssu{units, count}};
+                std::char_traits<K>::copy(out, decoded.symbols(), decoded.length());
+                out += decoded.length();
+            }
+            break;
+        }
+        default:
+            return error();
+        }
+    }
+    text_ = {begin, size_t(out - begin)};
+    return token;
+}
+
+template<typename K>
+SIMJSON_API void JsonProjection<K>::add(simple_str<K> pointer) {
+    size_t node = 0;
+    const K* ptr = pointer.begin();
+    const K* end = pointer.end();
+    while (ptr < end && !nodes_[node].all) {
+        // Пропускаем '/' и раскодируем ~1 в '/', ~0 в '~'
+        // Skip '/' and decode ~1 to '/', ~0 to '~'
+        ptr++;
+        lstring<K, 40> key;
+        const K* start = ptr;
+        while (ptr < end && *ptr != '/') {
+            ptr++;
+        }
+        K* out = key.set_size(ptr - start);
+        size_t len = 0;
+        for (const K* s = start; s < ptr; s++) {
+            if (*s == '~' && s + 1 < ptr && (s[1] == '0' || s[1] == '1')) {
+                out[len++] = s[1] == '0' ? K('~') : K('/');
+                s++;
+            } else {
+                out[len++] = *s;
+            }
+        }
+        simple_str<K> name{out, len};
+        size_t child = find(node, name);
+        if (child == npos) {
+            child = nodes_.size();
+            nodes_.push_back(Node{name, node, false});
+        }
+        node = child;
+    }
+    nodes_[node].all = true;
+}
+
+// Запись значений в колонку, с расширением её типа
+// Writing values into a column, widening its type
+template<typename K>
+struct column_writer {
+    JsonColumn<K>& col;
+
+    static void setBit(std::vector<uint8_t>& bits, size_t row) {
+        bits[row / 8] |= uint8_t(1 << (row % 8));
+    }
+
+    static void pushBit(std::vector<uint8_t>& bits, size_t row) {
+        if (row % 8 == 0) {
+            bits.push_back(0);
+        }
+    }
+
+    void appendText(simple_str<K> text) {
+        if constexpr (std::is_same_v<K, u8s>) {
+            col.data.insert(col.data.end(), text.begin(), text.end());
+        } else {
+            lstring<u8s, 128> utf8{text};
+            simple_str<u8s> str = utf8;
+            col.data.insert(col.data.end(), str.begin(), str.end());
+        }
+        col.offsets.back() = int64_t(col.data.size());
+    }
+
+    void appendValue(const JsonValueTempl<K>& value) {
+        if (value.is_text()) {
+            appendText(value.as_text());
+        } else {
+            appendText(value.store());
+        }
+    }
+
+    // Пустое значение для новой строки
+    // An empty value for a new row
+    void appendNull(size_t row) {
+        pushBit(col.validity, row);
+        col.null_count++;
+        switch (col.type) {
+        case Json::Integer:
+            col.integers.push_back(0);
+            break;
+        case Json::Real:
+            col.reals.push_back(0);
+            break;
+        case Json::Boolean:
+            pushBit(col.booleans, row);
+            break;
+        case Json::Text:
+            col.offsets.push_back(col.offsets.back());
+            break;
+        default:
+            break;
+        }
+    }
+
+    void convert(Json::Type type, size_t rows) {
+        switch (type) {
+        case Json::Integer:
+            col.integers.resize(rows);
+            break;
+        case Json::Real:
+            if (col.type == Json::Integer) {
+                col.reals.assign(col.integers.begin(), col.integers.end());
+                std::vector<int64_t>().swap(col.integers);
+            } else {
+                col.reals.resize(rows);
+            }
+            break;
+        case Json::Boolean:
+            col.booleans.resize((rows + 7) / 8);
+            break;
+        default: {
+            // Прошлые значения переводим в JSON-текст
+            // Previous values are converted to JSON text
+            JsonColumn<K> old = std::move(col);
+            col.name = std::move(old.name);
+            col.validity = std::move(old.validity);
+            col.null_count = old.null_count;
+            col.offsets.assign(1, 0);
+            col.offsets.reserve(rows + 1);
+            for (size_t row = 0; row < rows; row++) {
+                col.offsets.push_back(col.offsets.back());
+                if (old.type != Json::Null && col.is_valid(row)) {
+                    switch (old.type) {
+                    case Json::Integer:
+                        appendValue(JsonValueTempl<K>(old.integers[row]));
+                        break;
+                    case Json::Real:
+                        appendValue(JsonValueTempl<K>(old.reals[row]));
+                        break;
+                    default:
+                        appendValue(JsonValueTempl<K>(old.boolean(row)));
+                    }
+                }
+            }
+        }
+        }
+        col.type = type;
+    }
+
+    // Значение для последней строки, в которой уже стоит пустое значение
+    // A value for the last row, which already holds an empty value
+    void set(const JsonValueTempl<K>& value, size_t row) {
+        Json::Type type = value.type();
+        if (type == Json::Null || type == Json::Undefined) {
+            return;
+        }
+        if (type == Json::Object || type == Json::Array) {
+            type = Json::Text;
+        }
+        if (type != col.type) {
+            if (col.type == Json::Null || (col.type == Json::Integer && type == Json::Real)) {
+                convert(type, row + 1);
+            } else if (!(col.type == Json::Real && type == Json::Integer) && col.type != Json::Text) {
+                convert(Json::Text, row + 1);
+            }
+        }
+        setBit(col.validity, row);
+        col.null_count--;
+        switch (col.type) {
+        case Json::Integer:
+            col.integers[row] = value.as_integer();
+            break;
+        case Json::Real:
+            col.reals[row] = value.is_integer() ? double(value.as_integer()) : value.as_real();
+            break;
+        case Json::Boolean:
+            if (value.as_boolean()) {
+                setBit(col.booleans, row);
+            }
+            break;
+        default:
+            appendValue(value);
+        }
+    }
+};
+
+template<typename K>
+SIMJSON_API void JsonColumns<K>::add(const JsonValueTempl<K>& record) {
+    size_t row = rows_++;
+    for (auto& col : columns) {
+        column_writer<K>{col}.appendNull(row);
+    }
+    if (!record.is_object()) {
+        return;
+    }
+    for (const auto& [key, value] : *record.as_object()) {
+        if (value.is_undefined()) {
+            continue;
+        }
+        auto fnd = index_.find(key);
+        if (fnd == index_.end()) {
+            // Новая колонка, во всех прошлых строках пусто
+            // A new column, all previous rows are empty
+            fnd = index_.emplace(key, columns.size()).first;
+            JsonColumn<K>& col = columns.emplace_back();
+            col.name = key.to_str();
+            col.validity.resize((rows_ + 7) / 8);
+            col.null_count = rows_;
+        }
+        column_writer<K>{columns[fnd->second]}.set(value, row);
+    }
+}
+
+template<typename K>
+SIMJSON_API JsonColumns<K> JsonValueTempl<K>::to_columns() const {
+    JsonColumns<K> res;
+    if (type_ == Array) {
+        for (size_t i = 0, count = size(); i < count; i++) {
+            res.add(packed_ ? packedItem(i) : (*val_.array)[i]);
+        }
+    }
+    return res;
+}
+
+template<typename K>
+SIMJSON_API JsonIndex<K>::JsonIndex(const json_value& array, ssType path) {
+    if (array.is_array()) {
+        array_ = array;
+    }
+    // JSON pointer: "/meta/sku", ~0 - это ~, ~1 - это /
+    // JSON pointer: "/meta/sku", ~0 is ~, ~1 is /
+    const K* ptr = path.begin();
+    const K* end = path.end();
+    while (ptr < end) {
+        if (*ptr == '/') {
+            ptr++;
+        }
+        lstring<K, 64> name;
+        for (; ptr < end && *ptr != '/'; ptr++) {
+            if (*ptr == '~' && ptr + 1 < end && (ptr[1] == '0' || ptr[1] == '1')) {
+                name += e_c(1, K(ptr[1] == '0' ? '~' : '/'));
+                ptr++;
+            } else {
+                name += e_c(1, *ptr);
+            }
+        }
+        path_.emplace_back(ssType(name));
+    }
+    rebuild();
+}
+
+template<typename K>
+const JsonValueTempl<K>* JsonIndex<K>::keyOf(const json_value& item) const {
+    const json_value* current = &item;
+    for (const auto& key : path_) {
+        if (!current->is_object()) {
+            return nullptr;
+        }
+        auto fnd = current->as_object()->find(key);
+        if (fnd == current->as_object()->end()) {
+            return nullptr;
+        }
+        current = &fnd->second;
+    }
+    return current;
+}
+
+template<typename K>
+void JsonIndex<K>::add(size_t pos) {
+    const json_value* key = keyOf((*array_.as_array())[pos]);
+    if (!key) {
+        return;
+    }
+    // Для повторяющихся ключей в индексе остаётся первый элемент
+    // For repeated keys the first element stays in the index
+    if (key->is_text()) {
+        auto [it, inserted] = texts_.try_emplace(ssType(key->as_text()), pos);
+        if (!inserted && it->second > pos) {
+            it->second = pos;
+        }
+    } else if (key->is_integer()) {
+        auto [it, inserted] = integers_.try_emplace(key->as_integer(), pos);
+        if (!inserted && it->second > pos) {
+            it->second = pos;
+        }
+    }
+}
+
+template<typename K>
+SIMJSON_API void JsonIndex<K>::update() {
+    // В упакованном массиве только числа и логические значения, ключей там нет
+    // A packed array holds only numbers and booleans, there are no keys there
+    if (!array_.is_array() || array_.is_packed()) {
+        return;
+    }
+    size_t count = array_.as_array()->size();
+    if (count < indexed_) {
+        texts_.clear();
+        integers_.clear();
+        indexed_ = 0;
+    }
+    for (; indexed_ < count; indexed_++) {
+        add(indexed_);
+    }
+}
+
+template<typename K>
+SIMJSON_API void JsonIndex<K>::rebuild() {
+    texts_.clear();
+    integers_.clear();
+    indexed_ = 0;
+    update();
+}
+
+template<typename K>
+SIMJSON_API void JsonIndex<K>::update(size_t pos) {
+    update();
+    if (pos < indexed_) {
+        add(pos);
+    }
+}
+
+template<typename K>
+SIMJSON_API const JsonValueTempl<K>* JsonIndex<K>::find(ssType key) const {
+    return lookup(key);
+}
+
+template<typename K>
+SIMJSON_API const JsonValueTempl<K>* JsonIndex<K>::find(int64_t key) const {
+    return lookup(key);
+}
+
+template<typename K>
+template<typename T>
+const JsonValueTempl<K>* JsonIndex<K>::lookup(const T& key) const {
+    assert(!is_stale() && "JsonIndex: the array changed, call update()");
+    size_t pos;
+    if constexpr (std::is_same_v<T, int64_t>) {
+        auto fnd = integers_.find(key);
+        if (fnd == integers_.end()) {
+            return nullptr;
+        }
+        pos = fnd->second;
+    } else {
+        auto fnd = texts_.find(key);
+        if (fnd == texts_.end()) {
+            return nullptr;
+        }
+        pos = fnd->second;
+    }
+    // Индекс мог устареть: массив укоротили или ключ элемента поменяли, тогда элемента по этому ключу нет
+    // The index may be stale: the array was shortened or the element key changed, then there is no element for this key
+    if (!array_.is_array() || array_.is_packed() || pos >= array_.as_array()->size()) {
+        return nullptr;
+    }
+    const json_value& item = (*array_.as_array())[pos];
+    const json_value* k = keyOf(item);
+    if constexpr (std::is_same_v<T, int64_t>) {
+        return k && k->is_integer() && k->as_integer() == key ? &item : nullptr;
+    } else {
+        return k && k->is_text() && ssType(k->as_text()) == key ? &item : nullptr;
+    }
+}
+
 stringa get_file_content(stra filePath) {
     std::ifstream file(filePath.c_str(), std::ios::binary | std::ios::ate);
     if (!file.is_open()) {
@@ -1152,5 +3007,30 @@ template struct StreamedJsonParser<ubs>;
 template struct StreamedJsonParser<u16s>;
 template struct StreamedJsonParser<u32s>;
 template struct StreamedJsonParser<wchar_t>;
+// Парсинг UTF-8 сразу в json других типов символов
+// Parsing UTF-8 directly into json of other symbol types
+template struct StreamedJsonParser<u16s, u8s>;
+template struct StreamedJsonParser<u32s, u8s>;
+template struct StreamedJsonParser<wchar_t, u8s>;
+
+template class JsonProjection<u8s>;
+template class JsonProjection<u16s>;
+template class JsonProjection<u32s>;
+template class JsonProjection<wchar_t>;
+
+template class JsonTokenReader<u8s>;
+template class JsonTokenReader<ubs>;
+template class JsonTokenReader<u16s>;
+template class JsonTokenReader<u32s>;
+template class JsonTokenReader<wchar_t>;
+
+template class JsonColumns<u8s>;
+template class JsonColumns<u16s>;
+template class JsonColumns<u32s>;
+template class JsonColumns<wchar_t>;
+template class JsonIndex<u8s>;
+template class JsonIndex<u16s>;
+template class JsonIndex<u32s>;
+template class JsonIndex<wchar_t>;
 
 } // namespace simjson
@@ -0,0 +1,1012 @@
+﻿/*
+ * (c) Проект "SimJson", Александр Орефков orefkov@gmail.com
+ * ver. 1.0
+ * Запросы JSONPath к JSON
+ */
+
+#include <simjson/jsonpath.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <thread>
+
+namespace simjson {
+using namespace simstr;
+using namespace simstr::literals;
+
+namespace {
+
+// Общий пул потоков для параллельных фильтров. Вызывающий поток тоже берёт части работы,
+// поэтому вложенные параллельные вызовы не блокируют друг друга.
+// A shared thread pool for parallel filters. The calling thread also takes parts of the work,
+// so nested parallel calls do not block each other.
+class path_pool {
+public:
+    static path_pool& instance() {
+        static path_pool pool;
+        return pool;
+    }
+
+    size_t workers() const {
+        return threads_.size();
+    }
+
+    void run(size_t count, const std::function<void(size_t)>& fn) {
+        auto job = std::make_shared<Job>();
+        job->count = count;
+        job->fn = &fn;
+        size_t helpers = std::min(threads_.size(), count - 1);
+        {
+            std::lock_guard lock(mutex_);
+            for (size_t i = 0; i < helpers; i++) {
+                tasks_.push_back(job);
+            }
+        }
+        cv_.notify_all();
+        job->work();
+        std::unique_lock lock(job->mutex);
+        job->cv.wait(lock, [&] { return job->done == count; });
+        // Исключение из любой части получает вызывающий поток, а не std::terminate в потоке пула
+        // An exception from any part reaches the calling thread, not std::terminate in a pool thread
+        if (job->error) {
+            std::rethrow_exception(job->error);
+        }
+    }
+
+    ~path_pool() {
+        {
+            std::lock_guard lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        for (auto& t : threads_) {
+            t.join();
+        }
+    }
+
+private:
+    struct Job {
+        size_t count{};
+        // Вызывается только пока есть невзятые части, а значит, вызывающий поток ещё ждёт
+        // Called only while there are untaken parts, which means the calling thread is still waiting
+        const std::function<void(size_t)>* fn{};
+        std::atomic<size_t> next{0};
+        size_t done{};
+        // Первое исключение, после него оставшиеся части только отмечаются выполненными
+        // The first exception, after it the remaining parts are only marked done
+        std::exception_ptr error;
+        std::atomic<bool> failed{false};
+        std::mutex mutex;
+        std::condition_variable cv;
+
+        void work() {
+            for (size_t i; (i = next++) < count;) {
+                if (!failed) {
+                    try {
+                        (*fn)(i);
+                    } catch (...) {
+                        std::lock_guard lock(mutex);
+                        if (!error) {
+                            error = std::current_exception();
+                        }
+                        failed = true;
+                    }
+                }
+                std::lock_guard lock(mutex);
+                if (++done == count) {
+                    cv.notify_all();
+                }
+            }
+        }
+    };
+
+    path_pool() {
+        for (unsigned i = 1, n = std::thread::hardware_concurrency(); i < n; i++) {
+            threads_.emplace_back([this] { loop(); });
+        }
+    }
+
+    void loop() {
+        for (;;) {
+            std::shared_ptr<Job> job;
+            {
+                std::unique_lock lock(mutex_);
+                cv_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+                if (tasks_.empty()) {
+                    return;
+                }
+                job = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            job->work();
+        }
+    }
+
+    std::vector<std::thread> threads_;
+    std::deque<std::shared_ptr<Job>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_{};
+};
+
+template<typename K>
+bool isDigit(K symbol) {
+    return symbol >= '0' && symbol <= '9';
+}
+
+template<typename K>
+bool isNameFirst(K symbol) {
+    return (symbol >= 'a' && symbol <= 'z') || (symbol >= 'A' && symbol <= 'Z') || symbol == '_' ||
+        std::make_unsigned_t<K>(symbol) >= 0x80;
+}
+
+template<typename K>
+bool isNumber(const JsonValueTempl<K>& value) {
+    return value.is_integer() || value.is_real();
+}
+
+template<typename K>
+double numberValue(const JsonValueTempl<K>& value) {
+    return value.is_integer() ? double(value.as_integer()) : value.as_real();
+}
+
+template<typename K>
+bool jsonEqual(const JsonValueTempl<K>& a, const JsonValueTempl<K>& b) {
+    if (isNumber(a) && isNumber(b)) {
+        if (a.is_integer() && b.is_integer()) {
+            return a.as_integer() == b.as_integer();
+        }
+        return numberValue(a) == numberValue(b);
+    }
+    if (a.type() != b.type()) {
+        return false;
+    }
+    switch (a.type()) {
+    case Json::Boolean:
+        return a.as_boolean() == b.as_boolean();
+    case Json::Text:
+        return simple_str<K>(a.as_text()) == simple_str<K>(b.as_text());
+    case Json::Array: {
+        if (a.size() != b.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); i++) {
+            if (!jsonEqual(a.at(i), b.at(i))) {
+                return false;
+            }
+        }
+        return true;
+    }
+    case Json::Object: {
+        size_t count = 0;
+        for (const auto& [key, value] : *a.as_object()) {
+            if (value.is_undefined()) {
+                continue;
+            }
+            count++;
+            auto fnd = b.as_object()->find(key);
+            if (fnd == b.as_object()->end() || !jsonEqual(value, fnd->second)) {
+                return false;
+            }
+        }
+        for (const auto& [key, value] : *b.as_object()) {
+            count -= !value.is_undefined();
+        }
+        return count == 0;
+    }
+    default:
+        return true;
+    }
+}
+
+template<typename K>
+bool jsonLess(const JsonValueTempl<K>& a, const JsonValueTempl<K>& b) {
+    if (isNumber(a) && isNumber(b)) {
+        if (a.is_integer() && b.is_integer()) {
+            return a.as_integer() < b.as_integer();
+        }
+        return numberValue(a) < numberValue(b);
+    }
+    if (a.is_text() && b.is_text()) {
+        return simple_str<K>(a.as_text()) < simple_str<K>(b.as_text());
+    }
+    return false;
+}
+
+// Длина строки в символах Unicode
+// String length in Unicode characters
+template<typename K>
+size_t codePoints(simple_str<K> text) {
+    if constexpr (sizeof(K) == 4) {
+        return text.length();
+    } else {
+        size_t count = 0;
+        for (K s : text) {
+            if constexpr (sizeof(K) == 1) {
+                count += ((unsigned char)s & 0xC0) != 0x80;
+            } else {
+                count += (s & 0xFC00) != 0xDC00;
+            }
+        }
+        return count;
+    }
+}
+
+} // namespace
+
+template<typename K>
+void JsonPath<K>::skipSpaces() {
+    while (ptr_ < end_ && (*ptr_ == ' ' || *ptr_ == '\t' || *ptr_ == '\n' || *ptr_ == '\r')) {
+        ptr_++;
+    }
+}
+
+template<typename K>
+size_t JsonPath<K>::addExpr(Expr&& expr) {
+    exprs_.emplace_back(std::move(expr));
+    return exprs_.size() - 1;
+}
+
+template<typename K>
+SIMJSON_API bool JsonPath<K>::compile(ssType path) {
+    queries_.clear();
+    exprs_.clear();
+    valid_ = false;
+    begin_ = ptr_ = path.begin();
+    end_ = path.end();
+    // Вложенные запросы фильтров добавляются по ходу, основной запрос занимает место 0 заранее
+    // Nested filter queries are added on the way, the main query takes place 0 in advance
+    queries_.emplace_back();
+    Query main;
+    main.absolute = true;
+    if (ptr_ < end_ && *ptr_ == '$') {
+        ptr_++;
+        valid_ = parseSegments(main) && ptr_ == end_;
+    }
+    errorPos_ = size_t(ptr_ - begin_);
+    if (!valid_) {
+        queries_.clear();
+        exprs_.clear();
+        return false;
+    }
+    queries_[0] = std::move(main);
+    return true;
+}
+
+template<typename K>
+bool JsonPath<K>::parseSegments(Query& query) {
+    for (;;) {
+        const K* save = ptr_;
+        skipSpaces();
+        if (ptr_ < end_ && *ptr_ == '[') {
+            Segment segment;
+            if (!parseBracket(segment)) {
+                return false;
+            }
+            query.segments.emplace_back(std::move(segment));
+        } else if (ptr_ < end_ && *ptr_ == '.') {
+            ptr_++;
+            Segment segment;
+            if (ptr_ < end_ && *ptr_ == '.') {
+                ptr_++;
+                segment.descendant = true;
+                if (ptr_ < end_ && *ptr_ == '[') {
+                    if (!parseBracket(segment)) {
+                        return false;
+                    }
+                    query.segments.emplace_back(std::move(segment));
+                    continue;
+                }
+            }
+            Selector selector{.kind = Sel::Wildcard};
+            if (ptr_ < end_ && *ptr_ == '*') {
+                ptr_++;
+            } else {
+                selector.kind = Sel::Name;
+                if (!parseName(selector.name)) {
+                    return false;
+                }
+            }
+            segment.selectors.emplace_back(std::move(selector));
+            query.segments.emplace_back(std::move(segment));
+        } else {
+            ptr_ = save;
+            return true;
+        }
+    }
+}
+
+template<typename K>
+bool JsonPath<K>::parseBracket(Segment& segment) {
+    ptr_++;
+    for (;;) {
+        skipSpaces();
+        Selector selector{.kind = Sel::Wildcard};
+        if (!parseSelector(selector)) {
+            return false;
+        }
+        segment.selectors.emplace_back(std::move(selector));
+        skipSpaces();
+        if (ptr_ == end_) {
+            return false;
+        }
+        if (*ptr_ == ']') {
+            ptr_++;
+            return true;
+        }
+        if (*ptr_ != ',') {
+            return false;
+        }
+        ptr_++;
+    }
+}
+
+template<typename K>
+bool JsonPath<K>::parseSelector(Selector& selector) {
+    if (ptr_ == end_) {
+        return false;
+    }
+    K symbol = *ptr_;
+    if (symbol == '\'' || symbol == '"') {
+        selector.kind = Sel::Name;
+        return parseString(selector.name);
+    }
+    if (symbol == '*') {
+        ptr_++;
+        selector.kind = Sel::Wildcard;
+        return true;
+    }
+    if (symbol == '?') {
+        ptr_++;
+        selector.kind = Sel::Filter;
+        selector.expr = parseOr();
+        return selector.expr != npos;
+    }
+    if (symbol != ':' && symbol != '-' && !isDigit(symbol)) {
+        return false;
+    }
+    int64_t first = 0;
+    if (symbol != ':') {
+        if (!parseInt(first)) {
+            return false;
+        }
+        skipSpaces();
+        if (ptr_ == end_ || *ptr_ != ':') {
+            selector.kind = Sel::Index;
+            selector.index = first;
+            return true;
+        }
+        selector.hasStart = true;
+        selector.start = first;
+    }
+    // Срез start:end:step
+    // Slice start:end:step
+    selector.kind = Sel::Slice;
+    ptr_++;
+    skipSpaces();
+    if (ptr_ < end_ && (*ptr_ == '-' || isDigit(*ptr_))) {
+        if (!parseInt(selector.end)) {
+            return false;
+        }
+        selector.hasEnd = true;
+        skipSpaces();
+    }
+    if (ptr_ < end_ && *ptr_ == ':') {
+        ptr_++;
+        skipSpaces();
+        if (ptr_ < end_ && (*ptr_ == '-' || isDigit(*ptr_))) {
+            return parseInt(selector.step);
+        }
+    }
+    return true;
+}
+
+template<typename K>
+bool JsonPath<K>::parseName(strType& name) {
+    const K* start = ptr_;
+    if (ptr_ == end_ || !isNameFirst(*ptr_)) {
+        return false;
+    }
+    while (ptr_ < end_ && (isNameFirst(*ptr_) || isDigit(*ptr_))) {
+        ptr_++;
+    }
+    name = ssType{start, size_t(ptr_ - start)};
+    return true;
+}
+
+template<typename K>
+bool JsonPath<K>::parseString(strType& text) {
+    K quote = *ptr_++;
+    lstring<K, 64> buffer;
+    const K* start = ptr_;
+    auto flush = [&] {
+        buffer += ssType{start, size_t(ptr_ - start)};
+    };
+    auto hex4 = [&](u16s& unit) {
+        if (end_ - ptr_ < 4) {
+            return false;
+        }
+        unit = 0;
+        for (int i = 0; i < 4; i++) {
+            K s = *ptr_++;
+            unsigned digit = isDigit(s) ? s - '0' : (s >= 'a' && s <= 'f') ? s - 'a' + 10 : (s >= 'A' && s <= 'F') ? s - 'A' + 10 : 16;
+            if (digit > 15) {
+                return false;
+            }
+            unit = u16s((unit << 4) | digit);
+        }
+        return true;
+    };
+    while (ptr_ < end_) {
+        K symbol = *ptr_;
+        if (symbol == quote) {
+            flush();
+            ptr_++;
+            text = ssType(buffer);
+            return true;
+        }
+        if (std::make_unsigned_t<K>(symbol) < ' ') {
+            return false;
+        }
+        if (symbol != '\\') {
+            ptr_++;
+            continue;
+        }
+        flush();
+        if (++ptr_ == end_) {
+            return false;
+        }
+        K esc = *ptr_++;
+        K add = 0;
+        switch (esc) {
+        case 'b': add = '\b'; break;
+        case 'f': add = '\f'; break;
+        case 'n': add = '\n'; break;
+        case 'r': add = '\r'; break;
+        case 't': add = '\t'; break;
+        case '/': case '\\': case '\'': case '"': add = esc; break;
+        case 'u': {
+            u16s units[2];
+            size_t count = 1;
+            if (!hex4(units[0])) {
+                return false;
+            }
+            if ((units[0] & 0xFC00) == 0xD800) {
+                if (end_ - ptr_ < 6 || ptr_[0] != '\\' || ptr_[1] != 'u') {
+                    return false;
+                }
+                ptr_ += 2;
+                if (!hex4(units[1]) || (units[1] & 0xFC00) != 0xDC00) {
+                    return false;
+                }
+                count = 2;
+            } else if ((units[0] & 0xFC00) == 0xDC00) {
+                return false;
+            }
+            if constexpr (sizeof(K) == 2) {
+                buffer += ssType{(const K*)units, count};
+            } else {
+                lstring<K, 8> symbols{simple_str<u16s>{units, count}};
+                buffer += ssType(symbols);
+            }
+            break;
+        }
+        default:
+            return false;
+        }
+        if (add) {
+            buffer += e_c(1, add);
+        }
+        start = ptr_;
+    }
+    return false;
+}
+
+template<typename K>
+bool JsonPath<K>::parseInt(int64_t& value) {
+    bool negative = ptr_ < end_ && *ptr_ == '-';
+    if (negative) {
+        ptr_++;
+    }
+    if (ptr_ == end_ || !isDigit(*ptr_) || (*ptr_ == '0' && (negative || (ptr_ + 1 < end_ && isDigit(ptr_[1]))))) {
+        return false;
+    }
+    // Допустимый диапазон по RFC 9535 - точные целые IEEE 754
+    // The allowed range according to RFC 9535 - exact IEEE 754 integers
+    const int64_t maxValue = (int64_t(1) << 53) - 1;
+    value = 0;
+    while (ptr_ < end_ && isDigit(*ptr_)) {
+        value = value * 10 + (*ptr_++ - '0');
+        if (value > maxValue) {
+            return false;
+        }
+    }
+    if (negative) {
+        value = -value;
+    }
+    return true;
+}
+
+template<typename K>
+bool JsonPath<K>::parseNumber(json_value& value) {
+    const K* start = ptr_;
+    bool real = false;
+    if (ptr_ < end_ && *ptr_ == '-') {
+        ptr_++;
+    }
+    if (ptr_ == end_ || !isDigit(*ptr_)) {
+        return false;
+    }
+    if (*ptr_ == '0') {
+        ptr_++;
+    } else {
+        while (ptr_ < end_ && isDigit(*ptr_)) {
+            ptr_++;
+        }
+    }
+    if (ptr_ < end_ && *ptr_ == '.') {
+        real = true;
+        if (++ptr_ == end_ || !isDigit(*ptr_)) {
+            return false;
+        }
+        while (ptr_ < end_ && isDigit(*ptr_)) {
+            ptr_++;
+        }
+    }
+    if (ptr_ < end_ && (*ptr_ == 'e' || *ptr_ == 'E')) {
+        real = true;
+        if (++ptr_ < end_ && (*ptr_ == '+' || *ptr_ == '-')) {
+            ptr_++;
+        }
+        if (ptr_ == end_ || !isDigit(*ptr_)) {
+            return false;
+        }
+        while (ptr_ < end_ && isDigit(*ptr_)) {
+            ptr_++;
+        }
+    }
+    ssType text{start, size_t(ptr_ - start)};
+    if (real) {
+        value = text.template to_double<false, false>().value_or(0);
+    } else {
+        auto [res, err, _] = text.template to_int<int64_t, true, 10, false>();
+        value = res;
+    }
+    return true;
+}
+
+template<typename K>
+size_t JsonPath<K>::parseOr() {
+    size_t left = parseAnd();
+    for (;;) {
+        skipSpaces();
+        if (left == npos || end_ - ptr_ < 2 || ptr_[0] != '|' || ptr_[1] != '|') {
+            return left;
+        }
+        ptr_ += 2;
+        size_t right = parseAnd();
+        if (right == npos) {
+            return npos;
+        }
+        left = addExpr(Expr{.op = Op::Or, .left = left, .right = right});
+    }
+}
+
+template<typename K>
+size_t JsonPath<K>::parseAnd() {
+    size_t left = parseUnary();
+    for (;;) {
+        skipSpaces();
+        if (left == npos || end_ - ptr_ < 2 || ptr_[0] != '&' || ptr_[1] != '&') {
+            return left;
+        }
+        ptr_ += 2;
+        size_t right = parseUnary();
+        if (right == npos) {
+            return npos;
+        }
+        left = addExpr(Expr{.op = Op::And, .left = left, .right = right});
+    }
+}
+
+template<typename K>
+size_t JsonPath<K>::parseUnary() {
+    skipSpaces();
+    if (ptr_ == end_) {
+        return npos;
+    }
+    if (*ptr_ == '!') {
+        ptr_++;
+        size_t expr = parseUnary();
+        return expr == npos ? npos : addExpr(Expr{.op = Op::Not, .left = expr});
+    }
+    if (*ptr_ == '(') {
+        ptr_++;
+        size_t expr = parseOr();
+        skipSpaces();
+        if (expr == npos || ptr_ == end_ || *ptr_ != ')') {
+            return npos;
+        }
+        ptr_++;
+        return expr;
+    }
+    size_t left = parseComparable();
+    if (left == npos) {
+        return npos;
+    }
+    skipSpaces();
+    Op op = Op::Exists;
+    if (end_ - ptr_ >= 2 && ptr_[1] == '=' && (ptr_[0] == '=' || ptr_[0] == '!' || ptr_[0] == '<' || ptr_[0] == '>')) {
+        op = ptr_[0] == '=' ? Op::Eq : ptr_[0] == '!' ? Op::Ne : ptr_[0] == '<' ? Op::Le : Op::Ge;
+        ptr_ += 2;
+    } else if (ptr_ < end_ && (*ptr_ == '<' || *ptr_ == '>')) {
+        op = *ptr_ == '<' ? Op::Lt : Op::Gt;
+        ptr_++;
+    }
+    if (op == Op::Exists) {
+        // Без сравнения допустима только проверка наличия
+        // Without a comparison only an existence test is allowed
+        return exprs_[left].op == Op::Exists ? left : npos;
+    }
+    skipSpaces();
+    size_t right = parseComparable();
+    if (right == npos) {
+        return npos;
+    }
+    // В сравнении запросы должны давать не больше одного значения
+    // In a comparison queries must give at most one value
+    for (size_t side : {left, right}) {
+        if (exprs_[side].op == Op::Exists) {
+            if (!isSingular(queries_[exprs_[side].query])) {
+                return npos;
+            }
+            exprs_[side].op = Op::Singular;
+        }
+    }
+    return addExpr(Expr{.op = op, .left = left, .right = right});
+}
+
+template<typename K>
+size_t JsonPath<K>::parseComparable() {
+    skipSpaces();
+    if (ptr_ == end_) {
+        return npos;
+    }
+    K symbol = *ptr_;
+    if (symbol == '@' || symbol == '$') {
+        size_t query = parseQuery();
+        return query == npos ? npos : addExpr(Expr{.op = Op::Exists, .query = query});
+    }
+    if (symbol == '\'' || symbol == '"') {
+        strType text;
+        if (!parseString(text)) {
+            return npos;
+        }
+        return addExpr(Expr{Op::Literal, 0, 0, 0, json_value(text)});
+    }
+    if (symbol == '-' || isDigit(symbol)) {
+        json_value number;
+        if (!parseNumber(number)) {
+            return npos;
+        }
+        return addExpr(Expr{Op::Literal, 0, 0, 0, std::move(number)});
+    }
+    const K* start = ptr_;
+    while (ptr_ < end_ && *ptr_ >= 'a' && *ptr_ <= 'z') {
+        ptr_++;
+    }
+    ssType word{start, size_t(ptr_ - start)};
+    if (word == uni_string(K, "true")) {
+        return addExpr(Expr{Op::Literal, 0, 0, 0, json_value(true)});
+    } else if (word == uni_string(K, "false")) {
+        return addExpr(Expr{Op::Literal, 0, 0, 0, json_value(false)});
+    } else if (word == uni_string(K, "null")) {
+        return addExpr(Expr{Op::Literal, 0, 0, 0, json_value(Json::null)});
+    }
+    Op op;
+    if (word == uni_string(K, "length")) {
+        op = Op::Length;
+    } else if (word == uni_string(K, "count")) {
+        op = Op::Count;
+    } else if (word == uni_string(K, "value")) {
+        op = Op::Value;
+    } else {
+        return npos;
+    }
+    if (ptr_ == end_ || *ptr_ != '(') {
+        return npos;
+    }
+    ptr_++;
+    skipSpaces();
+    Expr expr{.op = op};
+    if (op == Op::Length) {
+        expr.left = parseComparable();
+        if (expr.left == npos) {
+            return npos;
+        }
+        if (exprs_[expr.left].op == Op::Exists) {
+            if (!isSingular(queries_[exprs_[expr.left].query])) {
+                return npos;
+            }
+            exprs_[expr.left].op = Op::Singular;
+        }
+    } else {
+        if (ptr_ == end_ || (*ptr_ != '@' && *ptr_ != '$')) {
+            return npos;
+        }
+        expr.query = parseQuery();
+        if (expr.query == npos) {
+            return npos;
+        }
+    }
+    skipSpaces();
+    if (ptr_ == end_ || *ptr_ != ')') {
+        return npos;
+    }
+    ptr_++;
+    return addExpr(std::move(expr));
+}
+
+template<typename K>
+size_t JsonPath<K>::parseQuery() {
+    Query query;
+    query.absolute = *ptr_++ == '$';
+    if (!parseSegments(query)) {
+        return npos;
+    }
+    queries_.emplace_back(std::move(query));
+    return queries_.size() - 1;
+}
+
+template<typename K>
+bool JsonPath<K>::isSingular(const Query& query) const {
+    for (const auto& segment : query.segments) {
+        if (segment.descendant || segment.selectors.size() != 1 ||
+                (segment.selectors[0].kind != Sel::Name && segment.selectors[0].kind != Sel::Index)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename K>
+SIMJSON_API void JsonPath<K>::select(const json_value& root, node_list& result) const {
+    if (valid_) {
+        run(queries_[0], root, root, result);
+    }
+}
+
+template<typename K>
+void JsonPath<K>::run(const Query& query, const json_value& current, const json_value& root, node_list& result) const {
+    const json_value& start = query.absolute ? root : current;
+    if (query.segments.empty()) {
+        result.push_back(&start);
+        return;
+    }
+    node_list nodes{&start}, next;
+    for (size_t i = 0, last = query.segments.size() - 1; i <= last; i++) {
+        if (i == last) {
+            for (const json_value* node : nodes) {
+                apply(query.segments[i], *node, root, result);
+            }
+        } else {
+            next.clear();
+            for (const json_value* node : nodes) {
+                apply(query.segments[i], *node, root, next);
+            }
+            if (next.empty()) {
+                return;
+            }
+            nodes.swap(next);
+        }
+    }
+}
+
+template<typename K>
+void JsonPath<K>::apply(const Segment& segment, const json_value& node, const json_value& root, node_list& result) const {
+    for (const auto& selector : segment.selectors) {
+        applySelector(selector, node, root, result);
+    }
+    if (segment.descendant) {
+        // Узел раньше своих потомков, элементы массива по порядку
+        // A node before its descendants, array elements in order
+        if (node.is_array()) {
+            for (const auto& item : *node.as_array()) {
+                apply(segment, item, root, result);
+            }
+        } else if (node.is_object()) {
+            for (const auto& [key, value] : *node.as_object()) {
+                if (!value.is_undefined()) {
+                    apply(segment, value, root, result);
+                }
+            }
+        }
+    }
+}
+
+template<typename K>
+void JsonPath<K>::applySelector(const Selector& selector, const json_value& node, const json_value& root, node_list& result) const {
+    switch (selector.kind) {
+    case Sel::Name:
+        if (node.is_object()) {
+            auto fnd = node.as_object()->find(selector.name);
+            if (fnd != node.as_object()->end() && !fnd->second.is_undefined()) {
+                result.push_back(&fnd->second);
+            }
+        }
+        break;
+    case Sel::Wildcard:
+        if (node.is_array()) {
+            for (const auto& item : *node.as_array()) {
+                result.push_back(&item);
+            }
+        } else if (node.is_object()) {
+            for (const auto& [key, value] : *node.as_object()) {
+                if (!value.is_undefined()) {
+                    result.push_back(&value);
+                }
+            }
+        }
+        break;
+    case Sel::Index:
+        if (node.is_array()) {
+            const auto& arr = *node.as_array();
+            int64_t idx = selector.index < 0 ? selector.index + int64_t(arr.size()) : selector.index;
+            if (idx >= 0 && idx < int64_t(arr.size())) {
+                result.push_back(&arr[size_t(idx)]);
+            }
+        }
+        break;
+    case Sel::Slice:
+        if (node.is_array() && selector.step) {
+            const auto& arr = *node.as_array();
+            int64_t len = int64_t(arr.size()), step = selector.step;
+            auto normalize = [len](int64_t i) { return i >= 0 ? i : len + i; };
+            if (step > 0) {
+                int64_t lower = std::min(std::max(selector.hasStart ? normalize(selector.start) : 0, int64_t(0)), len);
+                int64_t upper = std::min(std::max(selector.hasEnd ? normalize(selector.end) : len, int64_t(0)), len);
+                for (int64_t i = lower; i < upper; i += step) {
+                    result.push_back(&arr[size_t(i)]);
+                }
+            } else {
+                int64_t upper = std::min(std::max(selector.hasStart ? normalize(selector.start) : len - 1, int64_t(-1)), len - 1);
+                int64_t lower = std::min(std::max(selector.hasEnd ? normalize(selector.end) : -len - 1, int64_t(-1)), len - 1);
+                for (int64_t i = upper; lower < i; i += step) {
+                    result.push_back(&arr[size_t(i)]);
+                }
+            }
+        }
+        break;
+    case Sel::Filter:
+        filter(selector, node, root, result);
+        break;
+    }
+}
+
+template<typename K>
+void JsonPath<K>::filter(const Selector& selector, const json_value& node, const json_value& root, node_list& result) const {
+    if (node.is_object()) {
+        for (const auto& [key, value] : *node.as_object()) {
+            if (!value.is_undefined() && test(selector.expr, value, root)) {
+                result.push_back(&value);
+            }
+        }
+        return;
+    }
+    if (!node.is_array()) {
+        return;
+    }
+    const auto& arr = *node.as_array();
+    path_pool& pool = path_pool::instance();
+    if (arr.size() < parallel_threshold || !pool.workers()) {
+        for (const auto& item : arr) {
+            if (test(selector.expr, item, root)) {
+                result.push_back(&item);
+            }
+        }
+        return;
+    }
+    // Делим массив на части, результаты частей склеиваем по порядку
+    // Split the array into parts, the results of the parts are glued in order
+    size_t parts = std::min(arr.size(), (pool.workers() + 1) * 4);
+    size_t partSize = (arr.size() + parts - 1) / parts;
+    std::vector<node_list> found(parts);
+    pool.run(parts, [&](size_t part) {
+        for (size_t i = part * partSize, e = std::min(arr.size(), i + partSize); i < e; i++) {
+            if (test(selector.expr, arr[i], root)) {
+                found[part].push_back(&arr[i]);
+            }
+        }
+    });
+    for (const auto& part : found) {
+        result.insert(result.end(), part.begin(), part.end());
+    }
+}
+
+template<typename K>
+bool JsonPath<K>::test(size_t expr, const json_value& current, const json_value& root) const {
+    const Expr& e = exprs_[expr];
+    switch (e.op) {
+    case Op::Or:
+        return test(e.left, current, root) || test(e.right, current, root);
+    case Op::And:
+        return test(e.left, current, root) && test(e.right, current, root);
+    case Op::Not:
+        return !test(e.left, current, root);
+    case Op::Exists: {
+        node_list found;
+        run(queries_[e.query], current, root, found);
+        return !found.empty();
+    }
+    default:
+        break;
+    }
+    json_value s1, s2;
+    const json_value* a = operand(e.left, current, root, s1);
+    const json_value* b = operand(e.right, current, root, s2);
+    // Пустой результат (Nothing) равен только пустому
+    // An empty result (Nothing) equals only an empty one
+    auto equal = [&] { return a && b ? jsonEqual(*a, *b) : a == b; };
+    switch (e.op) {
+    case Op::Eq:
+        return equal();
+    case Op::Ne:
+        return !equal();
+    case Op::Lt:
+        return a && b && jsonLess(*a, *b);
+    case Op::Le:
+        return (a && b && jsonLess(*a, *b)) || equal();
+    case Op::Gt:
+        return a && b && jsonLess(*b, *a);
+    case Op::Ge:
+        return (a && b && jsonLess(*b, *a)) || equal();
+    default:
+        return false;
+    }
+}
+
+template<typename K>
+const typename JsonPath<K>::json_value* JsonPath<K>::operand(size_t expr, const json_value& current, const json_value& root, json_value& storage) const {
+    const Expr& e = exprs_[expr];
+    switch (e.op) {
+    case Op::Literal:
+        return &e.literal;
+    case Op::Singular:
+    case Op::Value: {
+        node_list found;
+        run(queries_[e.query], current, root, found);
+        return found.size() == 1 ? found[0] : nullptr;
+    }
+    case Op::Count: {
+        node_list found;
+        run(queries_[e.query], current, root, found);
+        storage = int64_t(found.size());
+        return &storage;
+    }
+    case Op::Length: {
+        json_value argStorage;
+        const json_value* arg = operand(e.left, current, root, argStorage);
+        if (!arg) {
+            return nullptr;
+        }
+        if (arg->is_text()) {
+            storage = int64_t(codePoints<K>(arg->as_text()));
+        } else if (arg->is_array() || arg->is_object()) {
+            storage = int64_t(arg->size());
+        } else {
+            return nullptr;
+        }
+        return &storage;
+    }
+    default:
+        return nullptr;
+    }
+}
+
+template class JsonPath<u8s>;
+template class JsonPath<u16s>;
+template class JsonPath<u32s>;
+template class JsonPath<wchar_t>;
+
+} // namespace simjson
@@ -0,0 +1,261 @@
+﻿/*
+ * (c) Проект "SimJson", Александр Орефков orefkov@gmail.com
+ * ver. 1.0
+ * Кодирование json в MessagePack и обратно
+ */
+
+#include <simjson/msgpack.h>
+#include "codec.h"
+#include <limits>
+
+namespace simjson {
+using namespace simstr;
+using namespace simstr::literals;
+
+namespace {
+
+template<typename K>
+struct msgpack_writer : tree_writer<K, msgpack_writer<K>> {
+    using tree_writer<K, msgpack_writer<K>>::putBig;
+
+    // Длина строки, массива или словаря: короткая форма в маркере, иначе 8, 16 или 32 бита
+    // Length of a string, array or map: the short form in the marker, otherwise 8, 16 or 32 bits
+    void length(uint8_t fix, unsigned fixLimit, uint8_t marker8, uint8_t marker16, size_t value) {
+        if (value < fixLimit) {
+            putBig(uint8_t(fix | value), 0, 0);
+        } else if (marker8 && value <= 0xFF) {
+            putBig(marker8, value, 1);
+        } else if (value <= 0xFFFF) {
+            putBig(marker16, value, 2);
+        } else {
+            putBig(marker16 + 1, value, 4);
+        }
+    }
+
+    void integer(int64_t value) {
+        if (value >= 0) {
+            if (value < 0x80) {
+                putBig(uint8_t(value), 0, 0);
+            } else if (value <= 0xFF) {
+                putBig(0xCC, uint64_t(value), 1);
+            } else if (value <= 0xFFFF) {
+                putBig(0xCD, uint64_t(value), 2);
+            } else if (value <= 0xFFFFFFFF) {
+                putBig(0xCE, uint64_t(value), 4);
+            } else {
+                putBig(0xCF, uint64_t(value), 8);
+            }
+        } else if (value >= -32) {
+            putBig(uint8_t(value), 0, 0);
+        } else if (value >= std::numeric_limits<int8_t>::min()) {
+            putBig(0xD0, uint64_t(value), 1);
+        } else if (value >= std::numeric_limits<int16_t>::min()) {
+            putBig(0xD1, uint64_t(value), 2);
+        } else if (value >= std::numeric_limits<int32_t>::min()) {
+            putBig(0xD2, uint64_t(value), 4);
+        } else {
+            putBig(0xD3, uint64_t(value), 8);
+        }
+    }
+
+    void real(double value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, 8);
+        putBig(0xCB, bits, 8);
+    }
+
+    void boolean(bool value) {
+        putBig(value ? 0xC3 : 0xC2, 0, 0);
+    }
+
+    void null() {
+        putBig(0xC0, 0, 0);
+    }
+
+    // В MessagePack нет undefined
+    // MessagePack has no undefined
+    void undefined() {
+        null();
+    }
+
+    void textHead(size_t size) {
+        length(0xA0, 32, 0xD9, 0xDA, size);
+    }
+
+    void arrayHead(size_t size) {
+        length(0x90, 16, 0, 0xDC, size);
+    }
+
+    void mapHead(size_t size) {
+        length(0x80, 16, 0, 0xDE, size);
+    }
+};
+
+uint64_t readBig(const uint8_t* ptr, unsigned bytes) {
+    uint64_t value = 0;
+    for (unsigned i = 0; i < bytes; i++) {
+        value = value << 8 | ptr[i];
+    }
+    return value;
+}
+
+} // namespace
+
+template<typename K>
+SIMJSON_API void to_msgpack(const JsonValueTempl<K>& json, lstring<u8s, 0, true>& out) {
+    msgpack_writer<K>{{out}}.write(json);
+}
+
+// Разбирает один элемент с его данными, возвращает сколько байтов занято, 0 - данных пока не хватает
+// Decodes one item with its data, returns how many bytes it took, 0 - not enough data yet
+template<typename K>
+size_t StreamedMsgpackParser<K>::decodeItem(const uint8_t* ptr, size_t size) {
+    unsigned marker = ptr[0];
+    if (marker < 0x80 || marker >= 0xE0) {
+        // positive и negative fixint
+        // positive and negative fixint
+        addValue(JsonValueTempl<K>(int64_t(int8_t(marker))));
+        return error_ == JsonParseResult::Pending ? 1 : 0;
+    }
+    if (marker < 0xC0) {
+        unsigned count = marker & (marker < 0xA0 ? 0x0F : 0x1F);
+        if (marker < 0xA0) {
+            openContainer(marker < 0x90, count);
+            return error_ == JsonParseResult::Pending ? 1 : 0;
+        }
+        if (size < 1 + count) {
+            return 0;
+        }
+        addString(ptr + 1, count, true);
+        return error_ == JsonParseResult::Pending ? 1 + count : 0;
+    }
+    // Ширина числа или длины за маркером
+    // Width of the number or the length after the marker
+    static constexpr uint8_t widths[32] = {
+        0, 0, 0, 0, 1, 2, 4, 1, 2, 4, 4, 8, 1, 2, 4, 8,
+        1, 2, 4, 8, 0, 0, 0, 0, 0, 1, 2, 4, 2, 4, 2, 4,
+    };
+    unsigned bytes = widths[marker - 0xC0];
+    if (size < 1 + bytes) {
+        return 0;
+    }
+    uint64_t arg = readBig(ptr + 1, bytes);
+    size_t used = 1 + bytes;
+    // У ext после длины ещё байт типа, у fixext длина задана маркером
+    // ext has a type byte after the length, fixext length is set by the marker
+    if (marker >= 0xC7 && marker <= 0xC9) {
+        used++;
+    } else if (marker >= 0xD4 && marker <= 0xD8) {
+        arg = uint64_t(1) << (marker - 0xD4);
+        used++;
+    }
+    bool payload = (marker >= 0xC4 && marker <= 0xC9) || (marker >= 0xD4 && marker <= 0xDB);
+    if (payload && (used > size || arg > size - used)) {
+        overString(arg);
+        return 0;
+    }
+
+    switch (marker) {
+    case 0xC0:
+        addValue(JsonValueTempl<K>(Json::null));
+        break;
+    case 0xC2:
+    case 0xC3:
+        addValue(JsonValueTempl<K>(marker == 0xC3));
+        break;
+    case 0xC4:
+    case 0xC5:
+    case 0xC6:
+        addString(ptr + used, size_t(arg), false);
+        used += size_t(arg);
+        break;
+    case 0xC7:
+    case 0xC8:
+    case 0xC9:
+    case 0xD4:
+    case 0xD5:
+    case 0xD6:
+    case 0xD7:
+    case 0xD8:
+        // Типы ext приложения в json не переносятся
+        // Application ext types are not carried over into json
+        addValue(JsonValueTempl<K>(Json::null));
+        used += size_t(arg);
+        break;
+    case 0xCA: {
+        uint32_t bits = uint32_t(arg);
+        float value;
+        std::memcpy(&value, &bits, 4);
+        addValue(JsonValueTempl<K>(double(value)));
+        break;
+    }
+    case 0xCB: {
+        double value;
+        std::memcpy(&value, &arg, 8);
+        addValue(JsonValueTempl<K>(value));
+        break;
+    }
+    case 0xCC:
+    case 0xCD:
+    case 0xCE:
+    case 0xCF:
+        if (arg <= uint64_t(std::numeric_limits<int64_t>::max())) {
+            addValue(JsonValueTempl<K>(int64_t(arg)));
+        } else {
+            addValue(JsonValueTempl<K>(double(arg)));
+        }
+        break;
+    case 0xD0:
+    case 0xD1:
+    case 0xD2:
+    case 0xD3: {
+        // Расширяем знак с ширины числа до 64 битов
+        // Sign-extend from the number width to 64 bits
+        unsigned shift = 64 - bytes * 8;
+        addValue(JsonValueTempl<K>(int64_t(arg << shift) >> shift));
+        break;
+    }
+    case 0xD9:
+    case 0xDA:
+    case 0xDB:
+        addString(ptr + used, size_t(arg), true);
+        used += size_t(arg);
+        break;
+    case 0xDC:
+    case 0xDD:
+    case 0xDE:
+    case 0xDF:
+        openContainer(marker >= 0xDE, arg);
+        break;
+    default:
+        // 0xC1 не используется
+        // 0xC1 is never used
+        error_ = JsonParseResult::Error;
+        break;
+    }
+    return error_ == JsonParseResult::Pending ? used : 0;
+}
+
+template<typename K>
+SIMJSON_API typename JsonValueTempl<K>::parse_result from_msgpack(ssa data, const ParseLimits& limits, std::pmr::memory_resource* resource) {
+    return decodeAll<StreamedMsgpackParser<K>>(data, limits, resource);
+}
+
+template SIMJSON_API void to_msgpack(const JsonValueTempl<u8s>&, lstring<u8s, 0, true>&);
+template SIMJSON_API void to_msgpack(const JsonValueTempl<u16s>&, lstring<u8s, 0, true>&);
+template SIMJSON_API void to_msgpack(const JsonValueTempl<u32s>&, lstring<u8s, 0, true>&);
+template SIMJSON_API void to_msgpack(const JsonValueTempl<wchar_t>&, lstring<u8s, 0, true>&);
+template struct StreamedBinaryParser<u8s, StreamedMsgpackParser<u8s>>;
+template struct StreamedMsgpackParser<u8s>;
+template struct StreamedBinaryParser<u16s, StreamedMsgpackParser<u16s>>;
+template struct StreamedMsgpackParser<u16s>;
+template struct StreamedBinaryParser<u32s, StreamedMsgpackParser<u32s>>;
+template struct StreamedMsgpackParser<u32s>;
+template struct StreamedBinaryParser<wchar_t, StreamedMsgpackParser<wchar_t>>;
+template struct StreamedMsgpackParser<wchar_t>;
+template SIMJSON_API JsonValueTempl<u8s>::parse_result from_msgpack<u8s>(ssa, const ParseLimits&, std::pmr::memory_resource*);
+template SIMJSON_API JsonValueTempl<u16s>::parse_result from_msgpack<u16s>(ssa, const ParseLimits&, std::pmr::memory_resource*);
+template SIMJSON_API JsonValueTempl<u32s>::parse_result from_msgpack<u32s>(ssa, const ParseLimits&, std::pmr::memory_resource*);
+template SIMJSON_API JsonValueTempl<wchar_t>::parse_result from_msgpack<wchar_t>(ssa, const ParseLimits&, std::pmr::memory_resource*);
+
+} // namespace simjson
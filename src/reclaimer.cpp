@@ -0,0 +1,147 @@
+﻿/*
+ * (c) Проект "SimJson", Александр Орефков orefkov@gmail.com
+ * ver. 1.0
+ * Отложенное уничтожение больших json-деревьев
+ */
+
+#include <simjson/reclaimer.h>
+
+namespace simjson {
+using namespace simstr;
+using namespace simstr::literals;
+
+template<typename K>
+SIMJSON_API JsonReclaimer<K>::JsonReclaimer(bool background) {
+    if (background) {
+        thread_ = std::thread([this] { run(); });
+    }
+}
+
+template<typename K>
+SIMJSON_API JsonReclaimer<K>::~JsonReclaimer() {
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_one();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    drain();
+}
+
+// Владеем ли мы последней ссылкой на объект или массив, тогда его разбор может быть долгим
+// Whether we own the last reference to an object or array, then taking it apart may be slow
+template<typename K>
+static bool ownsContainer(JsonValueTempl<K>& value) {
+    if (value.is_packed()) {
+        // Упакованные значения лежат плоско, разбирать там нечего
+        // Packed values lie flat, there is nothing to take apart
+        return false;
+    }
+    if (value.is_object()) {
+        return value.as_object().use_count() == 1;
+    }
+    if (value.is_array()) {
+        return value.as_array().use_count() == 1;
+    }
+    return false;
+}
+
+template<typename K>
+SIMJSON_API void JsonReclaimer<K>::retire(json_value&& value) {
+    if (!ownsContainer(value)) {
+        json_value drop = std::move(value);
+        return;
+    }
+    {
+        std::lock_guard lock(mutex_);
+        queue_.emplace_back(std::move(value));
+    }
+    wake_.notify_one();
+}
+
+template<typename K>
+SIMJSON_API size_t JsonReclaimer<K>::drain() {
+    std::vector<json_value> batch;
+    {
+        std::lock_guard lock(mutex_);
+        batch.swap(queue_);
+    }
+    size_t freed = 0;
+    for (auto& value : batch) {
+        freed += destroy(std::move(value));
+    }
+    return freed;
+}
+
+template<typename K>
+SIMJSON_API size_t JsonReclaimer<K>::pending() const {
+    std::lock_guard lock(mutex_);
+    return queue_.size();
+}
+
+template<typename K>
+SIMJSON_API size_t JsonReclaimer<K>::destroy(json_value&& value) {
+    // Вложенные объекты и массивы забираем из контейнера в явный стек, тогда сам контейнер
+    // уничтожается без рекурсии - в нём остаются только простые значения
+    // Nested objects and arrays are taken out of the container into an explicit stack, then the container
+    // itself is destroyed without recursion - only simple values are left in it
+    std::vector<json_value> stack;
+    stack.emplace_back(std::move(value));
+    size_t freed = 0;
+    while (!stack.empty()) {
+        json_value item = std::move(stack.back());
+        stack.pop_back();
+        if (!ownsContainer(item)) {
+            continue;
+        }
+        if (item.is_object()) {
+            for (auto& [key, child] : *item.as_object()) {
+                if (child.is_object() || child.is_array()) {
+                    stack.emplace_back(std::move(child));
+                }
+            }
+        } else {
+            for (auto& child : *item.as_array()) {
+                if (child.is_object() || child.is_array()) {
+                    stack.emplace_back(std::move(child));
+                }
+            }
+        }
+        freed++;
+    }
+    return freed;
+}
+
+template<typename K>
+SIMJSON_API JsonReclaimer<K>& JsonReclaimer<K>::background() {
+    static JsonReclaimer reclaimer;
+    return reclaimer;
+}
+
+template<typename K>
+void JsonReclaimer<K>::run() {
+    std::vector<json_value> batch;
+    std::unique_lock lock(mutex_);
+    for (;;) {
+        wake_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+        if (queue_.empty()) {
+            break;
+        }
+        batch.swap(queue_);
+        lock.unlock();
+        for (auto& value : batch) {
+            destroy(std::move(value));
+        }
+        batch.clear();
+        lock.lock();
+    }
+}
+
+template class JsonReclaimer<u8s>;
+template class JsonReclaimer<u16s>;
+template class JsonReclaimer<u32s>;
+template class JsonReclaimer<wchar_t>;
+
+} // namespace simjson
@@ -0,0 +1,159 @@
+﻿/*
+ * (c) Проект "SimJson", Александр Орефков orefkov@gmail.com
+ * ver. 1.0
+ * Общая между потоками неизменяемая копия json с горячей перезагрузкой
+ */
+
+#include <simjson/snapshot.h>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+
+namespace simjson {
+using namespace simstr;
+using namespace simstr::literals;
+
+namespace {
+
+// Признаки изменения файла, проверяются без его чтения
+// Signs of a file change, checked without reading it
+struct file_stamp {
+    std::filesystem::file_time_type time{};
+    uintmax_t size{};
+
+    static file_stamp of(const char* path) {
+        std::error_code ec;
+        file_stamp stamp;
+        stamp.time = std::filesystem::last_write_time(path, ec);
+        stamp.size = std::filesystem::file_size(path, ec);
+        if (ec) {
+            stamp.size = uintmax_t(-1);
+        }
+        return stamp;
+    }
+
+    bool operator==(const file_stamp&) const = default;
+};
+
+bool readFile(const char* path, lstring<u8s, 0, true>& text) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        return false;
+    }
+    std::streamsize size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    return bool(file.read(text.set_size(size), size));
+}
+
+// Полная копия дерева: Clone копирует только сам объект или массив, вложенные копируем сами
+// A full copy of the tree: Clone copies only the object or array itself, nested ones are copied here
+template<typename K>
+JsonValueTempl<K> deepClone(const JsonValueTempl<K>& value) {
+    JsonValueTempl<K> copy = value.clone();
+    if (copy.is_object()) {
+        for (auto& [key, item] : *copy.as_object()) {
+            if (item.is_object() || item.is_array()) {
+                item = deepClone(item);
+            }
+        }
+    } else if (copy.is_array() && !copy.is_packed()) {
+        for (auto& item : *copy.as_array()) {
+            if (item.is_object() || item.is_array()) {
+                item = deepClone(item);
+            }
+        }
+    }
+    return copy;
+}
+
+} // namespace
+
+template<typename K>
+SIMJSON_API JsonSnapshot<K>::~JsonSnapshot() {
+    stop();
+}
+
+template<typename K>
+SIMJSON_API void JsonSnapshot<K>::publish(json_value value) {
+    snapshot next = std::make_shared<const json_value>(std::move(value));
+#ifdef __cpp_lib_atomic_shared_ptr
+    current_.store(std::move(next), std::memory_order_release);
+#else
+    std::atomic_store_explicit(&current_, std::move(next), std::memory_order_release);
+#endif
+    version_.fetch_add(1, std::memory_order_acq_rel);
+}
+
+template<typename K>
+SIMJSON_API JsonParseResult JsonSnapshot<K>::load(stra path, const json_value& defaults) {
+    return loadFile(path, deepClone(defaults));
+}
+
+template<typename K>
+JsonParseResult JsonSnapshot<K>::loadFile(stra path, const json_value& defaults) {
+    lstring<u8s, 0, true> text;
+    if (!readFile(path.c_str(), text)) {
+        return JsonParseResult::Error;
+    }
+    auto [value, err, line, col] = json_value::parse_utf8(text);
+    if (err != JsonParseResult::Success) {
+        return err;
+    }
+    // Новое дерево принадлежит только нам, поэтому дополняем его, а не значения по умолчанию.
+    // Недостающие ключи делят объекты и массивы с defaults - это наша собственная полная копия, её никто не меняет.
+    // The new tree belongs only to us, so we complete it, not the defaults.
+    // Missing keys share objects and arrays with defaults - it is our own full copy, nobody changes it.
+    value.merge(defaults, false);
+    publish(std::move(value));
+    return JsonParseResult::Success;
+}
+
+template<typename K>
+SIMJSON_API JsonParseResult JsonSnapshot<K>::watch(stra path, const json_value& defaults, std::chrono::milliseconds interval) {
+    stop();
+    path_ = path;
+    defaults_ = deepClone(defaults);
+    stop_ = false;
+    // Признаки файла берём до чтения: изменение во время первой загрузки заметит следующая проверка.
+    // Если файл не загрузился, признаков нет, и следующая проверка попробует снова
+    // File signs are taken before reading: a change during the first load is seen by the next check.
+    // If the file did not load, there are no signs, and the next check tries again
+    std::optional<file_stamp> stamp = file_stamp::of(path_.c_str());
+    JsonParseResult res = loadFile(path_, defaults_);
+    if (res != JsonParseResult::Success) {
+        stamp.reset();
+    }
+    thread_ = std::thread([this, interval, stamp]() mutable {
+        std::unique_lock lock(mutex_);
+        while (!wake_.wait_for(lock, interval, [this] { return stop_; })) {
+            lock.unlock();
+            file_stamp now = file_stamp::of(path_.c_str());
+            // При ошибке разбора (например, файл ещё дописывается) пробуем снова на следующей проверке
+            // On a parse error (for example, the file is still being written) try again at the next check
+            if (now != stamp && loadFile(path_, defaults_) == JsonParseResult::Success) {
+                stamp = now;
+            }
+            lock.lock();
+        }
+    });
+    return res;
+}
+
+template<typename K>
+SIMJSON_API void JsonSnapshot<K>::stop() {
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_one();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+template class JsonSnapshot<u8s>;
+template class JsonSnapshot<u16s>;
+template class JsonSnapshot<u32s>;
+template class JsonSnapshot<wchar_t>;
+
+} // namespace simjson
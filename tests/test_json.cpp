@@ -1,12 +1,22 @@
-﻿#include <simjson/json.h>
+﻿#include <simjson/binary.h>
+#include <simjson/cbor.h>
+#include <simjson/json.h>
+#include <simjson/jsonpath.h>
+#include <simjson/msgpack.h>
+#include <simjson/reclaimer.h>
+#include <simjson/snapshot.h>
 #include <gtest/gtest.h>
 #include <chrono>
 #include <cstddef>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <memory_resource>
 #include <array>
 #include <list>
+#include <thread>
 
 namespace simjson::tests {
 
@@ -517,6 +527,1194 @@ TEST(SimJson, ManyKeys) {
     EXPECT_EQ(v.as_integer(), 10);
 }
 
+struct EncodeItem {
+    int id;
+    stringa name;
+    std::optional<double> price;
+    std::vector<int> tags;
+
+    template<typename E>
+    void json_fields(E& e) const {
+        e("id"_jk, id)("name"_jk, name)("price"_jk, price)("tags"_jk, tags);
+    }
+};
+
+struct EncodeResponse {
+    bool ok;
+    std::vector<EncodeItem> items;
+    std::map<stringa, int> counters;
+
+    template<typename E>
+    void json_fields(E& e) const {
+        e("ok"_jk, ok)("items"_jk, items)("cnt\n"_jk, counters)("null"_jk, Json::null);
+    }
+};
+
+TEST(SimJson, JsonEncoder) {
+    EncodeResponse resp{true, {{1, "one", 1.5, {1, 2}}, {2, "t\"wo", {}, {}}}, {{"a", 1}, {"b", 2}}};
+    EXPECT_EQ(to_json(resp), R"({"ok":true,"items":[{"id":1,"name":"one","price":1.5,"tags":[1,2]},)"
+        R"({"id":2,"name":"t\"wo","price":null,"tags":[]}],"cnt\n":{"a":1,"b":2},"null":null})");
+
+    std::vector<std::optional<int>> vals = {1, {}, 3};
+    EXPECT_EQ(to_json<u16s>(vals), u"[1,null,3]");
+
+    JsonValue json = {{"a"_h, 1}};
+    lstring<u8s, 0, true> res;
+    JsonEncoder<u8s>{res}.value(std::vector<JsonValue>{json, json});
+    EXPECT_EQ(res, R"([{"a":1},{"a":1}])");
+}
+
+TEST(SimJson, JsonKeySet) {
+    using Keys = JsonKeySet<u8s, "type", "id", "ts", "payload">;
+    static_assert(Keys::index<"type"> == 0 && Keys::index<"payload"> == 3);
+
+    EXPECT_EQ(Keys::index_of("id"), Keys::index<"id">);
+    EXPECT_EQ(Keys::index_of("ts"), Keys::index<"ts">);
+    EXPECT_EQ(Keys::index_of("tz"), Keys::npos);
+    EXPECT_EQ(Keys::index_of(""), Keys::npos);
+
+    auto [json, res, l, c] = JsonValue::parse(R"({"id": 10, "extra": true, "type": "msg", "ts": 1.5})");
+    ASSERT_EQ(res, JsonParseResult::Success);
+    auto fields = Keys::extract(json);
+    ASSERT_TRUE(fields[Keys::index<"type">]);
+    EXPECT_EQ(fields[Keys::index<"type">]->as_text(), "msg");
+    ASSERT_TRUE(fields[Keys::index<"id">]);
+    EXPECT_EQ(fields[Keys::index<"id">]->as_integer(), 10);
+    ASSERT_TRUE(fields[Keys::index<"ts">]);
+    EXPECT_EQ(fields[Keys::index<"ts">]->as_real(), 1.5);
+    EXPECT_FALSE(fields[Keys::index<"payload">]);
+
+    using KeysU = JsonKeySet<u16s, "a", "b">;
+    EXPECT_EQ(KeysU::index_of(u"b"), 1);
+    EXPECT_EQ(KeysU::index_of(u"c"), KeysU::npos);
+}
+
+TEST(SimJson, ParseLimits) {
+    {
+        auto [json, res, l, c] = JsonValue::parse("[[[1]]]", {.max_depth = 3});
+        EXPECT_EQ(res, JsonParseResult::Success);
+    }
+    {
+        auto [json, res, l, c] = JsonValue::parse("[[[[1]]]]", {.max_depth = 3});
+        EXPECT_EQ(res, JsonParseResult::LimitExceeded);
+    }
+    {
+        auto [json, res, l, c] = JsonValue::parse(R"({"a":{"b":{"c":[]}}})", {.max_depth = 3});
+        EXPECT_EQ(res, JsonParseResult::LimitExceeded);
+    }
+    {
+        auto [json, res, l, c] = JsonValue::parse(R"(["12345", "123456"])", {.max_string_length = 5});
+        EXPECT_EQ(res, JsonParseResult::LimitExceeded);
+    }
+    {
+        auto [json, res, l, c] = JsonValue::parse(R"([1, 2, 3])", {.max_values = 3});
+        EXPECT_EQ(res, JsonParseResult::LimitExceeded);
+    }
+    {
+        auto [json, res, l, c] = JsonValue::parse(R"([1, 2, 3])", {.max_values = 4});
+        EXPECT_EQ(res, JsonParseResult::Success);
+    }
+    {
+        auto [json, res, l, c] = JsonValue::parse(R"(["aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"])", {.max_bytes = 64});
+        EXPECT_EQ(res, JsonParseResult::LimitExceeded);
+    }
+    {
+        StreamedJsonParser<u8s> parser;
+        parser.limits_.max_string_length = 8;
+        EXPECT_EQ(parser.processChunk(R"(["12345)", false), JsonParseResult::Pending);
+        EXPECT_EQ(parser.processChunk(R"(67890)", false), JsonParseResult::LimitExceeded);
+        EXPECT_EQ(parser.processChunk(R"("])", true), JsonParseResult::LimitExceeded);
+        parser.reset();
+        EXPECT_EQ(parser.limits_.max_string_length, 8);
+        EXPECT_EQ(parser.processChunk(R"(["1234)", false), JsonParseResult::Pending);
+        EXPECT_EQ(parser.processChunk(R"(5"])", true), JsonParseResult::Success);
+    }
+}
+
+struct CountingResource : std::pmr::memory_resource {
+    size_t allocs{};
+    size_t bytes{};
+
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        allocs++;
+        this->bytes += bytes;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        this->bytes -= bytes;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+TEST(SimJson, ParseWithMemoryResource) {
+    CountingResource res;
+    {
+        auto [json, err, l, c] = JsonValue::parse(R"({"a": [1, 2, [3, 4]], "b": {"c": []}})", {}, &res);
+        ASSERT_EQ(err, JsonParseResult::Success);
+        EXPECT_GE(res.allocs, 5);
+        EXPECT_EQ(json("a"_h, 2, 1).as_integer(), 4);
+        EXPECT_EQ(json.store(false, true), R"({"a":[1,2,[3,4]],"b":{"c":[]}})");
+
+        JsonValue copy(JsonValue::Clone{json("a"_h), &res});
+        EXPECT_EQ(copy.store(), "[1,2,[3,4]]");
+        EXPECT_NE(copy.as_array().get(), json("a"_h).as_array().get());
+
+        // Из источника берётся сам массив, его элементы - только при SIMJSON_PMR_ARRAYS
+        JsonValue arr(Json::Array, &res);
+        size_t allocs = res.allocs;
+        EXPECT_GT(allocs, 0);
+        arr[-1] = 1;
+        if constexpr (SIMJSON_PMR_ARRAYS != 0) {
+            EXPECT_GT(res.allocs, allocs);
+        } else {
+            EXPECT_EQ(res.allocs, allocs);
+        }
+
+        // Упакованные массивы, их распаковка и клоны возвращают всю память источнику
+        ParseLimits limits;
+        limits.packed_arrays = true;
+        JsonValue packed = JsonValue::parse("[[1, 2, 3], [1.5], [true]]", limits, &res).value;
+        EXPECT_TRUE(packed.at(0).is_packed());
+        EXPECT_EQ(packed.at(0).at(2).as_integer(), 3);
+        JsonValue packedCopy(JsonValue::Clone{packed.at(1), &res});
+        EXPECT_TRUE(packedCopy.is_packed());
+        packed[2][1] = false;
+        EXPECT_EQ(packed.store(), "[[1,2,3],[1.5],[true,false]]");
+    }
+    EXPECT_EQ(res.bytes, 0);
+}
+
+TEST(SimJson, ParseUtf8ToWide) {
+    {
+        auto [json, err, l, c] = JsonValueU::parse_utf8(R"({"name": "Привет, мир", "list": [1, 2.5, "ascii text", "\u0416\ud83d\ude00"], "ok": true})");
+        ASSERT_EQ(err, JsonParseResult::Success);
+        EXPECT_EQ(json(u"name").as_text(), u"Привет, мир");
+        EXPECT_EQ(json(u"list", 1).as_real(), 2.5);
+        EXPECT_EQ(json(u"list", 2).as_text(), u"ascii text");
+        EXPECT_EQ(json(u"list", 3).as_text(), u"Ж😀");
+        EXPECT_EQ(json.store_utf8(false, true), R"({"list":[1,2.5,"ascii text","Ж😀"],"name":"Привет, мир","ok":true})");
+    }
+    {
+        auto [json, err, l, c] = JsonValueW::parse_utf8(R"(["Ключ", "key"])");
+        ASSERT_EQ(err, JsonParseResult::Success);
+        EXPECT_EQ(json(0).as_text(), L"Ключ");
+        EXPECT_EQ(json.store_utf8(), R"(["Ключ","key"])");
+    }
+    {
+        StreamedJsonParser<u32s, u8s> parser;
+        EXPECT_EQ(parser.processChunk(R"({"текст": "длинн)", false), JsonParseResult::Pending);
+        EXPECT_EQ(parser.processChunk(R"(ая строка\n"})", true), JsonParseResult::Success);
+        EXPECT_EQ(parser.result_(U"текст").as_text(), U"длинная строка\n");
+    }
+}
+
+TEST(SimJson, ValidateUtf8) {
+    ParseLimits check{.validate_utf8 = true};
+    {
+        auto [json, err, l, c] = JsonValue::parse(R"({"ключ": "значение 😀"})", check);
+        EXPECT_EQ(err, JsonParseResult::Success);
+    }
+    // избыточная форма, суррогат, больше U+10FFFF, оборванная последовательность, недопустимый байт в ключе
+    for (ssa bad : std::initializer_list<ssa>{"[\"\xC0\xAF\"]", "[\"\xED\xA0\x80\"]", "[\"\xF4\x90\x80\x80\"]",
+            "[\"ab\xE2\x82\"]", "{\"\xFF\": 1}"}) {
+        auto [json, err, l, c] = JsonValue::parse(bad, check);
+        EXPECT_EQ(err, JsonParseResult::Error);
+        EXPECT_EQ(JsonValue::parse(bad).err, JsonParseResult::Success);
+    }
+    {
+        StreamedJsonParser<u8s> parser;
+        parser.limits_.validate_utf8 = true;
+        // "€" = E2 82 AC, разрезан между порциями
+        EXPECT_EQ(parser.processChunk("[\"\xE2\x82", false), JsonParseResult::Pending);
+        EXPECT_EQ(parser.processChunk("\xAC\"]", true), JsonParseResult::Success);
+        EXPECT_EQ(parser.result_(0).as_text(), "€");
+        parser.reset();
+        EXPECT_EQ(parser.processChunk("[\"\xE2\x82", false), JsonParseResult::Pending);
+        EXPECT_EQ(parser.processChunk("\"]", true), JsonParseResult::Error);
+    }
+}
+
+TEST(SimJson, JsonTokenReader) {
+    {
+        JsonTokenReader<u8s> reader;
+        reader.feed(R"({"id": 12, "name": "a\"b\u0416", "tags": [true, null, -1.5e2], "skip": {"x": [1, {"y": 2}]}, "last": "z"})", true);
+        EXPECT_EQ(reader.next(), JsonToken::StartObject);
+        EXPECT_EQ(reader.depth(), 1);
+        EXPECT_EQ(reader.next(), JsonToken::Key);
+        EXPECT_EQ(reader.text(), "id");
+        EXPECT_EQ(reader.next(), JsonToken::Integer);
+        EXPECT_EQ(reader.integer(), 12);
+        EXPECT_EQ(reader.next(), JsonToken::Key);
+        EXPECT_EQ(reader.next(), JsonToken::String);
+        EXPECT_EQ(reader.text(), "a\"bЖ");
+        EXPECT_EQ(reader.next(), JsonToken::Key);
+        EXPECT_EQ(reader.next(), JsonToken::StartArray);
+        EXPECT_EQ(reader.depth(), 2);
+        EXPECT_EQ(reader.next(), JsonToken::True);
+        EXPECT_EQ(reader.next(), JsonToken::Null);
+        EXPECT_EQ(reader.next(), JsonToken::Real);
+        EXPECT_EQ(reader.real(), -150.0);
+        EXPECT_EQ(reader.next(), JsonToken::EndArray);
+        EXPECT_EQ(reader.next(), JsonToken::Key);
+        EXPECT_EQ(reader.text(), "skip");
+        EXPECT_EQ(reader.skip_value(), JsonToken::EndObject);
+        EXPECT_EQ(reader.depth(), 1);
+        EXPECT_EQ(reader.next(), JsonToken::Key);
+        EXPECT_EQ(reader.text(), "last");
+        EXPECT_EQ(reader.next(), JsonToken::String);
+        EXPECT_EQ(reader.next(), JsonToken::EndObject);
+        EXPECT_EQ(reader.next(), JsonToken::End);
+    }
+    {
+        // Подаём текст по одному символу
+        JsonTokenReader<u16s> reader;
+        ssu text = uR"([123, "текст\n", {"k": false}, [[]]])";
+        std::vector<JsonToken> tokens;
+        std::vector<stringu> texts;
+        for (size_t i = 0; i < text.length() && (tokens.empty() || tokens.back() != JsonToken::End); i++) {
+            reader.feed(ssu{text.begin() + i, 1}, i + 1 == text.length());
+            for (;;) {
+                JsonToken token = reader.next();
+                if (token == JsonToken::NeedMore || token == JsonToken::End || token == JsonToken::Error) {
+                    if (token != JsonToken::NeedMore) {
+                        tokens.push_back(token);
+                    }
+                    break;
+                }
+                tokens.push_back(token);
+                if (token == JsonToken::String || token == JsonToken::Key || token == JsonToken::Integer) {
+                    texts.emplace_back(reader.text());
+                }
+            }
+        }
+        EXPECT_EQ(tokens, (std::vector<JsonToken>{JsonToken::StartArray, JsonToken::Integer, JsonToken::String, JsonToken::StartObject,
+            JsonToken::Key, JsonToken::False, JsonToken::EndObject, JsonToken::StartArray, JsonToken::StartArray, JsonToken::EndArray,
+            JsonToken::EndArray, JsonToken::EndArray, JsonToken::End}));
+        ASSERT_EQ(texts.size(), 3);
+        EXPECT_EQ(texts[0], u"123");
+        EXPECT_EQ(texts[1], u"текст\n");
+        EXPECT_EQ(texts[2], u"k");
+    }
+    for (ssa bad : std::initializer_list<ssa>{"[1,]", "{\"a\" 1}", "[tru]", "[01]", "[\"\\x\"]", "[1] 2", "[1.]"}) {
+        JsonTokenReader<u8s> reader;
+        reader.feed(bad, true);
+        JsonToken token;
+        while ((token = reader.next()) != JsonToken::Error && token != JsonToken::End) {}
+        EXPECT_EQ(token, JsonToken::Error) << bad;
+    }
+}
+
+TEST(SimJson, StreamItems) {
+    {
+        StreamedJsonParser<u8s> parser;
+        std::vector<int64_t> ids;
+        parser.streamItems("$", [&](JsonValue& item) {
+            EXPECT_EQ(parser.result_.as_array()->size(), 1);
+            ids.push_back(item("id"_h).as_integer());
+            return true;
+        });
+        EXPECT_EQ(parser.processChunk(R"([{"id": 1, "v": [1, 2]}, {"i)", false), JsonParseResult::Pending);
+        EXPECT_EQ(parser.processChunk(R"(d": 2}, {"id": 3}])", true), JsonParseResult::Success);
+        EXPECT_EQ(ids, (std::vector<int64_t>{1, 2, 3}));
+        EXPECT_EQ(parser.result_.as_array()->size(), 0);
+    }
+    {
+        StreamedJsonParser<u8s> parser;
+        std::vector<JsonValue> items;
+        parser.streamItems("$.data", [&](JsonValue& item) {
+            items.emplace_back(std::move(item));
+            return true;
+        });
+        EXPECT_EQ(parser.parseAll(R"({"other": [0, 0], "data": [1, "two", [3], {"data": [4]}], "total": 4})"), JsonParseResult::Success);
+        ASSERT_EQ(items.size(), 4);
+        EXPECT_EQ(items[1].as_text(), "two");
+        EXPECT_EQ(items[3].store(), R"({"data":[4]})");
+        EXPECT_EQ(parser.result_.store(false, true), R"({"data":[],"other":[0,0],"total":4})");
+    }
+    {
+        StreamedJsonParser<u8s> parser;
+        size_t count = 0;
+        parser.streamItems("$", [&](JsonValue&) {
+            return ++count < 2;
+        });
+        EXPECT_EQ(parser.parseAll("[1, 2, 3, 4]"), JsonParseResult::NoNeedMore);
+        EXPECT_EQ(count, 2);
+        count = 0;
+        parser.reset();
+        EXPECT_EQ(parser.parseAll("[1, ]"), JsonParseResult::Error);
+        count = 0;
+        parser.reset();
+        EXPECT_EQ(parser.parseAll("[]"), JsonParseResult::Success);
+        EXPECT_EQ(count, 0);
+    }
+    {
+        // Ограничение памяти считается на один элемент
+        StreamedJsonParser<u8s> parser;
+        parser.limits_.max_bytes = 1024;
+        parser.streamItems("$", [](JsonValue&) { return true; });
+        lstringa<0> text = "[";
+        for (int i = 0; i < 1000; i++) {
+            text += i ? ",[1,2,3]" : "[1,2,3]";
+        }
+        text += "]";
+        EXPECT_EQ(parser.parseAll(text), JsonParseResult::Success);
+    }
+}
+
+TEST(SimJson, ParseProjection) {
+    ssa text = R"({
+        "id": 42,
+        "skip": {"a": [1, "x]}\"", {"b": null}], "c": "Ж"},
+        "meta": {"host": "h1", "tags": ["t1", "t2"], "big": [1, 2, 3]},
+        "items": [{"name": "n1", "value": 1.5}, {"value": 2, "name": "n2"}, 7],
+        "a/b": true,
+        "tail": "z"
+    })";
+    JsonProjection<u8s> projection{"/id", "/meta/tags", "/items/name", "/a~1b"};
+    auto [json, err, l, c] = JsonValue::parse(text, projection);
+    ASSERT_EQ(err, JsonParseResult::Success);
+    EXPECT_EQ(json.store(false, true), R"({"a/b":true,"id":42,"items":[{"name":"n1"},{"name":"n2"},7],"meta":{"tags":["t1","t2"]}})");
+
+    auto [all, err2, l2, c2] = JsonValue::parse(text, JsonProjection<u8s>{""});
+    ASSERT_EQ(err2, JsonParseResult::Success);
+    EXPECT_EQ(all.store(false, true), JsonValue::parse(text).value.store(false, true));
+
+    // По порциям, с разрезами внутри пропускаемых значений
+    StreamedJsonParser<u8s> parser;
+    parser.projection_ = &projection;
+    JsonParseResult res = JsonParseResult::Pending;
+    for (size_t i = 0; i < text.length(); i += 7) {
+        res = parser.processChunk(ssa{text.begin() + i, std::min<size_t>(7, text.length() - i)}, i + 7 >= text.length());
+    }
+    EXPECT_EQ(res, JsonParseResult::Success);
+    EXPECT_EQ(parser.result_.store(false, true), json.store(false, true));
+
+    // Пропускаемые значения тоже проверяются
+    for (const char* broken : {R"({"a":,"id":1})", R"({"a":}")", R"({"a":x1,"id":1})", R"({"a":1#,"id":1})",
+            R"({"a":[1,,2],"id":1})", R"({"a":[1 2],"id":1})", R"({"a":{"b" 1},"id":1})", R"({"a":{"b":1,},"id":1})",
+            R"({"a":{1:2},"id":1})", R"({"a":[1},"id":1})", R"({"a":{"b":[}]},"id":1})", R"({"a":[@],"id":1})"}) {
+        EXPECT_EQ(JsonValue::parse(ssa{broken, std::strlen(broken)}, projection).err, JsonParseResult::Error) << broken;
+    }
+    EXPECT_EQ(JsonValue::parse(R"({"a":{"b":[],"c":{},"d":[1,-2.5e+3,true,null,"s"]},"id":1})", projection).value.store(), R"({"id":1})");
+    // Ограничение вложенности одинаково с проекцией и без неё
+    ssa deep = R"({"a":[[[{"b":1}]]],"id":1})";
+    EXPECT_EQ(JsonValue::parse(deep, {.max_depth = 4}).err, JsonParseResult::LimitExceeded);
+    EXPECT_EQ(JsonValue::parse(deep, projection, {.max_depth = 4}).err, JsonParseResult::LimitExceeded);
+    EXPECT_EQ(JsonValue::parse(deep, {.max_depth = 5}).err, JsonParseResult::Success);
+    EXPECT_EQ(JsonValue::parse(deep, projection, {.max_depth = 5}).err, JsonParseResult::Success);
+}
+
+TEST(SimJson, RawNumbers) {
+    ssa text = R"({"id":18446744073709551615,"big":-9223372036854775809,"n":-12,"pi":3.14159265358979323846,"e":1.0E+2})";
+    auto [json, err, l, c] = JsonValue::parse(text, {.raw_numbers = true});
+    ASSERT_EQ(err, JsonParseResult::Success);
+    EXPECT_EQ(json.store(false, true), R"({"big":-9223372036854775809,"e":1.0E+2,"id":18446744073709551615,"n":-12,"pi":3.14159265358979323846})");
+
+    EXPECT_TRUE(json("id"_h).is_real());
+    EXPECT_EQ(*json("id"_h).number_uint(), 18446744073709551615ull);
+    EXPECT_EQ(*json("id"_h).raw_number(), "18446744073709551615");
+    EXPECT_FALSE(json("big"_h).number_uint());
+    EXPECT_TRUE(json("n"_h).is_integer());
+    EXPECT_EQ(json("n"_h).as_integer(), -12);
+    EXPECT_FALSE(json("n"_h).number_uint());
+    EXPECT_EQ(json("e"_h).number_int(), 100);
+    EXPECT_EQ(json("e"_h).to_text(), "100");
+    EXPECT_NEAR(json("pi"_h).as_real(), 3.14159, 0.0001);
+    EXPECT_TRUE(json("pi"_h).to_boolean());
+
+    // Копирование, перемещение и присвоение сохраняют текст числа
+    JsonValue copy = json("id"_h);
+    JsonValue moved = std::move(copy);
+    EXPECT_EQ(moved.store(), "18446744073709551615");
+    moved = 5;
+    EXPECT_FALSE(moved.raw_number());
+    EXPECT_EQ(moved.store(), "5");
+
+    auto [eager, err2, l2, c2] = JsonValue::parse(text);
+    EXPECT_FALSE(eager("id"_h).raw_number());
+    EXPECT_EQ(eager("n"_h).as_integer(), -12);
+}
+
+TEST(SimJson, StoreCanonical) {
+    // Пример из RFC 8785
+    auto [json, err, l, c] = JsonValue::parse(R"({
+        "numbers": [333333333.33333329, 1E30, 4.50, 2e-3, 0.000000000000000000000000001],
+        "string": "\u20ac$\u000F\u000aA'\u0042\u0022\u005c\\\"\/",
+        "literals": [null, true, false]
+    })");
+    ASSERT_EQ(err, JsonParseResult::Success);
+    EXPECT_EQ(json.store_canonical(), R"({"literals":[null,true,false],"numbers":[333333333.3333333,1e+30,4.5,0.002,1e-27],"string":"€$\u000f\nA'B\"\\\\\"/"})");
+
+    // Порядок ключей по кодовым единицам UTF-16
+    auto [keys, err2, l2, c2] = JsonValue::parse(R"({"\u20ac": 1, "\r": 2, "\ufb33": 3, "1": 4, "\ud83d\ude00": 5, "\u0080": 6, "\u00f6": 7, "long key 2": 8, "long key 1": 9})");
+    ASSERT_EQ(err2, JsonParseResult::Success);
+    EXPECT_EQ(keys.store_canonical(), "{\"\\r\":2,\"1\":4,\"long key 1\":9,\"long key 2\":8,\"\u0080\":6,\"ö\":7,\"€\":1,\"😀\":5,\"\ufb33\":3}");
+
+    JsonValueU wide = JsonValueU::parse_utf8(R"({"b": [1e21, 1e-7, -0.0, 123456789012345678, 100, 0.1], "a": {"דּ": 1, "😀": 2}})").value;
+    EXPECT_EQ(wide.store_canonical(), R"({"a":{"😀":2,"דּ":1},"b":[1e+21,1e-7,0,123456789012345680,100,0.1]})");
+}
+
+TEST(SimJson, ParserReuse) {
+    StreamedJsonParser<u8s> parser;
+    parser.limits_.max_depth = 3;
+    EXPECT_EQ(parser.processChunk(R"({"a": "\u00)", false), JsonParseResult::Pending);
+    parser.reset();
+    EXPECT_EQ(parser.limits_.max_depth, 3);
+    EXPECT_EQ(parser.parseAll(R"({"b": [1, "\u0041"]})"), JsonParseResult::Success);
+    EXPECT_EQ(parser.result_.store(), R"({"b":[1,"A"]})");
+    parser.reset();
+    EXPECT_EQ(parser.parseAll("[[[[1]]]]"), JsonParseResult::LimitExceeded);
+    parser.reset();
+    EXPECT_EQ(parser.parseAll("\n\n[1, ]"), JsonParseResult::Error);
+    EXPECT_EQ(parser.line_, 2);
+    parser.resetAll();
+    EXPECT_EQ(parser.parseAll("[[[[1]]]]"), JsonParseResult::Success);
+    EXPECT_EQ(parser.line_, 0);
+
+    // Парсер потока повторно используется, вложенный разбор получает отдельный парсер
+    PooledJsonParser<u8s> outer;
+    StreamedJsonParser<u8s>* first = &*outer;
+    {
+        PooledJsonParser<u8s> inner;
+        EXPECT_NE(&*inner, first);
+        EXPECT_EQ(inner->parseAll("[2]"), JsonParseResult::Success);
+    }
+    EXPECT_EQ(outer->parseAll("[1]"), JsonParseResult::Success);
+    outer->limits_.max_values = 1;
+    for (int i = 0; i < 3; i++) {
+        auto [json, err, l, c] = JsonValue::parse(R"({"x": [1, 2, 3]})");
+        ASSERT_EQ(err, JsonParseResult::Success);
+        EXPECT_EQ(json("x"_h)[2].as_integer(), 3);
+    }
+    EXPECT_EQ(outer->result_.store(), "[1]");
+
+    // После большого текста парсер отдаёт лишнюю память
+    struct ShrinkProbe : StreamedJsonParser<u8s> {
+        using StreamedJsonParser<u8s>::stack_;
+    } probe;
+    std::string deep(1000, '[');
+    deep += "\"" + std::string(10000, 'x') + "\\n\"";
+    deep.append(1000, ']');
+    EXPECT_EQ(probe.parseAll(ssa{deep.data(), deep.size()}), JsonParseResult::Success);
+    EXPECT_EQ(probe.result_.store().length(), deep.length());
+    probe.reset();
+    EXPECT_GT(probe.stack_.capacity() * sizeof(void*), 4096);
+    probe.shrink(4096);
+    EXPECT_LE(probe.stack_.capacity() * sizeof(void*), 4096);
+    EXPECT_EQ(probe.parseAll(ssa{deep.data(), deep.size()}), JsonParseResult::Success);
+    EXPECT_EQ(probe.result_.store().length(), deep.length());
+}
+
+TEST(SimJson, StoreLength) {
+    auto [json, err, l, c] = JsonValue::parse(R"({"a": [1, -2.5, "x\ny\u0001", [], {}, [null, true, false]],
+        "b": {"c": {"d": "\"q\""}, "e": []}, "n": 123, "": ""})");
+    ASSERT_EQ(err, JsonParseResult::Success);
+    json["u"_h] = Json::null;
+    json["u"_h] = JsonValue{};
+    for (bool prettify : {false, true}) {
+        for (unsigned indent : {0u, 2u, 4u}) {
+            stringa text = json.store(prettify, true, ' ', indent);
+            EXPECT_EQ(json.store_length(prettify, indent), text.length());
+            lstring<u8s, 0, true> buffer = "prefix";
+            json.store(buffer, prettify, false, '\t', indent);
+            EXPECT_EQ(buffer.length(), 6 + text.length());
+        }
+    }
+    EXPECT_EQ(JsonValue{}.store_length(), 0);
+    EXPECT_EQ(JsonValue("text").store_length(), 6);
+    EXPECT_EQ(json.store(false, true), R"({"":"","a":[1,-2.5,"x\ny\u0001",[],{},[null,true,false]],"b":{"c":{"d":"\"q\""},"e":[]},"n":123})");
+
+    JsonValueU wide = JsonValueU::parse_utf8(R"({"ключ": ["значение", 1]})").value;
+    EXPECT_EQ(wide.store_utf8(true), "{\n  \"ключ\": [\n    \"значение\",\n    1\n  ]\n}");
+
+    // Оценка длины меньше результата: экранирование и перекодирование расширяют буфер по ходу записи
+    std::string escaped = "[\"";
+    for (int i = 0; i < 200; i++) {
+        escaped += "\\n\\u0001";
+    }
+    escaped += "\",-9223372036854775808,1e+300]";
+    JsonValue many = JsonValue::parse(ssa{escaped.data(), escaped.size()}).value;
+    stringa stored = many.store();
+    EXPECT_EQ(std::string(stored.symbols(), stored.length()), escaped);
+    EXPECT_EQ(many.store_length(), escaped.length());
+    JsonValueU cyrillic = JsonValueU::parse_utf8(R"(["жжжжжжжжжжжжжжжжжжжжжжжжжжжжжж"])").value;
+    EXPECT_EQ(cyrillic.store_utf8(), R"(["жжжжжжжжжжжжжжжжжжжжжжжжжжжжжж"])");
+}
+
+TEST(SimJson, PackedArrays) {
+    stringa text = R"({"i":[1,-2,3],"r":[1.5,-2.25],"b":[true,false],"m":[1,2.5],"s":["a"],"e":[],"n":[[1],[2]]})";
+    ParseLimits limits;
+    limits.packed_arrays = true;
+    auto [json, err, l, c] = JsonValue::parse(text, limits);
+    ASSERT_EQ(err, JsonParseResult::Success);
+    JsonValue plain = JsonValue::parse(text).value;
+
+    EXPECT_TRUE(json("i"_h).is_packed());
+    EXPECT_TRUE(json("r"_h).is_packed());
+    EXPECT_TRUE(json("b"_h).is_packed());
+    EXPECT_FALSE(json("m"_h).is_packed());
+    EXPECT_FALSE(json("s"_h).is_packed());
+    EXPECT_FALSE(json("e"_h).is_packed());
+    EXPECT_FALSE(json("n"_h).is_packed());
+    EXPECT_TRUE(json("n"_h)[1].is_packed());
+
+    auto ints = json("i"_h).as_span<int64_t>();
+    EXPECT_EQ(std::vector<int64_t>(ints.begin(), ints.end()), (std::vector<int64_t>{1, -2, 3}));
+    EXPECT_EQ(json("r"_h).as_span<double>()[1], -2.25);
+    EXPECT_EQ(json("b"_h).as_span<uint8_t>()[0], 1);
+    EXPECT_TRUE(json("i"_h).as_span<double>().empty());
+    EXPECT_TRUE(plain("i"_h).as_span<int64_t>().empty());
+    EXPECT_EQ(json("i"_h).size(), 3);
+
+    for (bool prettify : {false, true}) {
+        EXPECT_EQ(json.store(prettify, true), plain.store(prettify, true));
+        EXPECT_EQ(json.store_length(prettify), plain.store_length(prettify));
+    }
+    EXPECT_EQ(json.store_canonical(), plain.store_canonical());
+
+    // Чтение через обычный API не распаковывает массив
+    const JsonValue& cjson = json;
+    EXPECT_EQ(cjson("i"_h)[1].as_integer(), -2);
+    EXPECT_EQ(cjson("b"_h)[1].as_boolean(), false);
+    EXPECT_TRUE(cjson("i"_h)[3].is_undefined());
+    EXPECT_EQ(cjson("r"_h).value_at(0).as_real(), 1.5);
+    EXPECT_EQ(cjson("i"_h).to_text(), "1,-2,3");
+    EXPECT_TRUE(cjson("i"_h).is_packed());
+
+    // Ссылки на элементы постоянны, сколько бы обращений ни было после
+    const JsonValue& second = cjson("i"_h)[1];
+    for (int i = 0; i < 100; i++) {
+        EXPECT_EQ(cjson("i"_h).at(i % 3).as_integer(), i % 3 == 1 ? -2 : (i % 3 ? 3 : 1));
+    }
+    EXPECT_EQ(&second, &cjson("i"_h)[1]);
+    EXPECT_EQ(second.as_integer(), -2);
+    int64_t sum = 0;
+    for (const auto& item : *cjson("i"_h).as_array()) {
+        sum += item.as_integer();
+    }
+    EXPECT_EQ(sum, 2);
+    EXPECT_TRUE(cjson("i"_h).is_packed());
+
+    // Изменение распаковывает только своё значение, копии и их span не затронуты
+    JsonValue copy = json("i"_h);
+    JsonValue clone(JsonValue::Clone{json("i"_h)});
+    EXPECT_TRUE(clone.is_packed());
+    copy[3] = 4;
+    EXPECT_FALSE(copy.is_packed());
+    EXPECT_EQ(copy.store(), "[1,-2,3,4]");
+    EXPECT_TRUE(json("i"_h).is_packed());
+    EXPECT_EQ(json("i"_h).store(), "[1,-2,3]");
+    EXPECT_EQ(ints[2], 3);
+    EXPECT_EQ(clone.store(), "[1,-2,3]");
+    EXPECT_TRUE(clone.unpack());
+    EXPECT_FALSE(clone.unpack());
+    EXPECT_EQ(clone.as_array()->size(), 3);
+    JsonValue merged = plain("i"_h);
+    merged.merge(json("r"_h), false, true);
+    EXPECT_EQ(merged.store(), "[1,-2,3,1.5,-2.25]");
+
+    JsonValue made = {1.0, 2.0, 3.5};
+    EXPECT_TRUE(made.pack());
+    EXPECT_EQ(made.as_span<double>().size(), 3);
+    // Распаковка забирает уже построенные элементы, выданные на них ссылки остаются действительными
+    const JsonValue& last = std::as_const(made)[2];
+    EXPECT_TRUE(made.unpack());
+    EXPECT_EQ(&last, &made.at(2));
+    EXPECT_TRUE(made.pack());
+    // Неконстантный as_array распаковывает
+    made.as_array()->emplace_back(4.5);
+    EXPECT_FALSE(made.is_packed());
+    EXPECT_EQ(made.store(), "[1,2,3.5,4.5]");
+    JsonValue other = {1, 2};
+    JsonValue ref = other;
+    EXPECT_FALSE(other.pack());
+
+    limits.raw_numbers = true;
+    EXPECT_FALSE(JsonValue::parse("[1, 2]", limits).value.is_packed());
+}
+
+TEST(SimJson, ToColumns) {
+    auto [json, err, l, c] = JsonValue::parse(R"([
+        {"a": 1, "b": "x", "c": true, "d": 1},
+        {"a": 2, "b": null, "c": false, "d": 2.5, "e": [1]},
+        5,
+        {"a": 3, "b": "yz", "d": 3, "c": 1, "f": null}
+    ])");
+    ASSERT_EQ(err, JsonParseResult::Success);
+    JsonColumns<u8s> cols = json.to_columns();
+    EXPECT_EQ(cols.rows(), 4);
+    EXPECT_EQ(cols.columns.size(), 6);
+
+    const JsonColumn<u8s>* a = cols.find("a");
+    ASSERT_NE(a, nullptr);
+    EXPECT_EQ(a->type, Json::Integer);
+    EXPECT_EQ(a->integers, (std::vector<int64_t>{1, 2, 0, 3}));
+    EXPECT_EQ(a->null_count, 1);
+    EXPECT_EQ(a->validity, (std::vector<uint8_t>{0b1011}));
+
+    const JsonColumn<u8s>* b = cols.find("b");
+    EXPECT_EQ(b->type, Json::Text);
+    EXPECT_EQ(b->offsets, (std::vector<int64_t>{0, 1, 1, 1, 3}));
+    EXPECT_EQ(b->text(3), "yz");
+    EXPECT_FALSE(b->is_valid(1));
+
+    // Логические и целые дают текст
+    const JsonColumn<u8s>* flags = cols.find("c");
+    EXPECT_EQ(flags->type, Json::Text);
+    EXPECT_EQ(flags->text(0), "true");
+    EXPECT_EQ(flags->text(1), "false");
+    EXPECT_EQ(flags->text(3), "1");
+
+    // Целые и вещественные дают вещественные
+    const JsonColumn<u8s>* d = cols.find("d");
+    EXPECT_EQ(d->type, Json::Real);
+    EXPECT_EQ(d->reals, (std::vector<double>{1, 2.5, 0, 3}));
+
+    const JsonColumn<u8s>* e = cols.find("e");
+    EXPECT_EQ(e->type, Json::Text);
+    EXPECT_EQ(e->text(1), "[1]");
+    EXPECT_EQ(e->null_count, 3);
+
+    const JsonColumn<u8s>* f = cols.find("f");
+    EXPECT_EQ(f->type, Json::Null);
+    EXPECT_EQ(f->null_count, 4);
+    EXPECT_EQ(cols.find("g"), nullptr);
+
+    // Разложение прямо при парсинге
+    JsonColumns<u16s> wide;
+    StreamedJsonParser<u16s, u8s> parser;
+    parser.streamItems(u"$.rows", [&](JsonValueU& row) {
+        wide.add(row);
+        return true;
+    });
+    EXPECT_EQ(parser.parseAll(R"({"rows": [{"k": true}, {"k": false, "имя": "текст"}, {}]})"), JsonParseResult::Success);
+    EXPECT_EQ(wide.rows(), 3);
+    EXPECT_EQ(wide.find(u"k")->booleans, (std::vector<uint8_t>{0b01}));
+    EXPECT_EQ(wide.find(u"k")->validity, (std::vector<uint8_t>{0b011}));
+    EXPECT_EQ(wide.find(u"имя")->text(1), "текст");
+}
+
+TEST(SimJson, JsonPath) {
+    auto [json, err, l, c] = JsonValue::parse(R"({
+        "store": {
+            "items": [
+                {"id": 1, "name": "pen", "price": 8.5, "tags": ["a", "b"]},
+                {"id": 2, "name": "book", "price": 12, "info": {"name": "inner"}},
+                {"id": 3, "name": "lamp", "price": 25, "tags": []},
+                {"id": 4, "price": "free"}
+            ],
+            "limit": 10
+        }
+    })");
+    ASSERT_EQ(err, JsonParseResult::Success);
+
+    auto ids = [&](ssa query) {
+        JsonPath<u8s> path{query};
+        EXPECT_TRUE(path.is_valid()) << query;
+        std::vector<int64_t> res;
+        for (const JsonValue* v : path.select(json)) {
+            res.push_back(v->is_integer() ? v->as_integer() : -1);
+        }
+        return res;
+    };
+    EXPECT_EQ(ids("$.store.items[?@.price > 10].id"), (std::vector<int64_t>{2, 3}));
+    EXPECT_EQ(ids("$.store.items[?(@.price > $.store.limit && @.name != 'lamp')].id"), (std::vector<int64_t>{2}));
+    EXPECT_EQ(ids("$.store.items[?@.tags].id"), (std::vector<int64_t>{1, 3}));
+    EXPECT_EQ(ids("$.store.items[?!@.tags && @.price == 12].id"), (std::vector<int64_t>{2}));
+    EXPECT_EQ(ids("$.store.items[?length(@.tags) == 2 || count(@.*) == 2].id"), (std::vector<int64_t>{1, 4}));
+    EXPECT_EQ(ids("$.store.items[?@.name == \"pen\" || @.price == \"free\"]['id']"), (std::vector<int64_t>{1, 4}));
+    EXPECT_EQ(ids("$.store.items[?@.missing == @.other].id"), (std::vector<int64_t>{1, 2, 3, 4}));
+    EXPECT_EQ(ids("$.store.items[?@.price <= 12].id"), (std::vector<int64_t>{1, 2}));
+    EXPECT_EQ(ids("$.store.items[0, -1].id"), (std::vector<int64_t>{1, 4}));
+    EXPECT_EQ(ids("$.store.items[1:].id"), (std::vector<int64_t>{2, 3, 4}));
+    EXPECT_EQ(ids("$.store.items[::-2].id"), (std::vector<int64_t>{4, 2}));
+    EXPECT_EQ(ids("$.store.items[:2].id"), (std::vector<int64_t>{1, 2}));
+    EXPECT_EQ(ids("$.store.items[9].id"), (std::vector<int64_t>{}));
+    EXPECT_EQ(ids("$..items[?value(@..name) == 'inner'].id"), (std::vector<int64_t>{}));
+    EXPECT_EQ(ids("$..items[?@.info.name == 'inner'].id"), (std::vector<int64_t>{2}));
+
+    JsonPath<u8s> names{"$..name"};
+    std::vector<stringa> found;
+    for (const JsonValue* v : names.select(json)) {
+        found.emplace_back(v->as_text());
+    }
+    std::sort(found.begin(), found.end());
+    EXPECT_EQ(found, (std::vector<stringa>{"book", "inner", "lamp", "pen"}));
+    // Ссылки на значения внутри документа
+    EXPECT_EQ(JsonPath<u8s>{"$.store.limit"}.select(json).front(), &json("store"_h, "limit"_h));
+    EXPECT_EQ(JsonPath<u8s>{"$"}.select(json).front(), &json);
+    EXPECT_EQ(JsonPath<u8s>{"$.store.*"}.select(json).size(), 2);
+
+    for (ssa bad : std::initializer_list<ssa>{"", "store", "$.", "$[", "$[1", "$.store.items[?@.price]]",
+            "$[?@.a == 1 +]", "$[?@..a == 1]", "$[?'a']", "$[?length(@.*) == 1]", "$[01]", "$ .a "}) {
+        JsonPath<u8s> path{bad};
+        EXPECT_FALSE(path.is_valid()) << bad;
+    }
+    JsonPath<u8s> bad{"$.a[?@.b = 1]"};
+    EXPECT_EQ(bad.error_pos(), 9);
+
+    JsonValueU wide = JsonValueU::parse_utf8(R"({"ключ": [{"v": "😀"}, {"v": "ab"}]})").value;
+    JsonPath<u16s> widePath{u"$['\\u043a\\u043b\\u044e\\u0447'][?length(@.v) == 1]"};
+    ASSERT_TRUE(widePath.is_valid());
+    EXPECT_EQ(widePath.select(wide).size(), 1);
+
+    // Большой массив фильтруется параллельно, порядок сохраняется
+    JsonValue big;
+    for (int i = 0; i < 50000; i++) {
+        big["rows"_h][i]["v"_h] = i % 7;
+    }
+    JsonPath<u8s> sevens{"$.rows[?@.v == 6]"};
+    sevens.parallel_threshold = 1000;
+    auto rows = sevens.select(big);
+    ASSERT_EQ(rows.size(), 7142);
+    EXPECT_EQ(rows[0], &big("rows"_h)[6]);
+    EXPECT_EQ(rows.back(), &big("rows"_h)[49999 - 49999 % 7 - 1]);
+    EXPECT_TRUE(std::is_sorted(rows.begin(), rows.end()));
+
+    // Упаковка массивов не меняет результат запросов
+    stringa codesText = R"({"codes":[7,8,9],"pts":[{"x":[1,2]},{"x":3}],"flags":[true,false]})";
+    ParseLimits packedLimits;
+    packedLimits.packed_arrays = true;
+    JsonValue packed = JsonValue::parse(codesText, packedLimits).value, unpacked = JsonValue::parse(codesText).value;
+    ASSERT_TRUE(packed("codes"_h).is_packed());
+    for (const char* query : {"$.codes[0]", "$.codes[-1]", "$.codes[*]", "$.codes[::-2]", "$..x", "$..x[1]",
+            "$.codes[?@ > 7]", "$.flags[?@ == true]", "$[?@[1] == 8]"}) {
+        JsonPath<u8s> path{ssa{query, strlen(query)}};
+        auto fromPacked = path.select(packed), fromUnpacked = path.select(unpacked);
+        ASSERT_EQ(fromPacked.size(), fromUnpacked.size()) << query;
+        for (size_t i = 0; i < fromPacked.size(); i++) {
+            EXPECT_EQ(fromPacked[i]->store(), fromUnpacked[i]->store()) << query;
+        }
+    }
+    EXPECT_EQ(JsonPath<u8s>{"$.codes[0]"}.select(packed).front()->as_integer(), 7);
+}
+
+TEST(SimJson, JsonIndex) {
+    auto [json, err, l, c] = JsonValue::parse(R"([
+        {"id": 10, "meta": {"sku": "A-1"}},
+        {"id": 20, "meta": {"sku": "B-2"}},
+        {"id": 10, "meta": {"sku": "C-3"}},
+        {"name": "no id"}
+    ])");
+    ASSERT_EQ(err, JsonParseResult::Success);
+    JsonIndex<u8s> byId(json, "/id");
+    JsonIndex<u8s> bySku(json, "/meta/sku");
+    EXPECT_EQ(byId.size(), 2);
+    EXPECT_EQ(bySku.size(), 3);
+
+    // Для повторов находится первый
+    const JsonValue* item = byId.find(10);
+    ASSERT_NE(item, nullptr);
+    EXPECT_EQ(item->at("meta").at("sku").as_text(), "A-1");
+    EXPECT_EQ(bySku.find("B-2")->at("id").as_integer(), 20);
+    EXPECT_EQ(bySku.find("Z-9"), nullptr);
+    EXPECT_EQ(byId.find(30), nullptr);
+
+    // Добавленные в конец элементы находятся после update
+    auto& items = *json.as_array();
+    items.emplace_back(JsonValue::parse(R"({"id": 30, "meta": {"sku": "D-4"}})").value);
+    EXPECT_TRUE(byId.is_stale());
+    byId.update();
+    EXPECT_FALSE(byId.is_stale());
+    EXPECT_EQ(byId.find(30)->at("meta").at("sku").as_text(), "D-4");
+
+    // Удаление из середины: индекс устарел, пока его не обновят
+    items.erase(items.begin());
+    const JsonIndex<u8s>& constIndex = byId;
+    EXPECT_TRUE(constIndex.is_stale());
+    // bySku пропустил update после добавления, и длина снова совпала - такое is_stale не видит
+    EXPECT_FALSE(bySku.is_stale());
+    byId.update();
+    bySku.update();
+    EXPECT_FALSE(constIndex.is_stale());
+    EXPECT_EQ(byId.find(10)->at("meta").at("sku").as_text(), "C-3");
+    EXPECT_EQ(bySku.find("A-1"), nullptr);
+
+    // Изменение ключа на месте
+    items[0]["id"] = 25;
+    EXPECT_EQ(byId.find(20), nullptr);
+    byId.update(0);
+    EXPECT_EQ(byId.find(25), &items[0]);
+}
+
+TEST(SimJson, Stats) {
+    StreamedJsonParser<u8s> parser;
+    ssa text = R"({"a": [1, 2.5, 123456789012345678901], "b": "x\ny", "c": {"d": null, "e": true}})";
+    ASSERT_EQ(parser.parseAll(text), JsonParseResult::Success);
+
+    JsonStoreStats::thread_total() = {};
+    lstring<u8s, 0, true> out;
+    parser.result_.store(out);
+    const JsonStoreStats& ss = JsonStoreStats::thread_total();
+
+#if SIMJSON_STATS != 0
+    {
+        const JsonParseStats& ps = parser.stats_;
+        EXPECT_EQ(ps.bytes, text.length());
+        EXPECT_EQ(ps.values[Json::Object], 2);
+        EXPECT_EQ(ps.values[Json::Array], 1);
+        EXPECT_EQ(ps.values[Json::Real], 2);
+        EXPECT_EQ(ps.values[Json::Text], 1);
+        EXPECT_EQ(ps.escapes, 1);
+        EXPECT_EQ(ps.integers, 1);
+        EXPECT_EQ(ps.reals, 2);
+        EXPECT_EQ(ps.fallbacks, 1);
+        EXPECT_EQ(ps.max_depth, 2);
+        EXPECT_GT(ps.allocations, 0);
+
+        EXPECT_EQ(ss.calls, 1);
+        EXPECT_EQ(ss.bytes, out.length());
+        EXPECT_EQ(ss.values[Json::Boolean], 1);
+        EXPECT_EQ(ss.escaped_strings, 1);
+        EXPECT_EQ(ss.max_depth, 2);
+    }
+#else
+    // Без SIMJSON_STATS статистика разбора пустая и не занимает места в парсере, счётчики записи не трогаются
+    EXPECT_TRUE(std::is_empty_v<decltype(parser.stats_)>);
+    EXPECT_EQ(ss.calls, 0);
+#endif
+}
+
+TEST(SimJson, MemoryUsage) {
+    auto [json, err, l, c] = JsonValue::parse(R"({"key": "short", "long": "a rather long text that does not fit locally", "arr": [1, 2, 3]})");
+    ASSERT_EQ(err, JsonParseResult::Success);
+    JsonMemoryUsage usage = json.memory_usage();
+    EXPECT_GT(usage.containers, 3 * sizeof(JsonValue));
+    EXPECT_GT(usage.strings, 45);
+    EXPECT_EQ(usage.keys, 0);
+    EXPECT_EQ(usage.shared, 0);
+    EXPECT_EQ(usage.exclusive(), usage.total());
+
+    // Запас ёмкости массива
+    json["arr"].as_array()->reserve(100);
+    JsonMemoryUsage reserved = json.memory_usage();
+    EXPECT_EQ(reserved.slack, 97 * sizeof(JsonValue));
+
+    // Массив, на который ссылается ещё одно значение, становится общим
+    JsonValue arr = json.at("arr");
+    JsonMemoryUsage withShared = json.memory_usage();
+    EXPECT_EQ(withShared.total(), reserved.total());
+    EXPECT_EQ(withShared.shared, arr.memory_usage().total());
+    EXPECT_GT(withShared.shared, 0);
+
+    // Массив, доступный по двум ключам, считается один раз, добавляется только узел ключа
+    json["again"] = arr;
+    JsonMemoryUsage twice = json.memory_usage();
+    EXPECT_EQ(twice.slack, reserved.slack);
+    EXPECT_LT(twice.total() - withShared.total(), arr.memory_usage().total());
+}
+
+TEST(SimJson, Compact) {
+    auto [json, err, l, c] = JsonValue::parse(R"([
+        {"status": "a rather long status that does not fit locally", "n": [1, 2, 3]},
+        {"status": "a rather long status that does not fit locally", "n": [4, 5, 6]},
+        {"status": "a rather long status that does not fit locally", "n": [7]}
+    ])");
+    ASSERT_EQ(err, JsonParseResult::Success);
+    lstring<u8s, 0, true> before, after;
+    json.store(before, false, true);
+    json.as_array()->reserve(50);
+
+    JsonMemoryUsage usage = json.memory_usage();
+    size_t released = json.compact();
+    JsonMemoryUsage compacted = json.memory_usage();
+    EXPECT_EQ(compacted.slack, 0);
+    EXPECT_GT(released, 47 * sizeof(JsonValue));
+    EXPECT_LT(compacted.total(), usage.total());
+    // Общий буфер строки считается один раз
+    EXPECT_EQ(compacted.strings * 3, usage.strings);
+    // Две из трёх одинаковых строк теперь ссылаются на буфер первой
+    EXPECT_EQ(json[1]["status"].as_text().symbols(), json[0]["status"].as_text().symbols());
+    EXPECT_EQ(json[2]["status"].as_text().symbols(), json[0]["status"].as_text().symbols());
+
+    // Порядок обхода ключей после уменьшения хэш-таблицы может поменяться
+    json.store(after, false, true);
+    EXPECT_EQ(simple_str<u8s>(before), simple_str<u8s>(after));
+    // Повторно освобождать нечего
+    EXPECT_EQ(json.compact(), 0);
+}
+
+TEST(SimJson, Reclaimer) {
+    // Такая вложенность переполнила бы стек при рекурсивном уничтожении
+    std::string deep(200000, '[');
+    deep.append(200000, ']');
+    auto [json, err, l, c] = JsonValue::parse(ssa{deep.data(), deep.size()});
+    ASSERT_EQ(err, JsonParseResult::Success);
+    EXPECT_EQ(JsonReclaimer<u8s>::destroy(std::move(json)), 200000);
+
+    JsonReclaimer<u8s> manual(false);
+    JsonValue doc = JsonValue::parse(R"({"a": [1, {"b": 2}], "c": {"d": []}})").value;
+    JsonValue kept = doc.at("c");
+    manual.retire(std::move(doc));
+    // Простые значения отпускаются сразу
+    manual.retire(JsonValue(1));
+    EXPECT_EQ(manual.pending(), 1);
+    // Корень и "a" с объектом внутри, "c" ещё жив через kept
+    EXPECT_EQ(manual.drain(), 3);
+    EXPECT_EQ(manual.pending(), 0);
+    EXPECT_TRUE(kept.at("d").is_array());
+
+    {
+        JsonReclaimer<u8s> worker;
+        for (int i = 0; i < 10; i++) {
+            worker.retire(JsonValue::parse(R"([{"x": [1, 2]}, {"y": {}}])").value);
+        }
+    }
+    JsonReclaimer<u8s>::background().retire(std::move(kept));
+}
+
+TEST(SimJson, Snapshot) {
+    JsonSnapshot<u8s> config(JsonValue::parse(R"({"workers": 1})").value);
+    auto first = config.get();
+    EXPECT_EQ(first->at("workers").as_integer(), 1);
+    config.publish(JsonValue::parse(R"({"workers": 2})").value);
+    EXPECT_EQ(config.version(), 1);
+    // Взятый ранее снимок не меняется
+    EXPECT_EQ(first->at("workers").as_integer(), 1);
+    EXPECT_EQ(config.get()->at("workers").as_integer(), 2);
+
+    std::string path = (std::filesystem::temp_directory_path() / "simjson_snapshot_test.json").string();
+    auto write = [&](const char* text) {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file << text;
+    };
+    auto waitVersion = [&](uint64_t v) {
+        for (int i = 0; i < 500 && config.version() < v; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return config.version() >= v;
+    };
+    JsonValue defaults = JsonValue::parse(R"({"workers": 4, "log": {"level": "info", "file": "app.log"}})").value;
+    write(R"({"workers": 8, "log": {"level": "debug"}})");
+    EXPECT_EQ(config.watch(path.c_str(), defaults, std::chrono::milliseconds(10)), JsonParseResult::Success);
+    EXPECT_EQ(config.version(), 2);
+    auto cfg = config.get();
+    EXPECT_EQ(cfg->at("workers").as_integer(), 8);
+    EXPECT_EQ(cfg->at("log").at("level").as_text(), "debug");
+    EXPECT_EQ(cfg->at("log").at("file").as_text(), "app.log");
+    // Значения по умолчанию не тронуты
+    EXPECT_EQ(defaults.at("log").at("level").as_text(), "info");
+    // Снимок не делит узлы с исходными значениями по умолчанию
+    defaults["log"]["file"] = "other.log";
+    EXPECT_EQ(cfg->at("log").at("file").as_text(), "app.log");
+
+    // Испорченный файл не публикуется, исправленный - публикуется
+    write(R"({"workers": )");
+    EXPECT_NE(config.load(path.c_str(), defaults), JsonParseResult::Success);
+    EXPECT_EQ(config.version(), 2);
+    write(R"({"workers": 16, "extra": true})");
+    ASSERT_TRUE(waitVersion(3));
+    EXPECT_EQ(config.get()->at("workers").as_integer(), 16);
+    EXPECT_EQ(config.get()->at("log").at("level").as_text(), "info");
+    EXPECT_EQ(config.get()->at("log").at("file").as_text(), "app.log");
+    config.stop();
+
+    // Неудачная первая загрузка не становится точкой отсчёта: файл без изменений перечитывается
+    write(R"({"workers": )");
+    EXPECT_NE(config.watch(path.c_str(), defaults, std::chrono::milliseconds(10)), JsonParseResult::Success);
+    uint64_t version = config.version();
+    write(R"({"workers": 32})");
+    ASSERT_TRUE(waitVersion(version + 1));
+    EXPECT_EQ(config.get()->at("workers").as_integer(), 32);
+    EXPECT_EQ(config.get()->at("log").at("file").as_text(), "other.log");
+    config.stop();
+    std::filesystem::remove(path);
+}
+
+TEST(SimJson, Binary) {
+    ParseLimits limits;
+    limits.packed_arrays = true;
+    auto [json, err, l, c] = JsonValue::parse(R"({
+        "items": [{"id": 1, "name": "first"}, {"id": 2, "name": "second", "tags": ["a", "b"]}],
+        "ratio": 0.5, "ok": true, "none": null, "codes": [3, 4, 5], "text": "Привет"
+    })", limits);
+    ASSERT_EQ(err, JsonParseResult::Success);
+    lstring<u8s, 0, true> data;
+    JsonBinary<u8s>::store(json, data);
+
+    JsonBinary<u8s> bin;
+    ASSERT_TRUE(bin.attach(data.symbols(), data.length()));
+    JsonBinaryValue<u8s> root = bin.root();
+    EXPECT_TRUE(root.is_object());
+    EXPECT_EQ(root.size(), 6);
+    EXPECT_EQ(root["items"][1]["name"].as_text(), "second");
+    EXPECT_EQ(root["items"][1]["tags"][1].as_text(), "b");
+    EXPECT_EQ(root["items"][0]["id"].as_integer(), 1);
+    EXPECT_EQ(root["ratio"].as_real(), 0.5);
+    EXPECT_TRUE(root["ok"].as_boolean());
+    EXPECT_TRUE(root["none"].is_null());
+    EXPECT_EQ(root["codes"][2].as_integer(), 5);
+    EXPECT_EQ(root["text"].as_text(), "Привет");
+    EXPECT_TRUE(root["missing"].is_undefined());
+    EXPECT_TRUE(root["items"][5].is_undefined());
+    size_t found = 0;
+    for (size_t i = 0; i < root.size(); i++) {
+        found += !root.key(i).is_empty() && root[root.key(i)].type() == root.at(i).type();
+    }
+    EXPECT_EQ(found, 6);
+
+    // Обратно в обычный json
+    lstring<u8s, 0, true> before, after;
+    json.store(before, false, true);
+    root.to_json().store(after, false, true);
+    EXPECT_EQ(simple_str<u8s>(before), simple_str<u8s>(after));
+
+    // Через файл, отображённый в память
+    std::string path = (std::filesystem::temp_directory_path() / "simjson_binary_test.sjb").string();
+    ASSERT_TRUE(JsonBinary<u8s>::save(json, path.c_str()));
+    JsonBinary<u8s> mapped;
+    ASSERT_TRUE(mapped.open(path.c_str()));
+    EXPECT_EQ(mapped.root()["items"][1]["id"].as_integer(), 2);
+    // Перезапись не трогает уже отображённый файл
+    ASSERT_TRUE(JsonBinary<u8s>::save(JsonValue::parse(R"({"items": []})").value, path.c_str()));
+    EXPECT_EQ(mapped.root()["items"][1]["id"].as_integer(), 2);
+    JsonBinary<u8s> reopened;
+    ASSERT_TRUE(reopened.open(path.c_str()));
+    EXPECT_EQ(reopened.root()["items"].size(), 0);
+    reopened.close();
+    mapped.close();
+    std::filesystem::remove(path);
+
+    // Испорченные смещения корня и элемента читаются как Undefined
+    lstring<u8s, 0, true> corrupt;
+    corrupt += simple_str<u8s>(data);
+    uint64_t rootAt, bad = ~uint64_t(7);
+    std::memcpy(&rootAt, corrupt.symbols() + 16, 8);
+    std::memcpy(corrupt.str() + 16, &bad, 8);
+    ASSERT_TRUE(bin.attach(corrupt.symbols(), corrupt.length()));
+    EXPECT_TRUE(bin.root().is_undefined());
+    std::memcpy(corrupt.str() + 16, &rootAt, 8);
+    std::memcpy(corrupt.str() + rootAt + 8 + 16, &bad, 8);
+    ASSERT_TRUE(bin.attach(corrupt.symbols(), corrupt.length()));
+    EXPECT_TRUE(bin.root().is_object());
+    EXPECT_TRUE(bin.root().at(size_t(0)).is_undefined());
+
+    // Чужие и обрезанные данные
+    JsonBinary<u16s> wide;
+    EXPECT_FALSE(wide.attach(data.symbols(), data.length()));
+    ASSERT_TRUE(bin.attach(data.symbols(), data.length() / 2));
+    EXPECT_TRUE(bin.root().is_undefined());
+}
+
+static std::string bytes(std::initializer_list<uint8_t> list) {
+    return std::string(list.begin(), list.end());
+}
+
+// Общая часть проверки двоичных форматов: полный цикл, подача по байту, незаконченные данные, другой тип символов,
+// ограничение глубины
+template<typename Parser>
+void checkBinaryFormat(void (*encode)(const JsonValue&, lstring<u8s, 0, true>&),
+        JsonValue::parse_result (*decode)(ssa, const ParseLimits&, std::pmr::memory_resource*),
+        JsonValueTempl<u16s>::parse_result (*decode16)(ssa, const ParseLimits&, std::pmr::memory_resource*)) {
+    auto [json, err, l, c] = JsonValue::parse(R"({"id": 12, "big": 5000000000, "neg": -70000, "ratio": 1.0, "ok": true,
+        "none": null, "text": "Привет", "list": [1, [2, 3], {"a": false}], "empty": {}})");
+    ASSERT_EQ(err, JsonParseResult::Success);
+    lstring<u8s, 0, true> data;
+    encode(json, data);
+    auto [back, err1, l1, c1] = decode(data, {}, nullptr);
+    ASSERT_EQ(err1, JsonParseResult::Success);
+    EXPECT_EQ(c1, data.length());
+    EXPECT_TRUE(back["ratio"].is_real());
+    EXPECT_EQ(back["big"].as_integer(), 5000000000);
+    EXPECT_EQ(back["neg"].as_integer(), -70000);
+    lstring<u8s, 0, true> before, after;
+    json.store(before, false, true);
+    back.store(after, false, true);
+    EXPECT_EQ(simple_str<u8s>(before), simple_str<u8s>(after));
+
+    Parser parser;
+    JsonParseResult state = JsonParseResult::Pending;
+    for (size_t i = 0; i < data.length(); i++) {
+        state = parser.processChunk(ssa{data.symbols() + i, 1}, i + 1 == data.length());
+        if (i + 1 < data.length()) {
+            ASSERT_EQ(state, JsonParseResult::Pending);
+        }
+    }
+    EXPECT_EQ(state, JsonParseResult::Success);
+    EXPECT_EQ(parser.result_["list"][1][1].as_integer(), 3);
+    parser.reset();
+    EXPECT_EQ(parser.parseAll(ssa{data.symbols(), data.length() / 2}), JsonParseResult::Pending);
+    parser.reset();
+    std::string two = bytes({0x01, 0x02});
+    EXPECT_EQ(parser.parseAll(ssa{two.data(), two.size()}), JsonParseResult::NoNeedMore);
+
+    auto wide = decode16(data, {}, nullptr);
+    ASSERT_EQ(wide.err, JsonParseResult::Success);
+    EXPECT_EQ(wide.value[u"text"].as_text(), u"Привет");
+
+    ParseLimits limits;
+    limits.max_depth = 2;
+    EXPECT_EQ(decode(data, limits, nullptr).err, JsonParseResult::LimitExceeded);
+}
+
+TEST(SimJson, Cbor) {
+    checkBinaryFormat<StreamedCborParser<u8s>>(to_cbor<u8s>, from_cbor<u8s>, from_cbor<u16s>);
+
+    // Пример из RFC 8949, в том числе с длиной неопределённого размера
+    lstring<u8s, 0, true> out;
+    to_cbor(JsonValue::parse("[1,[2,3],[4,5]]").value, out);
+    EXPECT_EQ(std::string(out.symbols(), out.length()), bytes({0x83, 0x01, 0x82, 0x02, 0x03, 0x82, 0x04, 0x05}));
+    std::string indefinite = bytes({0x9F, 0x01, 0x82, 0x02, 0x03, 0x9F, 0x04, 0x05, 0xFF, 0xFF});
+    auto res = from_cbor<u8s>(ssa{indefinite.data(), indefinite.size()});
+    ASSERT_EQ(res.err, JsonParseResult::Success);
+    EXPECT_EQ(res.value.store(), "[1,[2,3],[4,5]]");
+
+    // Половинная точность, строка байтов, строка частями, целый ключ
+    std::string misc = bytes({0xA3, 0x01, 0xF9, 0x3C, 0x00, 0x61, 'b', 0x43, 0x01, 0x02, 0x03,
+        0x61, 's', 0x7F, 0x62, 'a', 'b', 0x61, 'c', 0xFF});
+    res = from_cbor<u8s>(ssa{misc.data(), misc.size()});
+    ASSERT_EQ(res.err, JsonParseResult::Success);
+    EXPECT_EQ(res.value["1"].as_real(), 1.0);
+    EXPECT_EQ(res.value["b"].as_text(), "AQID");
+    EXPECT_EQ(res.value["s"].as_text(), "abc");
+
+    std::string broken = bytes({0x81, 0x1C});
+    EXPECT_EQ(from_cbor<u8s>(ssa{broken.data(), broken.size()}).err, JsonParseResult::Error);
+    std::string unbalanced = bytes({0xBF, 0x61, 'a', 0xFF});
+    EXPECT_EQ(from_cbor<u8s>(ssa{unbalanced.data(), unbalanced.size()}).err, JsonParseResult::Error);
+
+    // Строка неопределённой длины из множества частей упирается в ограничения, не дожидаясь break
+    ParseLimits limits;
+    limits.max_string_length = 10;
+    limits.max_bytes = 100;
+    StreamedCborParser<u8s> limited;
+    limited.limits_ = limits;
+    std::string head = bytes({0x7F}), part = bytes({0x63, 'a', 'b', 'c'});
+    JsonParseResult state = limited.processChunk(ssa{head.data(), head.size()}, false);
+    for (int i = 0; i < 1000 && state == JsonParseResult::Pending; i++) {
+        state = limited.processChunk(ssa{part.data(), part.size()}, false);
+    }
+    EXPECT_EQ(state, JsonParseResult::LimitExceeded);
+}
+
+TEST(SimJson, Msgpack) {
+    checkBinaryFormat<StreamedMsgpackParser<u8s>>(to_msgpack<u8s>, from_msgpack<u8s>, from_msgpack<u16s>);
+
+    // Самые короткие формы чисел и строк
+    lstring<u8s, 0, true> out;
+    to_msgpack(JsonValue::parse(R"([1,-1,300,-200,"a",null,true])").value, out);
+    EXPECT_EQ(std::string(out.symbols(), out.length()),
+        bytes({0x97, 0x01, 0xFF, 0xCD, 0x01, 0x2C, 0xD1, 0xFF, 0x38, 0xA1, 'a', 0xC0, 0xC3}));
+
+    // bin, ext, float32, uint64 вне int64_t, целый ключ
+    std::string misc = bytes({0x85, 0xA1, 'b', 0xC4, 0x03, 0x01, 0x02, 0x03, 0xA1, 'e', 0xD4, 0x01, 0x00,
+        0xA1, 'f', 0xCA, 0x3F, 0x80, 0x00, 0x00, 0xA1, 'u', 0xCF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+        0x07, 0x90});
+    auto res = from_msgpack<u8s>(ssa{misc.data(), misc.size()});
+    ASSERT_EQ(res.err, JsonParseResult::Success);
+    EXPECT_EQ(res.value["b"].as_text(), "AQID");
+    EXPECT_TRUE(res.value["e"].is_null());
+    EXPECT_EQ(res.value["f"].as_real(), 1.0);
+    EXPECT_TRUE(res.value["u"].is_real());
+    EXPECT_TRUE(res.value["7"].is_array());
+
+    std::string broken = bytes({0x91, 0xC1});
+    EXPECT_EQ(from_msgpack<u8s>(ssa{broken.data(), broken.size()}).err, JsonParseResult::Error);
+}
+
 #if 0
 TEST(SimJson, JsonParseBig) {
     stringa content1 = get_file_content("citm_catalog.json");
@@ -545,6 +1743,39 @@ TEST(SimJson, JsonParseBig) {
     std::cout << "Parse and store at " << ms_double.count() / 10.0 << std::endl;
 
 }
+
+TEST(SimJson, JsonParseSmall) {
+    stringa message;
+    {
+        JsonValue json;
+        for (int i = 0; i < 20; i++) {
+            JsonValue& item = json["items"_h][i];
+            item["id"_h] = i;
+            item["name"_h] = "item name";
+            item["price"_h] = i * 1.5;
+            item["tags"_h] = {"one", "two"};
+        }
+        message = json.store();
+    }
+    const size_t count = 100000;
+
+    // Новый парсер на каждое сообщение
+    auto t1 = std::chrono::high_resolution_clock::now();
+    for (size_t idx = 0; idx < count; idx++) {
+        StreamedJsonParser<u8s> parser;
+        EXPECT_EQ(parser.parseAll(message), JsonParseResult::Success);
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+    // Парсер из пула потока
+    for (size_t idx = 0; idx < count; idx++) {
+        EXPECT_EQ(JsonValue::parse(message).err, JsonParseResult::Success);
+    }
+    auto t3 = std::chrono::high_resolution_clock::now();
+
+    std::chrono::duration<double> fresh = t2 - t1, pooled = t3 - t2;
+    std::cout << "Message " << message.length() << " bytes, new parser " << count / fresh.count()
+              << " msg/s, pooled parser " << count / pooled.count() << " msg/s" << std::endl;
+}
 #endif
 
 } // namespace simjson::tests